@@ -0,0 +1,174 @@
+#include "ascii_catalog.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+AsciiCatalogReader::AsciiCatalogReader(const string &filename, const char comment_symbol):
+    Good(false), Data(nullptr), Length(0), CommentSymbol(comment_symbol)
+{
+    int fd = open(filename.c_str(),O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) return;
+
+    struct stat st;
+    if ( fstat(fd,&st) == 0 && S_ISREG(st.st_mode) ) {
+        Length = st.st_size;
+        if ( Length == 0 ) { // an empty catalog cannot be mapped but is valid
+            Good = true;
+        } else {
+            void *addr = mmap(nullptr,Length,PROT_READ,MAP_PRIVATE,fd,0);
+            if ( addr != MAP_FAILED ) {
+                madvise(addr,Length,MADV_SEQUENTIAL);
+                Data = static_cast<const char*>(addr);
+                Good = true;
+            } else {
+                Length = 0;
+            }
+        }
+    }
+
+    close(fd); // the mapping stays valid
+}
+
+
+AsciiCatalogReader::~AsciiCatalogReader()
+{
+    if ( Data ) munmap(const_cast<char*>(Data),Length);
+}
+
+
+bool AsciiCatalogReader::good() const
+{
+    return Good;
+}
+
+
+size_t AsciiCatalogReader::CountLines() const
+{
+    size_t N_lines = 0;
+    const char *ptr = Data;
+    const char *end = Data + Length;
+
+    while ( ptr < end ) {
+        ++N_lines;
+        ptr = static_cast<const char*>(memchr(ptr,'\n',end-ptr));
+        if ( ptr == nullptr ) break;
+        ++ptr;
+    }
+
+    return N_lines;
+}
+
+
+/*
+    Decimal number parser.
+
+    Numbers with at most 19 significant digits and mantissa below 2^53 scaled by
+    10^k with |k| <= 22 are converted exactly by one floating-point multiplication
+    or division (both operands are exact doubles, so the result is correctly rounded).
+    All other forms (long mantissas, large exponents, 'nan', 'inf', hexadecimal
+    numbers etc.) are passed to strtod.
+*/
+static const double pow10_table[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static bool is_delimiter(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+static bool parse_number_slow(const char *&ptr, const char *end, double &val)
+{
+    const char *tok_end = ptr;
+    while ( tok_end < end && !is_delimiter(*tok_end) ) ++tok_end;
+    if ( tok_end == ptr ) return false;
+
+    string tok(ptr,tok_end); // strtod needs null-terminated string
+    char *num_end;
+    val = strtod(tok.c_str(),&num_end);
+    if ( num_end == tok.c_str() ) return false;
+
+    ptr += num_end - tok.c_str();
+    return true;
+}
+
+
+bool AsciiCatalogReader::ParseNumber(const char *&ptr, const char *end, double &val)
+{
+    const char *p = ptr;
+
+    bool neg = false;
+    if ( p < end && (*p == '-' || *p == '+') ) {
+        neg = *p == '-';
+        ++p;
+    }
+
+    uint64_t mant = 0;
+    int N_digits = 0; // significant digits in 'mant'
+    int exp10 = 0;
+    bool has_digits = false;
+    bool exact = true;
+
+    for ( ; p < end && *p >= '0' && *p <= '9'; ++p ) {
+        has_digits = true;
+        if ( N_digits < 19 ) {
+            mant = mant*10 + (*p - '0');
+            if ( mant ) ++N_digits;
+        } else {
+            ++exp10;
+            if ( *p != '0' ) exact = false;
+        }
+    }
+    if ( p < end && *p == '.' ) {
+        for ( ++p; p < end && *p >= '0' && *p <= '9'; ++p ) {
+            has_digits = true;
+            if ( N_digits < 19 ) {
+                mant = mant*10 + (*p - '0');
+                if ( mant ) ++N_digits;
+                --exp10;
+            } else if ( *p != '0' ) {
+                exact = false;
+            }
+        }
+    }
+    if ( !has_digits ) return parse_number_slow(ptr,end,val);
+
+    if ( p < end && (*p == 'e' || *p == 'E') ) {
+        const char *q = p + 1;
+        bool exp_neg = false;
+        if ( q < end && (*q == '-' || *q == '+') ) {
+            exp_neg = *q == '-';
+            ++q;
+        }
+        if ( q < end && *q >= '0' && *q <= '9' ) {
+            int e = 0;
+            for ( ; q < end && *q >= '0' && *q <= '9'; ++q ) {
+                if ( e < 100000 ) e = e*10 + (*q - '0');
+            }
+            exp10 += exp_neg ? -e : e;
+            p = q;
+        }
+    }
+
+    if ( p < end && !is_delimiter(*p) ) return parse_number_slow(ptr,end,val);
+
+    if ( !exact || mant > (UINT64_C(1) << 53) || exp10 < -22 || exp10 > 22 ) {
+        return parse_number_slow(ptr,end,val);
+    }
+
+    val = (double)mant;
+    if ( exp10 < 0 ) val /= pow10_table[-exp10]; else val *= pow10_table[exp10];
+    if ( neg ) val = -val;
+
+    ptr = p;
+    return true;
+}
@@ -0,0 +1,171 @@
+#ifndef ASCII_CATALOG_H
+#define ASCII_CATALOG_H
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "catalog.h"
+#include "rotcen_errors.h"
+
+using namespace std;
+
+//
+// Catalog fields which can be filled from ASCII-file columns
+//
+struct CatalogId
+{
+    static void Set(Catalog &cat, size_t i, double val) { cat.Id(i) = (Catalog::IdType)val; }
+};
+
+struct CatalogX
+{
+    static void Set(Catalog &cat, size_t i, double val) { cat.X(i) = val; }
+};
+
+struct CatalogY
+{
+    static void Set(Catalog &cat, size_t i, double val) { cat.Y(i) = val; }
+};
+
+struct CatalogMag
+{
+    static void Set(Catalog &cat, size_t i, double val) { cat.Mag(i) = val; }
+};
+
+
+//
+// Column specification: the column with 0-based index 'FileColumn' in the file
+// is stored into the catalog field 'Field' (CatalogId, CatalogX, ...)
+//
+template<size_t FileColumn, typename Field>
+struct AsciiColumn
+{
+    static const size_t Index = FileColumn;
+    typedef Field Target;
+};
+
+
+// number of the leading file columns to be parsed for given column specifications
+template<typename... Columns> struct AsciiColumnsWidth;
+
+template<>
+struct AsciiColumnsWidth<>
+{
+    static const size_t Value = 0;
+};
+
+template<typename Column, typename... Rest>
+struct AsciiColumnsWidth<Column,Rest...>
+{
+    static const size_t Value = Column::Index + 1 > AsciiColumnsWidth<Rest...>::Value ?
+                                Column::Index + 1 : AsciiColumnsWidth<Rest...>::Value;
+};
+
+// whether the field 'Field' is filled by one of the column specifications
+template<typename Field, typename... Columns> struct AsciiColumnsFill;
+
+template<typename Field>
+struct AsciiColumnsFill<Field>
+{
+    static const bool Value = false;
+};
+
+template<typename Field, typename Column, typename... Rest>
+struct AsciiColumnsFill<Field,Column,Rest...>
+{
+    static const bool Value = is_same<Field,typename Column::Target>::value ||
+                              AsciiColumnsFill<Field,Rest...>::Value;
+};
+
+
+//
+// Reader of ASCII catalogs (SExtractor's and 'match' output files).
+//
+// The file is memory-mapped and parsed in place, there is no limit of line length.
+// Lines starting (after spaces) by CommentSymbol and empty lines are skipped.
+// The columns to be read are given at compile time, e.g.
+//
+//   AsciiCatalogReader reader(filename);
+//   int ret = reader.Read<AsciiColumn<0,CatalogId>, AsciiColumn<1,CatalogX>, AsciiColumn<2,CatalogY> >(cat);
+//
+// The catalog fields not listed in the specification are filled by zeros.
+//
+class AsciiCatalogReader
+{
+public:
+    AsciiCatalogReader(const string &filename, const char comment_symbol = '#');
+    ~AsciiCatalogReader();
+
+    AsciiCatalogReader(const AsciiCatalogReader&) = delete;
+    AsciiCatalogReader& operator=(const AsciiCatalogReader&) = delete;
+
+    bool good() const;
+
+    // returns ROTCEN_ERROR_OK, ROTCEN_ERROR_INVALID_FILENAME if the file cannot be mapped or
+    // ROTCEN_ERROR_BAD_DATA if a data line contains fewer numbers than needed
+    template<typename... Columns>
+    int Read(Catalog &cat) const;
+
+    // parses a number starting at 'ptr' (not beyond 'end'), on success 'ptr' points to
+    // the first character after the number
+    static bool ParseNumber(const char *&ptr, const char *end, double &val);
+
+private:
+    size_t CountLines() const;
+
+    bool Good;
+    const char *Data;
+    size_t Length;
+    char CommentSymbol;
+};
+
+
+template<typename... Columns>
+int AsciiCatalogReader::Read(Catalog &cat) const
+{
+    static_assert(sizeof...(Columns) > 0, "at least one column must be specified");
+
+    const size_t N_cols = AsciiColumnsWidth<Columns...>::Value;
+    double vals[N_cols];
+
+    if ( !Good ) return ROTCEN_ERROR_INVALID_FILENAME;
+
+    Catalog result(CountLines()); // upper estimate of the number of rows
+    if ( !AsciiColumnsFill<CatalogId,Columns...>::Value ) fill_n(result.Ids(),result.Size(),0);
+    if ( !AsciiColumnsFill<CatalogX,Columns...>::Value ) fill_n(result.X(),result.Size(),0.0);
+    if ( !AsciiColumnsFill<CatalogY,Columns...>::Value ) fill_n(result.Y(),result.Size(),0.0);
+    if ( !AsciiColumnsFill<CatalogMag,Columns...>::Value ) fill_n(result.Mag(),result.Size(),0.0);
+
+    const char *ptr = Data;
+    const char *end = Data + Length;
+    size_t row = 0;
+
+    while ( ptr < end ) {
+        const char *eol = static_cast<const char*>(memchr(ptr,'\n',end-ptr));
+        if ( eol == nullptr ) eol = end;
+
+        while ( ptr < eol && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r') ) ++ptr;
+
+        if ( ptr < eol && *ptr != CommentSymbol ) {
+            for ( size_t k = 0; k < N_cols; ++k ) {
+                while ( ptr < eol && (*ptr == ' ' || *ptr == '\t') ) ++ptr;
+                if ( !ParseNumber(ptr,eol,vals[k]) ) return ROTCEN_ERROR_BAD_DATA;
+            }
+
+            int dummy[] = {0, (Columns::Target::Set(result,row,vals[Columns::Index]), 0)...};
+            (void)dummy;
+            ++row;
+        }
+
+        ptr = eol + 1;
+    }
+
+    result.Resize(row);
+    cat = move(result);
+
+    return ROTCEN_ERROR_OK;
+}
+
+#endif // ASCII_CATALOG_H
@@ -46,9 +46,12 @@ AsciiFile::AsciiFileFlag AsciiFile::ReadLine(size_t N_elems, ...)
     if ( i == strlen(s) ) return AsciiFile::EmptyString;
 //    subs = strndup(s+i,MAX_STR_LEN-i);
     subs = strdup(s+i);
-    if ( errno == ENOMEM ) throw bad_alloc();
+    if ( subs == NULL ) throw bad_alloc();
 
-    if ( subs[0] == CommentSymbol ) return AsciiFile::CommentString;
+    if ( subs[0] == CommentSymbol ) {
+        free(subs);
+        return AsciiFile::CommentString;
+    }
 
     va_list args;
     va_start(args, N_elems);
@@ -91,9 +94,12 @@ AsciiFile::AsciiFileFlag AsciiFile::ReadLine(size_t N_elems, vector<double> *dat
     if ( i == strlen(s) ) return AsciiFile::EmptyString;
     subs = strdup(s+i);
 //    subs = strndup(s+i,MAX_STR_LEN-i);
-    if ( errno == ENOMEM ) throw bad_alloc();
+    if ( subs == NULL ) throw bad_alloc();
 
-    if ( subs[0] == CommentSymbol ) return AsciiFile::CommentString;
+    if ( subs[0] == CommentSymbol ) {
+        free(subs);
+        return AsciiFile::CommentString;
+    }
 
     data->clear();
     start = subs;
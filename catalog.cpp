@@ -0,0 +1,115 @@
+#include "catalog.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#define CATALOG_ALIGN 64 // columns alignment in bytes
+
+
+Catalog::Catalog(): N_objs(0), Storage(), IdCol(nullptr), XCol(nullptr), YCol(nullptr), MagCol(nullptr)
+{
+}
+
+
+Catalog::Catalog(size_t N_objects): Catalog()
+{
+    Allocate(N_objects);
+}
+
+
+Catalog::Catalog(Catalog &&other):
+    N_objs(other.N_objs), Storage(move(other.Storage)),
+    IdCol(other.IdCol), XCol(other.XCol), YCol(other.YCol), MagCol(other.MagCol)
+{
+    other.N_objs = 0;
+    other.IdCol = nullptr;
+    other.XCol = other.YCol = other.MagCol = nullptr;
+}
+
+
+Catalog& Catalog::operator=(Catalog &&other)
+{
+    if ( this != &other ) {
+        N_objs = other.N_objs;
+        Storage = move(other.Storage);
+        IdCol = other.IdCol;
+        XCol = other.XCol;
+        YCol = other.YCol;
+        MagCol = other.MagCol;
+
+        other.N_objs = 0;
+        other.IdCol = nullptr;
+        other.XCol = other.YCol = other.MagCol = nullptr;
+    }
+    return *this;
+}
+
+
+/*
+    One allocation for all the columns: [IDs | X | Y | Mag], each column
+    starts at CATALOG_ALIGN boundary
+*/
+void Catalog::Allocate(size_t N_objects)
+{
+    N_objs = N_objects;
+    if ( N_objects == 0 ) {
+        Storage.reset();
+        IdCol = nullptr;
+        XCol = YCol = MagCol = nullptr;
+        return;
+    }
+
+    auto col_size = [](size_t n) { return (n + CATALOG_ALIGN - 1)/CATALOG_ALIGN*CATALOG_ALIGN; };
+
+    size_t id_bytes = col_size(N_objects*sizeof(IdType));
+    size_t val_bytes = col_size(N_objects*sizeof(double));
+
+    Storage.reset(new char[id_bytes + 3*val_bytes + CATALOG_ALIGN]);
+
+    uintptr_t addr = reinterpret_cast<uintptr_t>(Storage.get());
+    char *ptr = Storage.get() + (CATALOG_ALIGN - addr % CATALOG_ALIGN) % CATALOG_ALIGN;
+
+    IdCol = reinterpret_cast<IdType*>(ptr);
+    XCol = reinterpret_cast<double*>(ptr + id_bytes);
+    YCol = reinterpret_cast<double*>(ptr + id_bytes + val_bytes);
+    MagCol = reinterpret_cast<double*>(ptr + id_bytes + 2*val_bytes);
+}
+
+
+Catalog Catalog::Clone() const
+{
+    Catalog cat(N_objs);
+
+    if ( N_objs ) {
+        memcpy(cat.IdCol,IdCol,N_objs*sizeof(IdType));
+        memcpy(cat.XCol,XCol,N_objs*sizeof(double));
+        memcpy(cat.YCol,YCol,N_objs*sizeof(double));
+        memcpy(cat.MagCol,MagCol,N_objs*sizeof(double));
+    }
+
+    return cat;
+}
+
+
+void Catalog::Resize(size_t N_objects)
+{
+    if ( N_objects == N_objs ) return;
+
+    if ( N_objects < N_objs ) { // the columns stay at their places, only the tails are dropped
+        N_objs = N_objects;
+        return;
+    }
+
+    Catalog cat(N_objects);
+
+    size_t n = min(N_objects,N_objs);
+    if ( n ) {
+        memcpy(cat.IdCol,IdCol,n*sizeof(IdType));
+        memcpy(cat.XCol,XCol,n*sizeof(double));
+        memcpy(cat.YCol,YCol,n*sizeof(double));
+        memcpy(cat.MagCol,MagCol,n*sizeof(double));
+    }
+
+    *this = move(cat);
+}
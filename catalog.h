@@ -0,0 +1,87 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+using namespace std;
+
+//
+// Catalog of objects detected in a frame.
+//
+// The catalog is a structure-of-arrays: integer IDs, X and Y coordinates (pixel
+// coordinates or RA and DEC in degrees for astrometric catalogs) and magnitudes.
+// All the columns are stored in one contiguous allocation, each column is aligned
+// to a cache line. The IDs are expected to be 1..Size() (as SExtractor's NUMBER),
+// so the object with given ID is at row ID-1.
+//
+// The catalog is move-only: it is handed from reader to matcher and solver without
+// copying (use Clone for an explicit copy). The element accessors are unchecked
+// in release builds (assert is used in debug ones).
+//
+class Catalog
+{
+public:
+    typedef long IdType;
+
+    Catalog();
+    explicit Catalog(size_t N_objects);
+
+    Catalog(Catalog &&other);
+    Catalog& operator=(Catalog &&other);
+
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+
+    Catalog Clone() const;
+
+    // change number of objects keeping the first min(N_objects,Size()) of them
+    // (shrinking does not reallocate)
+    void Resize(size_t N_objects);
+
+    size_t Size() const { return N_objs; }
+    bool Empty() const { return N_objs == 0; }
+
+    IdType* Ids() { return IdCol; }
+    double* X() { return XCol; }
+    double* Y() { return YCol; }
+    double* Mag() { return MagCol; }
+
+    const IdType* Ids() const { return IdCol; }
+    const double* X() const { return XCol; }
+    const double* Y() const { return YCol; }
+    const double* Mag() const { return MagCol; }
+
+    IdType& Id(size_t i) { assert(i < N_objs); return IdCol[i]; }
+    double& X(size_t i) { assert(i < N_objs); return XCol[i]; }
+    double& Y(size_t i) { assert(i < N_objs); return YCol[i]; }
+    double& Mag(size_t i) { assert(i < N_objs); return MagCol[i]; }
+
+    IdType Id(size_t i) const { assert(i < N_objs); return IdCol[i]; }
+    double X(size_t i) const { assert(i < N_objs); return XCol[i]; }
+    double Y(size_t i) const { assert(i < N_objs); return YCol[i]; }
+    double Mag(size_t i) const { assert(i < N_objs); return MagCol[i]; }
+
+    // row of the object with given ID
+    static size_t Row(IdType id) { assert(id > 0); return id - 1; }
+
+private:
+    void Allocate(size_t N_objects);
+
+    size_t N_objs;
+    unique_ptr<char[]> Storage;
+
+    IdType *IdCol;
+    double *XCol, *YCol, *MagCol;
+};
+
+
+//
+// Table of matched objects IDs: one column per frame, the rows of all the
+// columns are the same object.
+//
+typedef vector<vector<Catalog::IdType> > IdTable;
+
+#endif // CATALOG_H
@@ -0,0 +1,134 @@
+#include "catalog_io.h"
+#include "rotcen_errors.h"
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include <fitsio.h>
+
+
+/*
+    The function writes catalog in SExtractor's ASCII format (NUMBER, X_IMAGE, Y_IMAGE, MAG_BEST)
+*/
+int write_ascii_catalog(const string &filename, const Catalog &data)
+{
+    FILE *cat = fopen(filename.c_str(),"w");
+    if ( cat == NULL ) return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+
+    for ( size_t i = 0; i < data.Size(); ++i ) {
+        fprintf(cat,"%10ld %11.4f %11.4f %9.4f\n",data.Id(i),data.X(i),data.Y(i),data.Mag(i));
+    }
+
+    if ( fclose(cat) ) return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+/*
+    The function finds the column by name (case-insensitive) or returns 'default_col'
+    for an empty name
+*/
+static int fits_column(fitsfile *file, const string &name, int default_col, int &colnum, int &fits_status)
+{
+    if ( name.empty() ) {
+        colnum = default_col;
+        return fits_status;
+    }
+
+    vector<char> templ(name.begin(),name.end()); // CFITSIO wants non-const template
+    templ.push_back('\0');
+
+    return fits_get_colnum(file,CASEINSEN,templ.data(),&colnum,&fits_status);
+}
+
+
+/*
+    The routine reads X and Y columns of FITS binary table ('solve-field' RDLS and XYLS files).
+    The rows are read in the chunks of CFITSIO optimal size, both columns of a chunk are read
+    while its rows are in CFITSIO buffers, directly into the catalog.
+*/
+int read_fits_catalog(const string &filename, Catalog &cat, const string &x_column, const string &y_column)
+{
+    int fits_status = 0;
+    fitsfile *file = nullptr;
+    int ret_code = ROTCEN_ERROR_OK;
+
+    try {
+        fits_open_table(&file,filename.c_str(),READONLY,&fits_status);
+        if ( fits_status ) {
+            file = nullptr;
+            throw fits_status;
+        }
+
+        int x_col, y_col;
+        fits_column(file,x_column,1,x_col,fits_status);
+        fits_column(file,y_column,2,y_col,fits_status);
+        if ( fits_status ) throw fits_status;
+
+        long nrows, opt_nrows;
+        fits_get_num_rows(file,&nrows,&fits_status);
+        fits_get_rowsize(file,&opt_nrows,&fits_status);
+        if ( fits_status ) throw fits_status;
+
+        if ( opt_nrows < 1 ) opt_nrows = 1;
+
+        Catalog data(nrows);
+
+        for ( long row = 0; row < nrows; row += opt_nrows ) {
+            long n = min(opt_nrows,nrows-row);
+
+            fits_read_col(file,TDOUBLE,x_col,row+1,1,n,NULL,(void*)(data.X()+row),NULL,&fits_status);
+            fits_read_col(file,TDOUBLE,y_col,row+1,1,n,NULL,(void*)(data.Y()+row),NULL,&fits_status);
+            if ( fits_status ) throw fits_status;
+        }
+
+        // IDs are the row numbers
+        Catalog::IdType *ids = data.Ids();
+        for ( long i = 0; i < nrows; ++i ) ids[i] = i + 1;
+        fill_n(data.Mag(),nrows,0.0);
+
+        cat = move(data);
+    } catch (int err) {
+        ret_code =  err + ROTCEN_ERROR_CFITSIO;
+    } catch (bad_alloc &ex) {
+        ret_code = ROTCEN_ERROR_BAD_ALLOC;
+    }
+
+    if ( file ) {
+        int status = 0;
+        fits_close_file(file,&status);
+    }
+
+    return ret_code;
+}
+
+
+int write_fits_catalog(const string &filename, const Catalog &cat, const string &x_column, const string &y_column)
+{
+    int fits_status = 0;
+    fitsfile *file;
+
+    string name = "!" + filename; // overwrite existing file
+    fits_create_file(&file,name.c_str(),&fits_status);
+    if ( fits_status ) return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+
+    // CFITSIO wants non-const strings
+    vector<char> x_name(x_column.begin(),x_column.end()), y_name(y_column.begin(),y_column.end());
+    x_name.push_back('\0');
+    y_name.push_back('\0');
+    char format[] = "1D";
+    char *ttype[] = {x_name.data(), y_name.data()};
+    char *tform[] = {format, format};
+
+    fits_create_tbl(file,BINARY_TBL,0,2,ttype,tform,NULL,NULL,&fits_status);
+    fits_write_col(file,TDOUBLE,1,1,1,cat.Size(),(void*)cat.X(),&fits_status);
+    fits_write_col(file,TDOUBLE,2,1,1,cat.Size(),(void*)cat.Y(),&fits_status);
+
+    int status = 0;
+    fits_close_file(file,&status);
+    if ( !fits_status ) fits_status = status;
+
+    return fits_status ? ROTCEN_ERROR_CFITSIO + fits_status : ROTCEN_ERROR_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef CATALOG_IO_H
+#define CATALOG_IO_H
+
+#include <string>
+
+#include "catalog.h"
+#include "ascii_catalog.h"
+
+using namespace std;
+
+//
+// Columns of SExtractor's ASCII catalog (the first ones of 'match' output files too)
+//
+typedef AsciiColumn<0,CatalogId> NumberColumn;
+typedef AsciiColumn<1,CatalogX> XImageColumn;
+typedef AsciiColumn<2,CatalogY> YImageColumn;
+typedef AsciiColumn<3,CatalogMag> MagBestColumn;
+
+
+//
+// The function reads the given columns of ASCII catalog.
+// The catalog fields which are not read are filled by zeros.
+//
+template<typename... Columns>
+int read_ascii_catalog(const string &filename, Catalog &cat)
+{
+    AsciiCatalogReader reader(filename);
+
+    if ( !reader.good() ) return ROTCEN_ERROR_INVALID_FILENAME;
+
+    return reader.Read<Columns...>(cat);
+}
+
+
+// writes catalog in SExtractor's ASCII format (NUMBER, X_IMAGE, Y_IMAGE, MAG_BEST)
+int write_ascii_catalog(const string &filename, const Catalog &cat);
+
+// reads the columns of FITS binary table ('solve-field' RDLS and XYLS files) given by names
+// (case-insensitive, the first two columns for the empty ones) into X and Y, IDs are the row
+// numbers. CFITSIO errors are displaced by ROTCEN_ERROR_CFITSIO.
+int read_fits_catalog(const string &filename, Catalog &cat, const string &x_column = "", const string &y_column = "");
+
+// writes X and Y of the catalog as FITS binary table with the given column names (the
+// file is overwritten). CFITSIO errors are displaced by ROTCEN_ERROR_CFITSIO.
+int write_fits_catalog(const string &filename, const Catalog &cat, const string &x_column = "X", const string &y_column = "Y");
+
+#endif // CATALOG_IO_H
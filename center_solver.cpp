@@ -0,0 +1,987 @@
+#include "center_solver.h"
+#include "rotcen_errors.h"
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <numeric>
+
+#include <gsl/gsl_linalg.h>
+
+#define CENTER_SOLVER_CHUNK 64 // number of tracks in a chunk of SolveNormal
+
+
+StarTracks::StarTracks(): N_stars(0), N_frames(0), Ids(), Xs(), Ys()
+{
+}
+
+
+StarTracks::StarTracks(const vector<Catalog> &cats, const IdTable &ids):
+    N_stars(ids.empty() ? 0 : ids[0].size()), N_frames(ids.size()), Ids(), Xs(), Ys()
+{
+    if ( N_frames ) Ids = ids[0];
+
+    Xs.resize(N_stars*N_frames);
+    Ys.resize(N_stars*N_frames);
+
+    for ( size_t frame = 0; frame < N_frames; ++frame ) {
+        const Catalog &cat = cats[frame];
+        for ( size_t star = 0; star < N_stars; ++star ) {
+            size_t row = Catalog::Row(ids[frame][star]);
+            Xs[star*N_frames + frame] = cat.X(row);
+            Ys[star*N_frames + frame] = cat.Y(row);
+        }
+    }
+}
+
+
+TrackCircle::TrackCircle(): Valid(false), X(0.0), Y(0.0), R(0.0), Rms(0.0)
+{
+}
+
+
+StarTracks::StarTracks(const StarTracks &tracks, const vector<size_t> &stars, const vector<size_t> &frames):
+    N_stars(stars.size()), N_frames(frames.size()), Ids(), Xs(), Ys()
+{
+    Ids.reserve(N_stars);
+    Xs.resize(N_stars*N_frames);
+    Ys.resize(N_stars*N_frames);
+
+    for ( size_t star = 0; star < N_stars; ++star ) {
+        Ids.push_back(tracks.Id(stars[star]));
+        for ( size_t frame = 0; frame < N_frames; ++frame ) {
+            Xs[star*N_frames + frame] = tracks.X(stars[star],frames[frame]);
+            Ys[star*N_frames + frame] = tracks.Y(stars[star],frames[frame]);
+        }
+    }
+}
+
+
+CenterSolution::CenterSolution(): X(0.0), Y(0.0), ResidualSS(0.0), N_eq(0), Inliers(), Circles(), Rotations()
+{
+}
+
+
+BootstrapParams::BootstrapParams(): Mode(BootstrapParams::Stars), N_replicates(0), Seed(1)
+{
+}
+
+
+BootstrapResult::BootstrapResult():
+    N_replicates(0), N_failed(0), X(0.0), Y(0.0), Cxx(0.0), Cxy(0.0), Cyy(0.0),
+    EllipseA(0.0), EllipseB(0.0), EllipseAngle(0.0)
+{
+}
+
+
+RobustSolverParams::RobustSolverParams():
+    Loss(RobustSolverParams::Tukey), InlierThresh(2.0), N_hypotheses(512), MaxIter(50), Seed(1)
+{
+}
+
+
+CenterSolver::CenterSolver(WorkerPool *pool): Pool(pool)
+{
+}
+
+
+int CenterSolver::SolveQR(const StarTracks &tracks, CenterSolution &sol) const
+{
+    int ret_code = ROTCEN_ERROR_OK;
+
+    gsl_matrix* sys_mat = NULL;
+    gsl_vector *b = NULL;
+    gsl_vector *x = NULL;
+    gsl_vector *tau = NULL;
+    gsl_vector *res = NULL;
+
+    size_t N_circles = tracks.Stars();
+    size_t N_objs = tracks.Frames();
+
+    size_t N_eq = N_circles*(N_objs-1)*N_objs/2; // number of linear equations
+
+    if ( N_objs < 2 || N_eq < 2 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    try {
+        gsl_set_error_handler_off(); // turn off GSL default error handler
+
+        sys_mat = gsl_matrix_alloc(N_eq,2);
+        if ( sys_mat == NULL ) throw (int)ROTCEN_ERROR_BAD_ALLOC;
+
+        b = gsl_vector_alloc(N_eq);
+        if ( b == NULL ) throw (int)ROTCEN_ERROR_BAD_ALLOC;
+
+        x = gsl_vector_alloc(2);
+        if ( x == NULL ) throw (int)ROTCEN_ERROR_BAD_ALLOC;
+
+        tau = gsl_vector_alloc(2);
+        if ( tau == NULL ) throw (int)ROTCEN_ERROR_BAD_ALLOC;
+
+        res = gsl_vector_alloc(N_eq);
+        if ( res == NULL ) throw (int)ROTCEN_ERROR_BAD_ALLOC;
+
+        // fill system matrix and right-hand part:
+        size_t i = 0;
+        for ( size_t i_circ = 0; i_circ < N_circles; ++i_circ ) {
+            for ( size_t i_obj = 0; i_obj < (N_objs-1); ++i_obj ) {
+                double x1 = tracks.X(i_circ,i_obj);
+                double y1 = tracks.Y(i_circ,i_obj);
+
+                for ( size_t j = i_obj+1; j < N_objs; ++j ) {
+                    double x2 = tracks.X(i_circ,j);
+                    double y2 = tracks.Y(i_circ,j);
+
+                    gsl_matrix_set(sys_mat,i,0,2.0*(x2-x1));
+                    gsl_matrix_set(sys_mat,i,1,2.0*(y2-y1));
+
+                    gsl_vector_set(b,i,x2*x2+y2*y2-x1*x1-y1*y1);
+                    ++i;
+                }
+            }
+        }
+
+        if ( gsl_linalg_QR_decomp(sys_mat,tau) ) throw (int)ROTCEN_ERROR_CANNOT_SOLVE;
+
+        if ( gsl_linalg_QR_lssolve(sys_mat,tau,b,x,res) ) throw (int)ROTCEN_ERROR_CANNOT_SOLVE;
+
+        sol.X = gsl_vector_get(x,0);
+        sol.Y = gsl_vector_get(x,1);
+        sol.N_eq = N_eq;
+
+        // compute residual
+        sol.ResidualSS = 0.0;
+        for ( size_t i = 0; i < N_eq; ++i ) {
+            sol.ResidualSS += gsl_vector_get(res,i)*gsl_vector_get(res,i);
+        }
+    } catch (int err) {
+        ret_code = err;
+    }
+
+    gsl_matrix_free(sys_mat);
+    gsl_vector_free(b);
+    gsl_vector_free(x);
+    gsl_vector_free(tau);
+    gsl_vector_free(res);
+
+    return ret_code;
+}
+
+
+/*
+    Sums of the normal equations over all the point pairs of the tracks
+    (coordinates are relative to the origin 'x0','y0')
+*/
+struct NormalSums
+{
+    NormalSums(): Axx(0.0), Axy(0.0), Ayy(0.0), Bx(0.0), By(0.0)
+    {
+    }
+
+    void Add(const NormalSums &s)
+    {
+        Axx += s.Axx;
+        Axy += s.Axy;
+        Ayy += s.Ayy;
+        Bx += s.Bx;
+        By += s.By;
+    }
+
+    double Axx, Axy, Ayy; // A^T*A / 4
+    double Bx, By;        // A^T*b / 2
+};
+
+
+/*
+    Contribution of one track. With u = x - x0, v = y - y0 and q = u^2 + v^2 the
+    equation of the pair (i,j) is 2*(uj-ui)*uc + 2*(vj-vi)*vc = qj - qi. The pair (i,j)
+    has weight wi*wj (unit weights if 'w' is NULL), the pair sums are W*(weighted
+    centered sums) over the points.
+*/
+static void track_sums(const double *x, const double *y, const double *w, size_t n,
+                       double x0, double y0, NormalSums &sums)
+{
+    double sw = 0.0, mu = 0.0, mv = 0.0, mq = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double wi = w ? w[i] : 1.0;
+        double u = x[i] - x0;
+        double v = y[i] - y0;
+        sw += wi;
+        mu += wi*u;
+        mv += wi*v;
+        mq += wi*(u*u + v*v);
+    }
+    if ( !(sw > 0.0) ) return;
+
+    mu /= sw;
+    mv /= sw;
+    mq /= sw;
+
+    double suu = 0.0, suv = 0.0, svv = 0.0, suq = 0.0, svq = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double wi = w ? w[i] : 1.0;
+        double u = x[i] - x0;
+        double v = y[i] - y0;
+        double du = u - mu;
+        double dv = v - mv;
+        double dq = u*u + v*v - mq;
+        suu += wi*du*du;
+        suv += wi*du*dv;
+        svv += wi*dv*dv;
+        suq += wi*du*dq;
+        svq += wi*dv*dq;
+    }
+
+    sums.Axx += sw*suu;
+    sums.Axy += sw*suv;
+    sums.Ayy += sw*svv;
+    sums.Bx += sw*suq;
+    sums.By += sw*svq;
+}
+
+
+/*
+    Weighted sum of squared residuals of the track equations for the center (xc,yc): the
+    residual of the pair (i,j) is dj - di, where d is squared distance of a point to the center.
+    Number of the pairs with non-zero weight is added to 'N_eq'.
+*/
+static double track_residual(const double *x, const double *y, const double *w, size_t n,
+                             double xc, double yc, size_t &N_eq)
+{
+    double sw = 0.0, md = 0.0;
+    size_t n_used = 0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double wi = w ? w[i] : 1.0;
+        if ( wi > 0.0 ) ++n_used;
+        sw += wi;
+        md += wi*((x[i]-xc)*(x[i]-xc) + (y[i]-yc)*(y[i]-yc));
+    }
+    if ( n_used ) N_eq += n_used*(n_used-1)/2;
+    if ( !(sw > 0.0) ) return 0.0;
+
+    md /= sw;
+
+    double sdd = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double wi = w ? w[i] : 1.0;
+        double dd = (x[i]-xc)*(x[i]-xc) + (y[i]-yc)*(y[i]-yc) - md;
+        sdd += wi*dd*dd;
+    }
+
+    return sw*sdd;
+}
+
+
+/*
+    Radial residuals of a track: distances of the points to the center (xc,yc)
+    minus their median
+*/
+static void radial_residuals(const double *x, const double *y, size_t n, double xc, double yc,
+                             double *e, vector<double> &buff)
+{
+    buff.resize(n);
+    for ( size_t i = 0; i < n; ++i ) {
+        e[i] = hypot(x[i]-xc,y[i]-yc);
+        buff[i] = e[i];
+    }
+
+    auto mid = buff.begin() + n/2;
+    nth_element(buff.begin(),mid,buff.end());
+    double med = *mid;
+    if ( n % 2 == 0 ) med = 0.5*(med + *max_element(buff.begin(),mid));
+
+    for ( size_t i = 0; i < n; ++i ) e[i] -= med;
+}
+
+
+/*
+    The helpers below process the tracks in fixed-size chunks on the pool and
+    reduce the chunk results in the chunks order ('w' are per-point weights
+    in the tracks order or NULL)
+*/
+static NormalSums normal_sums(WorkerPool &pool, const StarTracks &tracks, const double *w, double x0, double y0)
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+    size_t N_chunks = (N_stars + CENTER_SOLVER_CHUNK - 1)/CENTER_SOLVER_CHUNK;
+
+    vector<NormalSums> chunk_sums(N_chunks);
+    pool.Run(N_chunks,[&](size_t i_chunk) {
+        size_t end = min(N_stars,(i_chunk+1)*CENTER_SOLVER_CHUNK);
+        for ( size_t star = i_chunk*CENTER_SOLVER_CHUNK; star < end; ++star ) {
+            track_sums(tracks.X(star),tracks.Y(star),w ? w + star*N_frames : nullptr,N_frames,x0,y0,chunk_sums[i_chunk]);
+        }
+    });
+
+    NormalSums sums;
+    for ( auto &s: chunk_sums ) sums.Add(s);
+
+    return sums;
+}
+
+
+static double residual_ss(WorkerPool &pool, const StarTracks &tracks, const double *w, double xc, double yc, size_t &N_eq)
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+    size_t N_chunks = (N_stars + CENTER_SOLVER_CHUNK - 1)/CENTER_SOLVER_CHUNK;
+
+    vector<double> chunk_res(N_chunks,0.0);
+    vector<size_t> chunk_eq(N_chunks,0);
+    pool.Run(N_chunks,[&](size_t i_chunk) {
+        size_t end = min(N_stars,(i_chunk+1)*CENTER_SOLVER_CHUNK);
+        for ( size_t star = i_chunk*CENTER_SOLVER_CHUNK; star < end; ++star ) {
+            chunk_res[i_chunk] += track_residual(tracks.X(star),tracks.Y(star),w ? w + star*N_frames : nullptr,
+                                                 N_frames,xc,yc,chunk_eq[i_chunk]);
+        }
+    });
+
+    double res = 0.0;
+    N_eq = 0;
+    for ( size_t i = 0; i < N_chunks; ++i ) {
+        res += chunk_res[i];
+        N_eq += chunk_eq[i];
+    }
+
+    return res;
+}
+
+
+// A^T*A*c = A^T*b, i.e. 4*[Axx Axy; Axy Ayy]*c = 2*[Bx; By]
+static bool solve_normal(const NormalSums &sums, double &uc, double &vc)
+{
+    double det = sums.Axx*sums.Ayy - sums.Axy*sums.Axy;
+    if ( !(fabs(det) > 1.0E-12*(sums.Axx*sums.Ayy)) ) return false; // degenerated (or NaN)
+
+    uc = 0.5*(sums.Ayy*sums.Bx - sums.Axy*sums.By)/det;
+    vc = 0.5*(sums.Axx*sums.By - sums.Axy*sums.Bx)/det;
+
+    return true;
+}
+
+
+int CenterSolver::SolveNormal(const StarTracks &tracks, CenterSolution &sol) const
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+
+    if ( N_frames < 2 || N_stars*N_frames*(N_frames-1)/2 < 2 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    // the origin is moved to the first point to reduce round-off errors of squared coordinates
+    double x0 = tracks.X(0,0);
+    double y0 = tracks.Y(0,0);
+
+    double uc, vc;
+    if ( !solve_normal(normal_sums(pool,tracks,nullptr,x0,y0),uc,vc) ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    sol.X = uc + x0;
+    sol.Y = vc + y0;
+    sol.ResidualSS = residual_ss(pool,tracks,nullptr,sol.X,sol.Y,sol.N_eq);
+    sol.Inliers.clear();
+    sol.Circles.clear();
+    sol.Rotations.clear();
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int CenterSolver::SolveRobust(const StarTracks &tracks, const RobustSolverParams &params, CenterSolution &sol) const
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+    size_t N_points = N_stars*N_frames;
+
+    if ( N_frames < 2 || N_stars*N_frames*(N_frames-1)/2 < 2 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+    size_t N_chunks = (N_stars + CENTER_SOLVER_CHUNK - 1)/CENTER_SOLVER_CHUNK;
+
+    double x0 = tracks.X(0,0);
+    double y0 = tracks.Y(0,0);
+
+    // RANSAC hypotheses. The first one is the plain least-squares solution,
+    // the others are the intersections of the bisectors of two random chords
+
+    size_t N_hyp = params.N_hypotheses + 1;
+    vector<double> hyp_x(N_hyp), hyp_y(N_hyp);
+    vector<char> hyp_valid(N_hyp,0);
+
+    hyp_valid[0] = solve_normal(normal_sums(pool,tracks,nullptr,x0,y0),hyp_x[0],hyp_y[0]);
+
+    mt19937 gen(params.Seed);
+    uniform_int_distribution<size_t> star_dist(0,N_stars-1);
+    uniform_int_distribution<size_t> frame_dist(0,N_frames-1);
+
+    for ( size_t h = 1; h < N_hyp; ++h ) {
+        double a[2][2], b[2];
+        for ( int k = 0; k < 2; ++k ) {
+            size_t star = star_dist(gen);
+            size_t i = frame_dist(gen);
+            size_t j = frame_dist(gen);
+            while ( j == i ) j = frame_dist(gen);
+
+            double ui = tracks.X(star,i) - x0, vi = tracks.Y(star,i) - y0;
+            double uj = tracks.X(star,j) - x0, vj = tracks.Y(star,j) - y0;
+            a[k][0] = 2.0*(uj-ui);
+            a[k][1] = 2.0*(vj-vi);
+            b[k] = uj*uj + vj*vj - ui*ui - vi*vi;
+        }
+
+        double det = a[0][0]*a[1][1] - a[0][1]*a[1][0];
+        double norm = hypot(a[0][0],a[0][1])*hypot(a[1][0],a[1][1]);
+        if ( !(fabs(det) > 1.0E-3*norm) ) continue; // (almost) parallel bisectors
+
+        hyp_x[h] = (b[0]*a[1][1] - b[1]*a[0][1])/det;
+        hyp_y[h] = (a[0][0]*b[1] - a[1][0]*b[0])/det;
+        hyp_valid[h] = 1;
+    }
+
+    // MSAC scores of the hypotheses
+
+    double thresh2 = params.InlierThresh*params.InlierThresh;
+    vector<double> hyp_score(N_hyp,HUGE_VAL);
+
+    pool.Run(N_hyp,[&](size_t h) {
+        if ( !hyp_valid[h] ) return;
+
+        vector<double> e(N_frames), buff;
+        double score = 0.0;
+        for ( size_t star = 0; star < N_stars; ++star ) {
+            radial_residuals(tracks.X(star),tracks.Y(star),N_frames,hyp_x[h]+x0,hyp_y[h]+y0,e.data(),buff);
+            for ( auto ei: e ) score += min(ei*ei,thresh2);
+        }
+        hyp_score[h] = score;
+    });
+
+    size_t best = min_element(hyp_score.begin(),hyp_score.end()) - hyp_score.begin();
+    if ( !hyp_valid[best] ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    double uc = hyp_x[best];
+    double vc = hyp_y[best];
+
+    // IRLS refinement
+
+    vector<double> e(N_points), w(N_points), abs_e(N_points);
+
+    auto compute_residuals = [&](double xc, double yc) {
+        pool.Run(N_chunks,[&](size_t i_chunk) {
+            vector<double> buff;
+            size_t end = min(N_stars,(i_chunk+1)*CENTER_SOLVER_CHUNK);
+            for ( size_t star = i_chunk*CENTER_SOLVER_CHUNK; star < end; ++star ) {
+                radial_residuals(tracks.X(star),tracks.Y(star),N_frames,xc,yc,e.data()+star*N_frames,buff);
+            }
+        });
+    };
+
+    for ( size_t iter = 0; iter < params.MaxIter; ++iter ) {
+        compute_residuals(uc+x0,vc+y0);
+
+        for ( size_t i = 0; i < N_points; ++i ) abs_e[i] = fabs(e[i]);
+        nth_element(abs_e.begin(),abs_e.begin()+N_points/2,abs_e.end());
+        double scale = max(1.4826*abs_e[N_points/2],1.0E-6); // MAD estimate of sigma
+
+        if ( params.Loss == RobustSolverParams::Huber ) {
+            double k = 1.345*scale;
+            for ( size_t i = 0; i < N_points; ++i ) w[i] = fabs(e[i]) <= k ? 1.0 : k/fabs(e[i]);
+        } else {
+            double k = 4.685*scale;
+            for ( size_t i = 0; i < N_points; ++i ) {
+                double r = e[i]/k;
+                w[i] = fabs(r) < 1.0 ? (1.0-r*r)*(1.0-r*r) : 0.0;
+            }
+        }
+
+        double uc_new, vc_new;
+        if ( !solve_normal(normal_sums(pool,tracks,w.data(),x0,y0),uc_new,vc_new) ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+        double shift = hypot(uc_new-uc,vc_new-vc);
+        uc = uc_new;
+        vc = vc_new;
+        if ( shift < 1.0E-6 ) break;
+    }
+
+    sol.X = uc + x0;
+    sol.Y = vc + y0;
+    sol.ResidualSS = residual_ss(pool,tracks,w.data(),sol.X,sol.Y,sol.N_eq);
+
+    compute_residuals(sol.X,sol.Y);
+
+    sol.Circles.clear();
+    sol.Rotations.clear();
+    sol.Inliers.assign(N_stars,0);
+    for ( size_t star = 0; star < N_stars; ++star ) {
+        for ( size_t i = 0; i < N_frames; ++i ) {
+            if ( fabs(e[star*N_frames+i]) <= params.InlierThresh ) ++sol.Inliers[star];
+        }
+    }
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+/*
+    Algebraic circle fit of n >= 3 points (Chernov's formulation).
+
+    With the centered coordinates and z = x^2 + y^2 the fits minimize
+    A^T*M*A subject to A^T*N*A = 1 (M is the moments matrix of (z,x,y,1)).
+    The solution corresponds to the smallest non-negative root 'eta' of the
+    characteristic polynomial det(M - eta*N), eta = 0 for Kasa fit. The center is
+
+      xc = (Mxz*(Myy-eta) - Myz*Mxy)/(2*DET), yc = (Myz*(Mxx-eta) - Mxz*Mxy)/(2*DET),
+      DET = eta^2 - eta*Mz + Mxx*Myy - Mxy^2
+
+    The information matrix of the center (inverse of the covariance without s^2 factor)
+    is the Schur complement of the geometric fit J^T*J matrix.
+*/
+static void fit_circle(const double *x, const double *y, size_t n, CenterSolver::CircleFit fit,
+                       TrackCircle &circ, double info[3])
+{
+    circ = TrackCircle();
+
+    double mx = 0.0, my = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        mx += x[i];
+        my += y[i];
+    }
+    mx /= n;
+    my /= n;
+
+    double Mxx = 0.0, Myy = 0.0, Mxy = 0.0, Mxz = 0.0, Myz = 0.0, Mzz = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double xi = x[i] - mx;
+        double yi = y[i] - my;
+        double zi = xi*xi + yi*yi;
+        Mxx += xi*xi;
+        Myy += yi*yi;
+        Mxy += xi*yi;
+        Mxz += xi*zi;
+        Myz += yi*zi;
+        Mzz += zi*zi;
+    }
+    Mxx /= n;
+    Myy /= n;
+    Mxy /= n;
+    Mxz /= n;
+    Myz /= n;
+    Mzz /= n;
+
+    double Mz = Mxx + Myy;
+    double Cov_xy = Mxx*Myy - Mxy*Mxy;
+    double Var_z = Mzz - Mz*Mz;
+
+    double eta = 0.0;
+
+    if ( fit != CenterSolver::Kasa ) {
+        double A0 = Mxz*(Mxz*Myy - Myz*Mxy) + Myz*(Myz*Mxx - Mxz*Mxy) - Var_z*Cov_xy;
+        double A1 = Var_z*Mz + 4.0*Cov_xy*Mz - Mxz*Mxz - Myz*Myz;
+        double A2, A3, A4;
+        if ( fit == CenterSolver::Pratt ) { // A0 + A1*eta + A2*eta^2 + 4*eta^4
+            A2 = 4.0*Cov_xy - 3.0*Mz*Mz - Mzz;
+            A3 = 0.0;
+            A4 = 4.0;
+        } else {                            // A0 + A1*eta + A2*eta^2 + 4*Mz*eta^3
+            A2 = -3.0*Mz*Mz - Mzz;
+            A3 = 4.0*Mz;
+            A4 = 0.0;
+        }
+
+        // Newton iterations from 0 (the polynomial is monotonic up to the smallest root)
+        double p = A0;
+        for ( int iter = 0; iter < 100; ++iter ) {
+            double dp = A1 + eta*(2.0*A2 + eta*(3.0*A3 + 4.0*A4*eta));
+            double eta_new = eta - p/dp;
+            if ( eta_new == eta || !isfinite(eta_new) ) break;
+            double p_new = A0 + eta_new*(A1 + eta_new*(A2 + eta_new*(A3 + eta_new*A4)));
+            if ( fabs(p_new) >= fabs(p) ) break;
+            eta = eta_new;
+            p = p_new;
+        }
+    }
+
+    double det = eta*eta - eta*Mz + Cov_xy;
+    if ( !(fabs(det) > 1.0E-12*Mz*Mz) ) return; // the points are (almost) on a line
+
+    double xc = (Mxz*(Myy - eta) - Myz*Mxy)/det/2.0;
+    double yc = (Myz*(Mxx - eta) - Mxz*Mxy)/det/2.0;
+
+    // radius and residuals of the geometric fit, J^T*J of (xc,yc,R)
+
+    double r_mean = 0.0;
+    for ( size_t i = 0; i < n; ++i ) r_mean += hypot(x[i]-mx-xc,y[i]-my-yc);
+    r_mean /= n;
+
+    double rss = 0.0, saa = 0.0, sab = 0.0, sbb = 0.0, sa = 0.0, sb = 0.0;
+    for ( size_t i = 0; i < n; ++i ) {
+        double dx = x[i] - mx - xc;
+        double dy = y[i] - my - yc;
+        double r = hypot(dx,dy);
+        rss += (r - r_mean)*(r - r_mean);
+        if ( r > 0.0 ) {
+            double a = dx/r, b = dy/r;
+            saa += a*a;
+            sab += a*b;
+            sbb += b*b;
+            sa += a;
+            sb += b;
+        }
+    }
+
+    info[0] = saa - sa*sa/n;
+    info[1] = sab - sa*sb/n;
+    info[2] = sbb - sb*sb/n;
+    if ( !(info[0]*info[2] - info[1]*info[1] > 0.0) ) return;
+
+    circ.Valid = true;
+    circ.X = xc + mx;
+    circ.Y = yc + my;
+    circ.R = r_mean;
+    circ.Rms = sqrt(rss/n);
+}
+
+
+int CenterSolver::SolveCircles(const StarTracks &tracks, CircleFit fit, CenterSolution &sol) const
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+
+    if ( N_frames < 3 || N_stars == 0 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+    size_t N_chunks = (N_stars + CENTER_SOLVER_CHUNK - 1)/CENTER_SOLVER_CHUNK;
+
+    vector<TrackCircle> circles(N_stars);
+    vector<double> info(3*N_stars);
+
+    pool.Run(N_chunks,[&](size_t i_chunk) {
+        size_t end = min(N_stars,(i_chunk+1)*CENTER_SOLVER_CHUNK);
+        for ( size_t star = i_chunk*CENTER_SOLVER_CHUNK; star < end; ++star ) {
+            fit_circle(tracks.X(star),tracks.Y(star),N_frames,fit,circles[star],info.data()+3*star);
+        }
+    });
+
+    // variances of the radial residuals (the track covariance is var*info^-1)
+
+    double dof = N_frames > 3 ? N_frames - 3 : 0;
+    vector<double> var;
+    for ( auto &c: circles ) {
+        if ( c.Valid && dof > 0 ) var.push_back(c.Rms*c.Rms*N_frames/dof);
+    }
+
+    double var_min = 0.0;
+    if ( !var.empty() ) {
+        nth_element(var.begin(),var.begin()+var.size()/2,var.end());
+        var_min = 0.1*var[var.size()/2];
+    }
+    if ( !(var_min > 0.0) ) var_min = 1.0; // exact fits (3 frames or noiseless data): geometry weights only
+
+    // sum_k Ik*ck and sum_k Ik (Ik = info_k/var_k), the origin is moved to the first point
+
+    double x0 = tracks.X(0,0);
+    double y0 = tracks.Y(0,0);
+
+    double Ixx = 0.0, Ixy = 0.0, Iyy = 0.0, bx = 0.0, by = 0.0;
+    size_t N_valid = 0;
+    for ( size_t star = 0; star < N_stars; ++star ) {
+        const TrackCircle &c = circles[star];
+        if ( !c.Valid ) continue;
+
+        double v = dof > 0 ? c.Rms*c.Rms*N_frames/dof : 0.0;
+        if ( v < var_min ) v = var_min;
+
+        const double *I = info.data() + 3*star;
+        double u = c.X - x0;
+        double w = c.Y - y0;
+
+        Ixx += I[0]/v;
+        Ixy += I[1]/v;
+        Iyy += I[2]/v;
+        bx += (I[0]*u + I[1]*w)/v;
+        by += (I[1]*u + I[2]*w)/v;
+        ++N_valid;
+    }
+
+    double det = Ixx*Iyy - Ixy*Ixy;
+    if ( N_valid == 0 || !(det > 0.0) ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    sol.X = (Iyy*bx - Ixy*by)/det + x0;
+    sol.Y = (Ixx*by - Ixy*bx)/det + y0;
+    sol.ResidualSS = residual_ss(pool,tracks,nullptr,sol.X,sol.Y,sol.N_eq);
+    sol.Inliers.clear();
+    sol.Rotations.clear();
+    sol.Circles.swap(circles);
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int CenterSolver::SolveRigid(const StarTracks &tracks, CenterSolution &sol) const
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+
+    if ( N_frames < 2 || N_stars < 2 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    // the origin is moved to the first point to reduce round-off errors
+
+    double x0 = tracks.X(0,0);
+    double y0 = tracks.Y(0,0);
+
+    // mean point of the first frame
+
+    double px_mean = 0.0, py_mean = 0.0;
+    for ( size_t star = 0; star < N_stars; ++star ) {
+        px_mean += tracks.X(star,0) - x0;
+        py_mean += tracks.Y(star,0) - y0;
+    }
+    px_mean /= N_stars;
+    py_mean /= N_stars;
+
+    // per-frame fits (each frame is summed in the tracks order, so the result does
+    // not depend on number of threads)
+
+    vector<double> angle(N_frames,0.0), tx(N_frames,0.0), ty(N_frames,0.0);
+
+    pool.Run(N_frames-1,[&](size_t i) {
+        size_t k = i+1;
+
+        double qx_mean = 0.0, qy_mean = 0.0;
+        for ( size_t star = 0; star < N_stars; ++star ) {
+            qx_mean += tracks.X(star,k) - x0;
+            qy_mean += tracks.Y(star,k) - y0;
+        }
+        qx_mean /= N_stars;
+        qy_mean /= N_stars;
+
+        double s_cos = 0.0, s_sin = 0.0;
+        for ( size_t star = 0; star < N_stars; ++star ) {
+            double px = tracks.X(star,0) - x0 - px_mean;
+            double py = tracks.Y(star,0) - y0 - py_mean;
+            double qx = tracks.X(star,k) - x0 - qx_mean;
+            double qy = tracks.Y(star,k) - y0 - qy_mean;
+            s_cos += px*qx + py*qy;
+            s_sin += px*qy - py*qx;
+        }
+
+        angle[k] = atan2(s_sin,s_cos);
+        tx[k] = qx_mean - (cos(angle[k])*px_mean - sin(angle[k])*py_mean);
+        ty[k] = qy_mean - (sin(angle[k])*px_mean + cos(angle[k])*py_mean);
+    });
+
+    // (I - R)^T*(I - R)*c = (I - R)^T*t summed over the frames, (I - R) = [[a,s],[-s,a]]
+
+    double norm = 0.0, bx = 0.0, by = 0.0;
+    for ( size_t k = 1; k < N_frames; ++k ) {
+        double a = 1.0 - cos(angle[k]);
+        double s = sin(angle[k]);
+        norm += a*a + s*s;
+        bx += a*tx[k] - s*ty[k];
+        by += s*tx[k] + a*ty[k];
+    }
+    if ( !(norm > 1.0E-12*(N_frames-1)) ) return ROTCEN_ERROR_CANNOT_SOLVE; // no rotation
+
+    sol.X = bx/norm + x0;
+    sol.Y = by/norm + y0;
+    sol.ResidualSS = residual_ss(pool,tracks,nullptr,sol.X,sol.Y,sol.N_eq);
+    sol.Inliers.clear();
+    sol.Circles.clear();
+    sol.Rotations.resize(N_frames);
+    for ( size_t k = 0; k < N_frames; ++k ) sol.Rotations[k] = angle[k]*180.0/M_PI;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int CenterSolver::Bootstrap(const StarTracks &tracks, const SolveFunction &solve, const BootstrapParams &params,
+                            BootstrapResult &res) const
+{
+    size_t N_stars = tracks.Stars();
+    size_t N_frames = tracks.Frames();
+
+    bool jackknife = params.Mode == BootstrapParams::Jackknife;
+    size_t N_rep = jackknife ? N_frames : params.N_replicates;
+
+    if ( N_stars == 0 || N_frames == 0 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    vector<double> rep_x(N_rep), rep_y(N_rep);
+    vector<char> rep_ok(N_rep,0);
+
+    pool.Run(N_rep,[&](size_t k) {
+        vector<size_t> stars(N_stars), frames;
+
+        iota(stars.begin(),stars.end(),0);
+        if ( jackknife ) {
+            for ( size_t i = 0; i < N_frames; ++i ) if ( i != k ) frames.push_back(i);
+        } else {
+            frames.resize(N_frames);
+            iota(frames.begin(),frames.end(),0);
+
+            seed_seq seq{(unsigned long)params.Seed,(unsigned long)k};
+            mt19937 gen(seq);
+            if ( params.Mode != BootstrapParams::Frames ) {
+                uniform_int_distribution<size_t> dist(0,N_stars-1);
+                for ( auto &s: stars ) s = dist(gen);
+            }
+            if ( params.Mode != BootstrapParams::Stars ) {
+                uniform_int_distribution<size_t> dist(0,N_frames-1);
+                for ( auto &f: frames ) f = dist(gen);
+                sort(frames.begin(),frames.end());
+            }
+        }
+
+        StarTracks rep_tracks(tracks,stars,frames);
+        CenterSolver rep_solver; // serial, the replicates are already concurrent
+        CenterSolution sol;
+
+        if ( solve(rep_solver,rep_tracks,sol) == ROTCEN_ERROR_OK && isfinite(sol.X) && isfinite(sol.Y) ) {
+            rep_x[k] = sol.X;
+            rep_y[k] = sol.Y;
+            rep_ok[k] = 1;
+        }
+    });
+
+    res = BootstrapResult();
+
+    for ( size_t k = 0; k < N_rep; ++k ) {
+        if ( !rep_ok[k] ) {
+            ++res.N_failed;
+            continue;
+        }
+        ++res.N_replicates;
+        res.X += rep_x[k];
+        res.Y += rep_y[k];
+    }
+    if ( res.N_replicates < 2 ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    res.X /= res.N_replicates;
+    res.Y /= res.N_replicates;
+
+    for ( size_t k = 0; k < N_rep; ++k ) {
+        if ( !rep_ok[k] ) continue;
+        double dx = rep_x[k] - res.X;
+        double dy = rep_y[k] - res.Y;
+        res.Cxx += dx*dx;
+        res.Cxy += dx*dy;
+        res.Cyy += dy*dy;
+    }
+
+    double n = res.N_replicates;
+    double norm = jackknife ? (n-1.0)/n : 1.0/(n-1.0);
+    res.Cxx *= norm;
+    res.Cxy *= norm;
+    res.Cyy *= norm;
+
+    // eigenvalues of the covariance matrix, 95% quantile of chi-square distribution with 2 DOF is 5.991
+
+    double half_tr = 0.5*(res.Cxx + res.Cyy);
+    double d = hypot(0.5*(res.Cxx - res.Cyy),res.Cxy);
+    res.EllipseA = sqrt(5.991*(half_tr + d));
+    res.EllipseB = sqrt(5.991*max(half_tr - d,0.0));
+    res.EllipseAngle = 0.5*atan2(2.0*res.Cxy,res.Cxx - res.Cyy)*180.0/M_PI;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+CenterAccumulator::CenterAccumulator(): Moments(), HasOrigin(false), X0(0.0), Y0(0.0), N_points(0)
+{
+}
+
+
+void CenterAccumulator::Add(Catalog::IdType id, double x, double y)
+{
+    if ( !HasOrigin ) { // the origin is moved to the first point as in SolveNormal
+        X0 = x;
+        Y0 = y;
+        HasOrigin = true;
+    }
+
+    auto it = Moments.find(id);
+    if ( it == Moments.end() ) it = Moments.insert(make_pair(id,TrackMoments{0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0})).first;
+    TrackMoments &m = it->second;
+
+    double u = x - X0;
+    double v = y - Y0;
+    double q = u*u + v*v;
+
+    ++m.N;
+    double du = u - m.Mu;
+    double dv = v - m.Mv;
+    double dq = q - m.Mq;
+    m.Mu += du/m.N;
+    m.Mv += dv/m.N;
+    m.Mq += dq/m.N;
+
+    // co-moment update: S_ab += (a - <a>_old)*(b - <b>_new)
+    m.Suu += du*(u - m.Mu);
+    m.Suv += du*(v - m.Mv);
+    m.Svv += dv*(v - m.Mv);
+    m.Suq += du*(q - m.Mq);
+    m.Svq += dv*(q - m.Mq);
+    m.Sqq += dq*(q - m.Mq);
+
+    ++N_points;
+}
+
+
+size_t CenterAccumulator::Tracks() const
+{
+    size_t n = 0;
+    for ( auto &m: Moments ) if ( m.second.N > 1 ) ++n;
+    return n;
+}
+
+
+size_t CenterAccumulator::Points() const
+{
+    return N_points;
+}
+
+
+int CenterAccumulator::Solve(CenterSolution &sol) const
+{
+    NormalSums sums;
+    size_t N_eq = 0;
+
+    for ( auto &it: Moments ) {
+        const TrackMoments &m = it.second;
+        if ( m.N < 2 ) continue;
+        sums.Axx += m.N*m.Suu;
+        sums.Axy += m.N*m.Suv;
+        sums.Ayy += m.N*m.Svv;
+        sums.Bx += m.N*m.Suq;
+        sums.By += m.N*m.Svq;
+        N_eq += m.N*(m.N-1)/2;
+    }
+
+    double uc, vc;
+    if ( N_eq < 2 || !solve_normal(sums,uc,vc) ) return ROTCEN_ERROR_CANNOT_SOLVE;
+
+    // the residual of the pair (i,j) is dj - di, d = q - 2*uc*u - 2*vc*v + const
+    double res = 0.0;
+    for ( auto &it: Moments ) {
+        const TrackMoments &m = it.second;
+        if ( m.N < 2 ) continue;
+        double sdd = m.Sqq - 4.0*(uc*m.Suq + vc*m.Svq) + 4.0*(uc*uc*m.Suu + 2.0*uc*vc*m.Suv + vc*vc*m.Svv);
+        if ( sdd > 0.0 ) res += m.N*sdd; // it may be slightly negative due to round-off
+    }
+
+    sol.X = uc + X0;
+    sol.Y = vc + Y0;
+    sol.ResidualSS = res;
+    sol.N_eq = N_eq;
+    sol.Inliers.clear();
+    sol.Circles.clear();
+    sol.Rotations.clear();
+
+    return ROTCEN_ERROR_OK;
+}
@@ -0,0 +1,246 @@
+#ifndef CENTER_SOLVER_H
+#define CENTER_SOLVER_H
+
+#include <vector>
+#include <map>
+#include <functional>
+
+#include "catalog.h"
+#include "worker_pool.h"
+
+using namespace std;
+
+//
+// Positions of the objects matched in all the frames ("star tracks").
+// Each track is a set of points of a circle around the rotation center.
+// The coordinates are stored track by track (star-major order).
+//
+class StarTracks
+{
+public:
+    StarTracks();
+
+    // cats[k] - catalog of k-th frame, ids[k][i] - ID of i-th matched object in k-th frame
+    StarTracks(const vector<Catalog> &cats, const IdTable &ids);
+
+    // tracks of the given stars in the given frames (indices may repeat)
+    StarTracks(const StarTracks &tracks, const vector<size_t> &stars, const vector<size_t> &frames);
+
+    size_t Stars() const { return N_stars; }
+    size_t Frames() const { return N_frames; }
+
+    // ID of the object in the first frame
+    Catalog::IdType Id(size_t star) const { return Ids[star]; }
+
+    double X(size_t star, size_t frame) const { return Xs[star*N_frames + frame]; }
+    double Y(size_t star, size_t frame) const { return Ys[star*N_frames + frame]; }
+
+    // all the frames of a track
+    const double* X(size_t star) const { return Xs.data() + star*N_frames; }
+    const double* Y(size_t star) const { return Ys.data() + star*N_frames; }
+
+private:
+    size_t N_stars, N_frames;
+    vector<Catalog::IdType> Ids;
+    vector<double> Xs, Ys;
+};
+
+
+//
+// Circle fitted to a track
+//
+struct TrackCircle
+{
+    TrackCircle();
+
+    bool Valid;  // false if the fit failed (e.g. points are on a line)
+    double X, Y; // center
+    double R;    // radius
+    double Rms;  // RMS of radial residuals of the points
+};
+
+
+//
+// Rotation center and quality of the solution
+//
+struct CenterSolution
+{
+    CenterSolution();
+
+    double X, Y;       // rotation center
+    double ResidualSS; // sum of squared residuals of the linear equations
+    size_t N_eq;       // number of the linear equations
+
+    vector<size_t> Inliers; // number of inlier points of each track (robust solver only)
+    vector<TrackCircle> Circles; // circles of the tracks (circle fits only)
+    vector<double> Rotations; // rotation angle of each frame relative to the first one (degrees, rigid fits only)
+};
+
+
+//
+// Parameters of the robust solver
+//
+struct RobustSolverParams
+{
+    enum LossFunction {Huber, Tukey};
+
+    RobustSolverParams();
+
+    LossFunction Loss;   // IRLS weight function
+    double InlierThresh; // maximal deviation of an inlier point from its track circle (pixels)
+    size_t N_hypotheses; // number of RANSAC hypotheses
+    size_t MaxIter;      // maximal number of IRLS iterations
+    unsigned long Seed;  // seed of RANSAC samples generator
+};
+
+
+//
+// Parameters of the bootstrap estimation of the center uncertainty
+//
+struct BootstrapParams
+{
+    enum ResamplingMode {Stars, Frames, StarsFrames, Jackknife};
+
+    BootstrapParams();
+
+    ResamplingMode Mode;  // what is resampled with replacement (Jackknife: leave-one-frame-out)
+    size_t N_replicates;  // number of bootstrap replicates (ignored for Jackknife)
+    unsigned long Seed;   // seed of the resampling
+};
+
+
+//
+// Bootstrap estimation of the center uncertainty
+//
+struct BootstrapResult
+{
+    BootstrapResult();
+
+    size_t N_replicates; // number of the solved replicates
+    size_t N_failed;     // number of the replicates which cannot be solved
+    double X, Y;         // mean center of the replicates
+    double Cxx, Cxy, Cyy; // covariance matrix of the center
+
+    // 95% confidence ellipse: semi-axes and position angle of the major axis (degrees from X axis)
+    double EllipseA, EllipseB, EllipseAngle;
+};
+
+
+//
+// Least-squares solver of the rotation center.
+//
+// For each track and each pair of its points (i,j) the center (xc,yc) satisfies
+// the linear equation (the perpendicular bisector of the chord):
+//
+//   2*(xj-xi)*xc + 2*(yj-yi)*yc = xj^2 + yj^2 - xi^2 - yi^2
+//
+// SolveQR builds the whole N_eq x 2 system (N_eq = N_stars*N_frames*(N_frames-1)/2)
+// and solves it by QR decomposition (GSL).
+//
+// SolveNormal computes the same least-squares solution through the 2x2 normal
+// equations without building the system: the sums over all the pairs of a track are
+// computed in O(N_frames) from the centered sums over its points:
+//
+//   sum_{i<j} (uj-ui)*(vj-vi) = n*sum_i (ui-<u>)*(vi-<v>)
+//
+// Tracks are processed in fixed-size chunks (concurrently if pool is given), the chunk
+// sums are added in the chunks order, so the result does not depend on number of threads.
+// The residual is computed exactly by the second pass over the tracks.
+//
+// SolveRobust rejects mismatched objects and points:
+//   1) RANSAC: each hypothesis is the intersection of the bisectors of two random chords,
+//      it is scored (concurrently) by truncated squared radial residuals (MSAC). The radial
+//      residual of a point is its distance to the center minus the median one of its track;
+//   2) IRLS from the best hypothesis: the points are weighted by Huber or Tukey function of
+//      the radial residuals (scaled by their MAD) and the weighted normal equations are
+//      solved (the pair (i,j) has weight wi*wj). The pair sums are computed in O(N_frames)
+//      as above: sum_{i<j} wi*wj*(uj-ui)*(vj-vi) = W*sum_i wi*(ui-<u>)*(vi-<v>), where
+//      W = sum_i wi and the means are weighted.
+// The samples are generated from the given seed, so the result is reproducible.
+//
+// SolveCircles fits a circle to each track independently (tracks are processed
+// concurrently) by one of the algebraic fits: Kasa (linear least squares), Pratt or
+// Taubin (the smallest root of the characteristic polynomial is found by Newton
+// iterations on the centered data, Chernov's formulation). The track centers are
+// combined with inverse covariance weights: the covariance of a track center is
+// s^2*(J^T*J)^-1 of the geometric circle fit (J is the jacobian of distances to the
+// circle, s is RMS of the radial residuals, it is bounded from below by 0.1 of the
+// median one of all the tracks). At least 3 frames are needed.
+//
+// SolveRigid fits the rigid rotation of each frame relative to the first one by the
+// closed-form 2-D Procrustes (Kabsch) solution over all the tracks (frames are processed
+// concurrently): with the centered points p of the first frame and q of k-th frame
+//
+//   angle_k = atan2(sum px*qy - py*qx, sum px*qx + py*qy),  t_k = <q> - R_k*<p>
+//
+// The center is the common fixed point of the rotations, (I - R_k)*c = t_k, solved by
+// least squares over all the frames. (I - R_k)^T*(I - R_k) = 4*sin^2(angle_k/2)*I, so
+// it costs O(N_frames) after the O(N_stars*N_frames) fits.
+//
+// Bootstrap re-solves the resampled tracks by 'solve' function (the replicates are
+// solved concurrently, each of them by a serial solver) and computes covariance
+// of the centers. The replicate k is resampled with the seeds (Seed,k), so the
+// result is reproducible for any number of threads. The jackknife covariance
+// is (n-1)/n*sum_k (ck-<c>)*(ck-<c>)^T for n leave-one-frame-out replicates.
+//
+class CenterSolver
+{
+public:
+    enum CircleFit {Kasa, Pratt, Taubin};
+
+    typedef function<int(const CenterSolver&, const StarTracks&, CenterSolution&)> SolveFunction;
+
+    CenterSolver(WorkerPool *pool = nullptr);
+
+    // return ROTCEN_ERROR_OK, ROTCEN_ERROR_BAD_ALLOC or ROTCEN_ERROR_CANNOT_SOLVE
+    int SolveQR(const StarTracks &tracks, CenterSolution &sol) const;
+    int SolveNormal(const StarTracks &tracks, CenterSolution &sol) const;
+    int SolveRobust(const StarTracks &tracks, const RobustSolverParams &params, CenterSolution &sol) const;
+    int SolveCircles(const StarTracks &tracks, CircleFit fit, CenterSolution &sol) const;
+    int SolveRigid(const StarTracks &tracks, CenterSolution &sol) const;
+
+    // returns ROTCEN_ERROR_OK or ROTCEN_ERROR_CANNOT_SOLVE if less than 2 replicates were solved
+    int Bootstrap(const StarTracks &tracks, const SolveFunction &solve, const BootstrapParams &params,
+                  BootstrapResult &res) const;
+
+private:
+    WorkerPool *Pool;
+};
+
+
+//
+// Incremental solution of the same least-squares problem as CenterSolver::SolveNormal
+// for the points coming frame by frame. A track may miss some frames: its equations
+// are formed by all the pairs of its points. Each track keeps its centered moments
+// (updated by Welford's formulas), so adding a point costs O(1) and the solution
+// costs O(N_tracks). The residual is computed from the moments too.
+//
+class CenterAccumulator
+{
+public:
+    CenterAccumulator();
+
+    // adds the point of the track of the object 'id' (ID in the reference frame)
+    void Add(Catalog::IdType id, double x, double y);
+
+    size_t Tracks() const; // number of the tracks with at least 2 points
+    size_t Points() const;
+
+    // returns ROTCEN_ERROR_OK or ROTCEN_ERROR_CANNOT_SOLVE
+    int Solve(CenterSolution &sol) const;
+
+private:
+    struct TrackMoments
+    {
+        size_t N;
+        double Mu, Mv, Mq;                // means of u = x - x0, v = y - y0 and q = u^2 + v^2
+        double Suu, Suv, Svv, Suq, Svq, Sqq; // centered sums of products
+    };
+
+    map<Catalog::IdType,TrackMoments> Moments; // ordered, so the sums do not depend on hashing
+    bool HasOrigin;
+    double X0, Y0;
+    size_t N_points;
+};
+
+#endif // CENTER_SOLVER_H
@@ -0,0 +1,82 @@
+#include "directory_watcher.h"
+
+#include <cerrno>
+#include <climits>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+
+DirectoryWatcher::DirectoryWatcher(const string &dir):
+    Dir(dir), Fd(-1), Wd(-1), Pending()
+{
+    if ( Dir.empty() ) return;
+    if ( Dir.back() != '/' ) Dir += '/';
+
+    Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ( Fd < 0 ) return;
+
+    Wd = inotify_add_watch(Fd,Dir.c_str(),IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR | IN_DELETE_SELF | IN_MOVE_SELF);
+    if ( Wd < 0 ) {
+        close(Fd);
+        Fd = -1;
+    }
+}
+
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    if ( Fd >= 0 ) close(Fd); // the watch is removed with the descriptor
+}
+
+
+bool DirectoryWatcher::good() const
+{
+    return Fd >= 0;
+}
+
+
+bool DirectoryWatcher::ReadEvents()
+{
+    alignas(struct inotify_event) char buff[16*(sizeof(struct inotify_event) + NAME_MAX + 1)];
+
+    for (;;) {
+        ssize_t len = read(Fd,buff,sizeof(buff));
+        if ( len < 0 ) {
+            if ( errno == EINTR ) continue;
+            return errno == EAGAIN; // no more events
+        }
+        if ( len == 0 ) return false;
+
+        for ( char *ptr = buff; ptr < buff + len; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if ( event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED) ) return false;
+            if ( event->mask & IN_ISDIR ) continue;
+            if ( event->len && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) ) Pending.push_back(Dir + event->name);
+        }
+    }
+}
+
+
+int DirectoryWatcher::Next(string &filename, int timeout_ms)
+{
+    if ( Fd < 0 ) return -1;
+
+    if ( Pending.empty() ) {
+        struct pollfd pfd = {Fd, POLLIN, 0};
+        int ret = poll(&pfd,1,timeout_ms);
+        if ( ret < 0 ) return errno == EINTR ? 0 : -1;
+        if ( ret == 0 ) return 0;
+
+        if ( !ReadEvents() ) return -1;
+        if ( Pending.empty() ) return 0;
+    }
+
+    filename = Pending.front();
+    Pending.pop_front();
+
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include <string>
+#include <deque>
+
+using namespace std;
+
+//
+// The class watches a directory (inotify) for new files. A file is reported when
+// it is closed after writing or moved (renamed) into the directory, so the frames
+// written by acquisition software are reported once they are complete. The files
+// existing before the watch is started are not reported.
+//
+class DirectoryWatcher
+{
+public:
+    explicit DirectoryWatcher(const string &dir);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    bool good() const;
+
+    // waits at most 'timeout_ms' milliseconds (-1 means infinitely) for a new file.
+    // It returns 1 and the full path of the file in 'filename', 0 on timeout or
+    // interruption by a signal, or -1 on error (e.g. the directory was removed).
+    int Next(string &filename, int timeout_ms);
+
+private:
+    bool ReadEvents(); // returns false on error
+
+    string Dir;
+    int Fd;
+    int Wd;
+    deque<string> Pending; // reported by the kernel but not returned yet
+};
+
+#endif // DIRECTORY_WATCHER_H
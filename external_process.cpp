@@ -0,0 +1,198 @@
+#include "external_process.h"
+#include "stage_profiler.h"
+
+#include <map>
+#include <mutex>
+#include <cerrno>
+#include <cstring>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+
+ExternalProcess::ExternalProcess(const vector<string> &argv):
+    ArgvVec(argv), ChildPid(-1), ErrFd(-1), ExitStatus(-1), ErrOutput(), Usage(), StartTime(-1.0)
+{
+}
+
+
+ExternalProcess::~ExternalProcess()
+{
+    if ( Running() ) Wait(); // do not leave zombies
+}
+
+
+/*
+    Spawn the child process. Both ends of the stderr-pipe are created with
+    close-on-exec flag, so the children started concurrently from other
+    threads do not inherit them (otherwise EOF on the pipe would be delayed
+    until all these children exit).
+*/
+int ExternalProcess::Start()
+{
+    if ( ArgvVec.empty() ) return EINVAL;
+    if ( Running() ) return EBUSY;
+
+    int fd[2];
+    if ( pipe2(fd,O_CLOEXEC) ) return errno;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions,0,"/dev/null",O_RDONLY,0);
+    posix_spawn_file_actions_addopen(&actions,1,"/dev/null",O_WRONLY,0);
+    posix_spawn_file_actions_adddup2(&actions,fd[1],2);
+
+    vector<char*> argv;
+    for ( auto &arg: ArgvVec ) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    StageProfiler *profiler = StageProfiler::Current();
+    StartTime = profiler ? profiler->Now() : -1.0;
+
+    pid_t pid;
+    int ret = posix_spawnp(&pid,argv[0],&actions,nullptr,argv.data(),environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fd[1]);
+
+    if ( ret ) {
+        close(fd[0]);
+        return ret;
+    }
+
+    ChildPid = pid;
+    ErrFd = fd[0];
+    ExitStatus = -1;
+    ErrOutput.clear();
+
+    return 0;
+}
+
+
+bool ExternalProcess::ReadErrorOutput()
+{
+    char buff[4096];
+
+    for (;;) {
+        ssize_t n = read(ErrFd,buff,sizeof(buff));
+        if ( n > 0 ) {
+            ErrOutput.append(buff,n);
+            return true;
+        }
+        if ( n < 0 && errno == EINTR ) continue;
+
+        close(ErrFd); // EOF or error
+        ErrFd = -1;
+        return false;
+    }
+}
+
+
+/*
+    Wait for the child and take its resource usage. The application is recorded
+    by the profiler installed at its start.
+*/
+void ExternalProcess::Reap()
+{
+    int status;
+    pid_t ret;
+
+    memset(&Usage,0,sizeof(Usage));
+    while ( (ret = wait4(ChildPid,&status,0,&Usage)) == -1 && errno == EINTR );
+
+    if ( ret == ChildPid && WIFEXITED(status) ) {
+        ExitStatus = WEXITSTATUS(status);
+    } else {
+        ExitStatus = -1;
+    }
+    ChildPid = -1;
+
+    StageProfiler *profiler = StageProfiler::Current();
+    if ( profiler && StartTime >= 0.0 ) {
+        size_t pos = ArgvVec[0].rfind('/');
+        profiler->AddProcess(pos == string::npos ? ArgvVec[0] : ArgvVec[0].substr(pos+1),StartTime,Usage);
+    }
+}
+
+
+int ExternalProcess::Wait()
+{
+    if ( !Running() ) return ExitStatus;
+
+    while ( ErrFd >= 0 && ReadErrorOutput() );
+    Reap();
+
+    return ExitStatus;
+}
+
+
+pid_t ExternalProcess::Pid() const
+{
+    return ChildPid;
+}
+
+
+bool ExternalProcess::Running() const
+{
+    return ChildPid > 0;
+}
+
+
+int ExternalProcess::ExitCode() const
+{
+    return ExitStatus;
+}
+
+
+const string& ExternalProcess::ErrorOutput() const
+{
+    return ErrOutput;
+}
+
+
+const vector<string>& ExternalProcess::Argv() const
+{
+    return ArgvVec;
+}
+
+
+const struct rusage& ExternalProcess::ResourceUsage() const
+{
+    return Usage;
+}
+
+
+int ExternalProcess::Run(const vector<string> &argv, string *err_output)
+{
+    ExternalProcess proc(argv);
+
+    if ( proc.Start() ) return -1;
+
+    int ret = proc.Wait();
+    if ( err_output ) *err_output = proc.ErrorOutput();
+
+    return ret;
+}
+
+
+bool ExternalProcess::Available(const vector<string> &probe_argv)
+{
+    static map<vector<string>,bool> probed;
+    static mutex probe_mutex;
+
+    lock_guard<mutex> lock(probe_mutex);
+
+    auto it = probed.find(probe_argv);
+    if ( it != probed.end() ) return it->second;
+
+    ExternalProcess proc(probe_argv);
+    bool ok = proc.Start() == 0;
+    if ( ok ) ok = proc.Wait() != 127; // 127: the shell-like "command not found" exit code
+
+    probed[probe_argv] = ok;
+
+    return ok;
+}
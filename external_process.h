@@ -0,0 +1,57 @@
+#ifndef EXTERNAL_PROCESS_H
+#define EXTERNAL_PROCESS_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+//
+// The class runs an external application without a shell (posix_spawn).
+// The application is given by argv vector (the first element is the
+// executable name, it is searched in PATH). The standard input and output
+// of the child are redirected to /dev/null, the standard error is captured
+// into memory. The finished applications are recorded by the installed
+// StageProfiler (with their CPU time).
+//
+class ExternalProcess
+{
+public:
+    explicit ExternalProcess(const vector<string> &argv);
+    ~ExternalProcess();
+
+    ExternalProcess(const ExternalProcess&) = delete;
+    ExternalProcess& operator=(const ExternalProcess&) = delete;
+
+    int Start(); // returns 0 or errno-code if the application cannot be started
+    int Wait();  // returns exit code of the application or -1 if it was not started or abnormally terminated
+
+    pid_t Pid() const;
+    bool Running() const;
+    int ExitCode() const;
+    const string& ErrorOutput() const;
+    const vector<string>& Argv() const;
+    const struct rusage& ResourceUsage() const; // of the finished application
+
+    // start the application and wait for its finish
+    static int Run(const vector<string> &argv, string *err_output = nullptr);
+
+    // check whether the application can be run. The result is cached, so each
+    // application is probed only once per process.
+    static bool Available(const vector<string> &probe_argv);
+private:
+    bool ReadErrorOutput(); // returns false at EOF of the captured stderr
+    void Reap();
+
+    vector<string> ArgvVec;
+    pid_t ChildPid;
+    int ErrFd;
+    int ExitStatus;
+    string ErrOutput;
+    struct rusage Usage;
+    double StartTime; // of the profiler (negative if the profiling is off)
+};
+
+#endif // EXTERNAL_PROCESS_H
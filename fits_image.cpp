@@ -0,0 +1,604 @@
+#include "fits_image.h"
+#include "rotcen_errors.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fitsio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define FITS_IMAGE_AVX2
+#endif
+
+
+static const size_t FITS_BLOCK = 2880;
+static const size_t FITS_CARD = 80;
+
+
+/*
+    The function returns the value of the header card as number. The header card
+    is "KEYWORD = value / comment", false is returned if it has no valid number.
+*/
+static bool card_number(const char *card, double &val)
+{
+    if ( card[8] != '=' || card[9] != ' ' ) return false;
+
+    char buff[FITS_CARD-9];
+    memcpy(buff,card+10,FITS_CARD-10);
+    buff[FITS_CARD-10] = '\0';
+
+    char *slash = strchr(buff,'/');
+    if ( slash ) *slash = '\0';
+    for ( char *p = buff; *p; ++p ) if ( *p == 'D' || *p == 'd' ) *p = 'E'; // Fortran's exponent
+
+    char *end;
+    val = strtod(buff,&end);
+    if ( end == buff ) return false;
+    return strspn(end," ") == strlen(end);
+}
+
+
+/*
+    The function checks if the header card has the keyword (padded by spaces to 8 characters)
+*/
+static bool card_key(const char *card, const char *key)
+{
+    size_t len = strlen(key);
+    if ( memcmp(card,key,len) ) return false;
+    for ( size_t i = len; i < 8; ++i ) if ( card[i] != ' ' ) return false;
+    return true;
+}
+
+
+/*
+    Conversion of big-endian pixel values: dst[i] = src[i]*scale + zero.
+
+    Integer values are assembled from the bytes, so the scalar functions do not
+    depend on the host byte order. 32 and 64-bit values are scaled in double like
+    CFITSIO does.
+*/
+static void convert_u8(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    for ( size_t i = 0; i < n; ++i ) dst[i] = src[i]*scale + zero;
+}
+
+
+static inline uint32_t load_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+static inline uint64_t load_be64(const unsigned char *p)
+{
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p+4);
+}
+
+
+static void convert_i16_scalar(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    for ( size_t i = 0; i < n; ++i, src += 2 ) {
+        int16_t v = (int16_t)(((uint16_t)src[0] << 8) | src[1]);
+        dst[i] = v*scale + zero;
+    }
+}
+
+
+static void convert_i32_scalar(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    for ( size_t i = 0; i < n; ++i, src += 4 ) dst[i] = (int32_t)load_be32(src)*scale + zero;
+}
+
+
+static void convert_f32_scalar(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    for ( size_t i = 0; i < n; ++i, src += 4 ) {
+        uint32_t u = load_be32(src);
+        float v;
+        memcpy(&v,&u,4);
+        dst[i] = v*scale + zero;
+    }
+}
+
+
+static void convert_i64(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    for ( size_t i = 0; i < n; ++i, src += 8 ) dst[i] = (int64_t)load_be64(src)*scale + zero;
+}
+
+
+static void convert_f64(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    for ( size_t i = 0; i < n; ++i, src += 8 ) {
+        uint64_t u = load_be64(src);
+        double v;
+        memcpy(&v,&u,8);
+        dst[i] = v*scale + zero;
+    }
+}
+
+
+#if defined(__SSE2__)
+
+/*
+    SSE2 kernels (8 values of 16-bit or 4 values of 32-bit data per iteration).
+    The byte swap is done by shifts as SSE2 has no byte shuffle. They return
+    the number of converted values, the tail is left for the scalar functions.
+*/
+static inline __m128i swap16_sse2(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi16(x,8),_mm_srli_epi16(x,8));
+}
+
+
+static inline __m128i swap32_sse2(__m128i x)
+{
+    x = swap16_sse2(x);
+    return _mm_or_si128(_mm_slli_epi32(x,16),_mm_srli_epi32(x,16));
+}
+
+
+static size_t convert_i16_sse2(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 z = _mm_set1_ps(zero);
+
+    size_t i = 0;
+    for ( ; i+8 <= n; i += 8 ) {
+        __m128i x = swap16_sse2(_mm_loadu_si128((const __m128i*)(src+2*i)));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x,x),16); // sign extension
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x,x),16);
+        _mm_storeu_ps(dst+i,_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo),s),z));
+        _mm_storeu_ps(dst+i+4,_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi),s),z));
+    }
+    return i;
+}
+
+
+static size_t convert_i32_sse2(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d z = _mm_set1_pd(zero);
+
+    size_t i = 0;
+    for ( ; i+4 <= n; i += 4 ) {
+        __m128i x = swap32_sse2(_mm_loadu_si128((const __m128i*)(src+4*i)));
+        __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(x),s),z);
+        __m128d hi = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(x,0x0e)),s),z);
+        _mm_storeu_ps(dst+i,_mm_movelh_ps(_mm_cvtpd_ps(lo),_mm_cvtpd_ps(hi)));
+    }
+    return i;
+}
+
+
+static size_t convert_f32_sse2(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 z = _mm_set1_ps(zero);
+
+    size_t i = 0;
+    for ( ; i+4 <= n; i += 4 ) {
+        __m128 x = _mm_castsi128_ps(swap32_sse2(_mm_loadu_si128((const __m128i*)(src+4*i))));
+        _mm_storeu_ps(dst+i,_mm_add_ps(_mm_mul_ps(x,s),z));
+    }
+    return i;
+}
+
+#endif // __SSE2__
+
+
+#if defined(FITS_IMAGE_AVX2)
+
+/*
+    AVX2 kernels (16 values of 16-bit or 8 values of 32-bit data per iteration),
+    they are compiled for AVX2 regardless of the compiler flags and used only if
+    the CPU supports it. No FMA is used, so the results equal the SSE2 ones.
+*/
+__attribute__((target("avx2")))
+static size_t convert_i16_avx2(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    const __m256i swap = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+                                          1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 z = _mm256_set1_ps(zero);
+
+    size_t i = 0;
+    for ( ; i+16 <= n; i += 16 ) {
+        __m256i x = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src+2*i)),swap);
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x,1));
+        _mm256_storeu_ps(dst+i,_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo),s),z));
+        _mm256_storeu_ps(dst+i+8,_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi),s),z));
+    }
+    return i;
+}
+
+
+__attribute__((target("avx2")))
+static size_t convert_i32_avx2(const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    const __m256i swap = _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+                                          3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+    const __m256d s = _mm256_set1_pd(scale);
+    const __m256d z = _mm256_set1_pd(zero);
+
+    size_t i = 0;
+    for ( ; i+8 <= n; i += 8 ) {
+        __m256i x = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src+4*i)),swap);
+        __m256d lo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)),s),z);
+        __m256d hi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x,1)),s),z);
+        _mm_storeu_ps(dst+i,_mm256_cvtpd_ps(lo));
+        _mm_storeu_ps(dst+i+4,_mm256_cvtpd_ps(hi));
+    }
+    return i;
+}
+
+
+__attribute__((target("avx2")))
+static size_t convert_f32_avx2(const unsigned char *src, float *dst, size_t n, float scale, float zero)
+{
+    const __m256i swap = _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+                                          3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 z = _mm256_set1_ps(zero);
+
+    size_t i = 0;
+    for ( ; i+8 <= n; i += 8 ) {
+        __m256 x = _mm256_castsi256_ps(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src+4*i)),swap));
+        _mm256_storeu_ps(dst+i,_mm256_add_ps(_mm256_mul_ps(x,s),z));
+    }
+    return i;
+}
+
+
+static bool has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif // FITS_IMAGE_AVX2
+
+
+/*
+    The function converts 'n' big-endian values of type 'bitpix' by the fastest
+    available kernel, the tail (or everything if there is no SIMD) is scalar
+*/
+static void convert_pixels(int bitpix, const unsigned char *src, float *dst, size_t n, double scale, double zero)
+{
+    size_t done = 0;
+
+    switch ( bitpix ) {
+    case 8:
+        convert_u8(src,dst,n,scale,zero);
+        break;
+    case 16:
+#if defined(FITS_IMAGE_AVX2)
+        if ( has_avx2() ) done = convert_i16_avx2(src,dst,n,scale,zero);
+#endif
+#if defined(__SSE2__)
+        done += convert_i16_sse2(src+2*done,dst+done,n-done,scale,zero);
+#endif
+        convert_i16_scalar(src+2*done,dst+done,n-done,scale,zero);
+        break;
+    case 32:
+#if defined(FITS_IMAGE_AVX2)
+        if ( has_avx2() ) done = convert_i32_avx2(src,dst,n,scale,zero);
+#endif
+#if defined(__SSE2__)
+        done += convert_i32_sse2(src+4*done,dst+done,n-done,scale,zero);
+#endif
+        convert_i32_scalar(src+4*done,dst+done,n-done,scale,zero);
+        break;
+    case 64:
+        convert_i64(src,dst,n,scale,zero);
+        break;
+    case -32:
+#if defined(FITS_IMAGE_AVX2)
+        if ( has_avx2() ) done = convert_f32_avx2(src,dst,n,scale,zero);
+#endif
+#if defined(__SSE2__)
+        done += convert_f32_sse2(src+4*done,dst+done,n-done,scale,zero);
+#endif
+        convert_f32_scalar(src+4*done,dst+done,n-done,scale,zero);
+        break;
+    case -64:
+        convert_f64(src,dst,n,scale,zero);
+        break;
+    }
+}
+
+
+unique_lock<mutex> cfitsio_lock()
+{
+    static mutex cfitsio_mutex;
+    return fits_is_reentrant() ? unique_lock<mutex>() : unique_lock<mutex>(cfitsio_mutex);
+}
+
+
+FitsImage::FitsImage():
+    Nx(0), Ny(0), Bitpix(0), Bscale(1.0), Bzero(0.0), Map(nullptr), MapSize(0), DataOffset(0),
+    File(nullptr), FileMutex()
+{
+}
+
+
+FitsImage::~FitsImage()
+{
+    Close();
+}
+
+
+void FitsImage::Close()
+{
+    if ( Map ) munmap((void*)Map,MapSize);
+    Map = nullptr;
+    MapSize = 0;
+    Bscale = 1.0;
+    Bzero = 0.0;
+
+    if ( File ) {
+        int status = 0;
+        unique_lock<mutex> lock = cfitsio_lock();
+        fits_close_file((fitsfile*)File,&status);
+        File = nullptr;
+    }
+
+    Nx = Ny = 0;
+}
+
+
+int FitsImage::Open(const string &filename)
+{
+    Close();
+
+    int ret = OpenMapped(filename);
+    if ( ret == ROTCEN_ERROR_OK || ret == ROTCEN_ERROR_BAD_DATA ) return ret;
+
+    return OpenCfitsio(filename);
+}
+
+
+/*
+    The primary header is parsed directly from the mapping. ROTCEN_ERROR_CMD means
+    the file cannot be mapped (it is not a plain FITS file with 2D image in the primary
+    HDU) and CFITSIO is to be used.
+*/
+int FitsImage::OpenMapped(const string &filename)
+{
+    int fd = open(filename.c_str(),O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) return ROTCEN_ERROR_CMD;
+
+    struct stat st;
+    if ( fstat(fd,&st) || !S_ISREG(st.st_mode) || (size_t)st.st_size < FITS_BLOCK ) {
+        close(fd);
+        return ROTCEN_ERROR_CMD;
+    }
+
+    void *map = mmap(nullptr,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); // the mapping holds the file
+    if ( map == MAP_FAILED ) return ROTCEN_ERROR_CMD;
+
+    Map = (const unsigned char*)map;
+    MapSize = st.st_size;
+
+    const char *hdr = (const char*)Map;
+    if ( !card_key(hdr,"SIMPLE") || hdr[29] != 'T' ) { // gzipped or not a FITS file
+        Close();
+        return ROTCEN_ERROR_CMD;
+    }
+
+    double bitpix = 0, naxis = -1, naxis1 = 0, naxis2 = 0, val;
+    bool compressed = false, has_end = false;
+
+    size_t pos = 0;
+    for ( ; pos+FITS_CARD <= MapSize && !has_end; pos += FITS_CARD ) {
+        const char *card = hdr + pos;
+        if ( card_key(card,"END") ) has_end = true;
+        else if ( card_key(card,"BITPIX") && card_number(card,val) ) bitpix = val;
+        else if ( card_key(card,"NAXIS") && card_number(card,val) ) naxis = val;
+        else if ( card_key(card,"NAXIS1") && card_number(card,val) ) naxis1 = val;
+        else if ( card_key(card,"NAXIS2") && card_number(card,val) ) naxis2 = val;
+        else if ( card_key(card,"BSCALE") && card_number(card,val) ) Bscale = val;
+        else if ( card_key(card,"BZERO") && card_number(card,val) ) Bzero = val;
+        else if ( card_key(card,"ZIMAGE") || card_key(card,"ZBITPIX") ) compressed = true;
+    }
+
+    Bitpix = bitpix;
+    bool valid_bitpix = Bitpix == 8 || Bitpix == 16 || Bitpix == 32 || Bitpix == 64 ||
+                        Bitpix == -32 || Bitpix == -64;
+
+    // an image in an extension (empty primary HDU) is left for CFITSIO
+    if ( !has_end || !valid_bitpix || naxis != 2 || compressed ) {
+        Close();
+        return ROTCEN_ERROR_CMD;
+    }
+
+    if ( naxis1 < 1 || naxis2 < 1 ) {
+        Close();
+        return ROTCEN_ERROR_BAD_DATA;
+    }
+
+    Nx = naxis1;
+    Ny = naxis2;
+    DataOffset = (pos + FITS_BLOCK - 1)/FITS_BLOCK*FITS_BLOCK;
+
+    if ( DataOffset + Nx*Ny*(abs(Bitpix)/8) > MapSize ) { // truncated file
+        Close();
+        return ROTCEN_ERROR_BAD_DATA;
+    }
+
+    madvise(map,MapSize,MADV_SEQUENTIAL);
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int FitsImage::OpenCfitsio(const string &filename)
+{
+    int fits_status = 0;
+    fitsfile *file;
+    int bitpix, naxis;
+    long naxes[2] = {0,0};
+
+    unique_lock<mutex> lock = cfitsio_lock(); // the frames are opened concurrently
+    fits_open_image(&file,filename.c_str(),READONLY,&fits_status);
+    if ( fits_status ) return ROTCEN_ERROR_CFITSIO + fits_status;
+
+    fits_get_img_param(file,2,&bitpix,&naxis,naxes,&fits_status);
+    if ( fits_status ) {
+        int status = 0;
+        fits_close_file(file,&status);
+        return ROTCEN_ERROR_CFITSIO + fits_status;
+    }
+    if ( naxis != 2 || naxes[0] < 1 || naxes[1] < 1 ) {
+        fits_close_file(file,&fits_status);
+        return ROTCEN_ERROR_BAD_DATA;
+    }
+
+    File = file;
+    Nx = naxes[0];
+    Ny = naxes[1];
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+size_t FitsImage::Width() const
+{
+    return Nx;
+}
+
+
+size_t FitsImage::Height() const
+{
+    return Ny;
+}
+
+
+bool FitsImage::IsMapped() const
+{
+    return Map != nullptr;
+}
+
+
+int FitsImage::ReadRows(size_t first_row, size_t n_rows, float *pix) const
+{
+    if ( first_row + n_rows > Ny ) return ROTCEN_ERROR_BAD_DATA;
+    if ( n_rows == 0 ) return ROTCEN_ERROR_OK;
+
+    if ( Map ) {
+        size_t pix_size = abs(Bitpix)/8;
+        convert_pixels(Bitpix,Map + DataOffset + first_row*Nx*pix_size,pix,n_rows*Nx,Bscale,Bzero);
+        return ROTCEN_ERROR_OK;
+    }
+
+    if ( !File ) return ROTCEN_ERROR_CMD;
+
+    int fits_status = 0;
+    long fpixel[2] = {1,(long)first_row+1};
+
+    lock_guard<mutex> lock(FileMutex);
+    unique_lock<mutex> cfitsio = cfitsio_lock(); // other images may be read concurrently
+    fits_read_pix((fitsfile*)File,TFLOAT,fpixel,n_rows*Nx,NULL,(void*)pix,NULL,&fits_status);
+
+    return fits_status ? ROTCEN_ERROR_CFITSIO + fits_status : ROTCEN_ERROR_OK;
+}
+
+
+/*
+    The function drops the mapped pages of the converted rows, so the resident
+    memory of a process handling many frames does not grow with the frame size
+    (the pages stay in the page cache)
+*/
+void FitsImage::ReleaseRows(size_t first_row, size_t n_rows) const
+{
+    if ( !Map ) return;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pix_size = abs(Bitpix)/8;
+    size_t start = DataOffset + first_row*Nx*pix_size;
+    size_t end = DataOffset + (first_row+n_rows)*Nx*pix_size;
+
+    start = (start + page - 1)/page*page; // only the pages entirely inside the rows
+    end = end/page*page;
+    if ( start < end ) madvise((void*)(Map+start),end-start,MADV_DONTNEED);
+}
+
+
+int FitsImage::Read(vector<float> &pix, WorkerPool *pool) const
+{
+    try {
+        pix.resize(Nx*Ny);
+    } catch (bad_alloc &ex) {
+        return ROTCEN_ERROR_BAD_ALLOC;
+    }
+
+    if ( !Map ) return ReadRows(0,Ny,pix.data()); // CFITSIO reads are serialized anyway
+
+    WorkerPool serial;
+    WorkerPool &wp = pool ? *pool : serial;
+
+    // bands of about 1 MB of the source data
+    size_t band = max((size_t)1,((size_t)1 << 20)/(Nx*(abs(Bitpix)/8)));
+    size_t n_bands = (Ny + band - 1)/band;
+
+    vector<int> status(n_bands,ROTCEN_ERROR_OK);
+
+    wp.Run(n_bands,[&](size_t i) {
+        size_t y = i*band;
+        size_t n = min(band,Ny-y);
+        status[i] = ReadRows(y,n,pix.data() + y*Nx);
+        ReleaseRows(y,n);
+    });
+
+    for ( auto st: status ) if ( st != ROTCEN_ERROR_OK ) return st;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int FitsImage::ForEachTile(size_t tile_rows, const TileHandler &handler, WorkerPool *pool) const
+{
+    if ( tile_rows == 0 ) return ROTCEN_ERROR_BAD_DATA;
+
+    WorkerPool serial;
+    WorkerPool &wp = pool ? *pool : serial;
+
+    size_t n_tiles = (Ny + tile_rows - 1)/tile_rows;
+    vector<int> status(n_tiles,ROTCEN_ERROR_OK);
+
+    wp.Run(n_tiles,[&](size_t i) {
+        size_t y = i*tile_rows;
+        size_t n = min(tile_rows,Ny-y);
+
+        vector<float> tile;
+        try {
+            tile.resize(n*Nx);
+        } catch (bad_alloc &ex) {
+            status[i] = ROTCEN_ERROR_BAD_ALLOC;
+            return;
+        }
+
+        status[i] = ReadRows(y,n,tile.data());
+        ReleaseRows(y,n);
+        if ( status[i] == ROTCEN_ERROR_OK ) handler(y,n,tile.data());
+    });
+
+    for ( auto st: status ) if ( st != ROTCEN_ERROR_OK ) return st;
+
+    return ROTCEN_ERROR_OK;
+}
@@ -0,0 +1,85 @@
+#ifndef FITS_IMAGE_H
+#define FITS_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+#include "worker_pool.h"
+
+using namespace std;
+
+//
+// Read-only access to the pixels of a 2D FITS image converted to float with
+// BSCALE and BZERO applied.
+//
+// An uncompressed image in the primary HDU of a plain file is memory-mapped and
+// converted from big-endian BITPIX 8/16/32/64/-32/-64 data by the library itself
+// (BITPIX 16, 32 and -32 by SSE2/AVX2 kernels on x86), so the pixels are not
+// copied into the CFITSIO buffers. Any other image (compressed, in an extension,
+// gzipped or given by CFITSIO extended filename syntax) is read through CFITSIO.
+//
+// The rows can be read concurrently, so an image can be processed by tiles
+// (bands of rows) in worker threads without loading the whole frame. If CFITSIO
+// is not reentrant, its calls are serialized across all the images (cfitsio_lock).
+//
+class FitsImage
+{
+public:
+    typedef function<void(size_t first_row, size_t n_rows, const float *pix)> TileHandler;
+
+    FitsImage();
+    ~FitsImage();
+
+    FitsImage(const FitsImage&) = delete;
+    FitsImage& operator=(const FitsImage&) = delete;
+
+    // returns ROTCEN_ERROR_* code (CFITSIO errors are displaced by ROTCEN_ERROR_CFITSIO),
+    // ROTCEN_ERROR_BAD_DATA if the image is not 2D or the data are truncated
+    int Open(const string &filename);
+    void Close();
+
+    size_t Width() const;
+    size_t Height() const;
+    bool IsMapped() const; // the data are read from the file mapping, not by CFITSIO
+
+    // converts rows [first_row, first_row+n_rows) (0-based) into 'pix' of n_rows*Width()
+    // values. It may be called from several threads.
+    int ReadRows(size_t first_row, size_t n_rows, float *pix) const;
+
+    // the whole image, the bands of rows are converted concurrently
+    int Read(vector<float> &pix, WorkerPool *pool = nullptr) const;
+
+    // calls 'handler' for each band of 'tile_rows' rows (the last one may be shorter).
+    // The bands are converted and handled concurrently (the handler must be thread-safe),
+    // each task has its own buffer, so the memory used is about
+    // (number of threads)*tile_rows*Width() floats whatever the image size is.
+    int ForEachTile(size_t tile_rows, const TileHandler &handler, WorkerPool *pool = nullptr) const;
+
+private:
+    int OpenMapped(const string &filename);
+    int OpenCfitsio(const string &filename);
+    void ReleaseRows(size_t first_row, size_t n_rows) const;
+
+    size_t Nx, Ny;
+
+    // memory-mapped file
+    int Bitpix;
+    double Bscale, Bzero;
+    const unsigned char *Map;
+    size_t MapSize;
+    size_t DataOffset;
+
+    // CFITSIO file, its handle cannot be used by several threads simultaneously
+    void *File;
+    mutable mutex FileMutex;
+};
+
+
+// locks the process-wide mutex of CFITSIO calls if the library is not reentrant, otherwise
+// the returned lock owns nothing. The calls which may run concurrently with the reading
+// of the images in other threads are to be made under this lock.
+unique_lock<mutex> cfitsio_lock();
+
+#endif // FITS_IMAGE_H
@@ -0,0 +1,249 @@
+#include "frame_calibrator.h"
+#include "fits_image.h"
+#include "frame_manifest.h"
+#include "rotcen_errors.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+static const size_t CALIB_BAND_ROWS = 64;
+static const size_t NOISE_SAMPLE_SIZE = 100000;
+
+
+FrameCalibratorParams::FrameCalibratorParams():
+    Bias(), Dark(), Flat(), ExposureKey("EXPTIME"), CosmicThresh(0.0), CosmicContrast(2.0)
+{
+}
+
+
+FrameCalibrator::FrameCalibrator(const FrameCalibratorParams &params):
+    Params(params), Nx(0), Ny(0), Bias(), Dark(), FlatInv(), DarkExposure(0.0), Exposures()
+{
+}
+
+
+bool FrameCalibrator::Active() const
+{
+    return !Params.Bias.empty() || !Params.Dark.empty() || !Params.Flat.empty() || Params.CosmicThresh > 0.0;
+}
+
+
+/*
+    The function reads the master frame and checks its size against the already read ones
+*/
+static int read_master(const string &filename, vector<float> &pix, size_t &nx, size_t &ny)
+{
+    FitsImage image;
+
+    int ret = image.Open(filename);
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+    if ( nx && (image.Width() != nx || image.Height() != ny) ) return ROTCEN_ERROR_BAD_DATA;
+    nx = image.Width();
+    ny = image.Height();
+
+    return image.Read(pix);
+}
+
+
+int FrameCalibrator::Load()
+{
+    int ret;
+
+    Nx = Ny = 0;
+    Bias.clear();
+    Dark.clear();
+    FlatInv.clear();
+    DarkExposure = 0.0;
+
+    if ( !Params.Bias.empty() ) {
+        ret = read_master(Params.Bias,Bias,Nx,Ny);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+    }
+
+    if ( !Params.Dark.empty() ) {
+        ret = read_master(Params.Dark,Dark,Nx,Ny);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+        FrameHeaderKeys keys;
+        keys.Ra = keys.Dec = keys.RotAngle = keys.DateObs = "";
+        keys.Exposure = Params.ExposureKey;
+
+        FrameHeader hdr;
+        ret = FrameManifest::ReadHeader(Params.Dark,keys,hdr);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+        DarkExposure = hdr.HasExposure ? hdr.Exposure : 0.0;
+    }
+
+    if ( !Params.Flat.empty() ) {
+        ret = read_master(Params.Flat,FlatInv,Nx,Ny);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+        vector<float> good;
+        for ( auto v: FlatInv ) if ( v > 0.0 && isfinite(v) ) good.push_back(v);
+        if ( good.empty() ) return ROTCEN_ERROR_BAD_DATA;
+
+        nth_element(good.begin(),good.begin()+good.size()/2,good.end());
+        float median = good[good.size()/2];
+
+        for ( auto &v: FlatInv ) v = (v > 0.0 && isfinite(v)) ? median/v : 1.0f;
+    }
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+/*
+    The function returns the median of the 8 neighbours of the pixel (x,y) and the maximal
+    one of them. The pixel must not be on the image border.
+*/
+static float neighbours_median(const float *pix, size_t nx, size_t x, size_t y, float &max_val)
+{
+    const float *p = pix + y*nx + x;
+    ptrdiff_t w = nx;
+    float v[8] = {p[-w-1], p[-w], p[-w+1], p[-1], p[1], p[w-1], p[w], p[w+1]};
+
+    max_val = *max_element(v,v+8);
+    nth_element(v,v+4,v+8);
+    float upper = v[4];
+    float lower = *max_element(v,v+4);
+
+    return 0.5f*(lower + upper);
+}
+
+
+void FrameCalibrator::RejectCosmics(float *pix, size_t nx, size_t ny, WorkerPool &pool) const
+{
+    if ( nx < 3 || ny < 3 ) return;
+
+    // the noise is the robust RMS of the pixel excesses over their neighbours
+    // (the background gradients do not affect it)
+
+    size_t n_inner = (nx-2)*(ny-2);
+    size_t step = max((size_t)1,n_inner/NOISE_SAMPLE_SIZE);
+
+    vector<float> excess;
+    excess.reserve(n_inner/step + 1);
+    for ( size_t k = 0; k < n_inner; k += step ) {
+        size_t x = k % (nx-2) + 1;
+        size_t y = k/(nx-2) + 1;
+        float max_val;
+        float d = pix[y*nx+x] - neighbours_median(pix,nx,x,y,max_val);
+        if ( isfinite(d) ) excess.push_back(d);
+    }
+    if ( excess.empty() ) return;
+
+    size_t mid = excess.size()/2;
+    nth_element(excess.begin(),excess.begin()+mid,excess.end());
+    float med = excess[mid];
+    for ( auto &d: excess ) d = fabs(d - med);
+    nth_element(excess.begin(),excess.begin()+mid,excess.end());
+    float sigma = 1.4826f*excess[mid];
+    if ( !(sigma > 0.0f) ) return;
+
+    float thresh = Params.CosmicThresh*sigma;
+    float contrast = Params.CosmicContrast;
+
+    // the replacements are found by bands and applied after all of them, so the bands
+    // see the original neighbours of their border rows
+
+    size_t n_bands = (ny + CALIB_BAND_ROWS - 1)/CALIB_BAND_ROWS;
+    vector<vector<pair<size_t,float> > > replaced(n_bands);
+
+    ptrdiff_t w = nx;
+
+    pool.Run(n_bands,[&](size_t i_band) {
+        size_t y_start = max((size_t)1,i_band*CALIB_BAND_ROWS);
+        size_t y_end = min(ny-1,(i_band+1)*CALIB_BAND_ROWS);
+
+        for ( size_t y = y_start; y < y_end; ++y ) {
+            const float *row = pix + y*nx;
+            for ( size_t x = 1; x+1 < nx; ++x ) {
+                const float *p = row + x;
+                float v = *p;
+                // a spike is a local maximum, it is a quick check before the median
+                if ( !(v > p[-1] && v > p[1] && v > p[-w] && v > p[w] &&
+                       v > p[-w-1] && v > p[-w+1] && v > p[w-1] && v > p[w+1]) ) continue;
+
+                float max_val;
+                float med = neighbours_median(pix,nx,x,y,max_val);
+                float d = v - med;
+                if ( d > thresh && d > contrast*(max_val - med) ) replaced[i_band].push_back({y*nx+x,med});
+            }
+        }
+    });
+
+    for ( auto &band: replaced ) {
+        for ( auto &r: band ) pix[r.first] = r.second;
+    }
+}
+
+
+int FrameCalibrator::Calibrate(float *pix, size_t nx, size_t ny, double exposure, WorkerPool *pool) const
+{
+    if ( Nx && (nx != Nx || ny != Ny) ) return ROTCEN_ERROR_BAD_DATA;
+
+    WorkerPool serial;
+    WorkerPool &wp = pool ? *pool : serial;
+
+    if ( Nx ) {
+        float dark_scale = (exposure > 0.0 && DarkExposure > 0.0) ? exposure/DarkExposure : 1.0;
+
+        const float *bias = Bias.empty() ? nullptr : Bias.data();
+        const float *dark = Dark.empty() ? nullptr : Dark.data();
+        const float *flat_inv = FlatInv.empty() ? nullptr : FlatInv.data();
+
+        size_t n_bands = (ny + CALIB_BAND_ROWS - 1)/CALIB_BAND_ROWS;
+
+        wp.Run(n_bands,[&](size_t i_band) {
+            size_t start = i_band*CALIB_BAND_ROWS*nx;
+            size_t end = min(ny,(i_band+1)*CALIB_BAND_ROWS)*nx;
+
+            if ( bias ) for ( size_t i = start; i < end; ++i ) pix[i] -= bias[i];
+            if ( dark ) for ( size_t i = start; i < end; ++i ) pix[i] -= dark_scale*dark[i];
+            if ( flat_inv ) for ( size_t i = start; i < end; ++i ) pix[i] *= flat_inv[i];
+        });
+    }
+
+    if ( Params.CosmicThresh > 0.0 ) RejectCosmics(pix,nx,ny,wp);
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+void FrameCalibrator::SetExposures(const FrameManifest &manifest)
+{
+    Exposures.clear();
+    if ( manifest.Keys().Exposure != Params.ExposureKey ) return;
+
+    for ( size_t i = 0; i < manifest.Size(); ++i ) {
+        Exposures[manifest[i].Filename] = manifest[i].HasExposure ? manifest[i].Exposure : 0.0;
+    }
+}
+
+
+int FrameCalibrator::Calibrate(const string &frame, float *pix, size_t nx, size_t ny, WorkerPool *pool) const
+{
+    double exposure = 0.0;
+
+    if ( !Dark.empty() && DarkExposure > 0.0 ) {
+        auto it = Exposures.find(frame);
+        if ( it != Exposures.end() ) {
+            exposure = it->second;
+        } else {
+            FrameHeaderKeys keys;
+            keys.Ra = keys.Dec = keys.RotAngle = keys.DateObs = "";
+            keys.Exposure = Params.ExposureKey;
+
+            FrameHeader hdr;
+            unique_lock<mutex> lock = cfitsio_lock(); // the frames are calibrated concurrently
+            int ret = FrameManifest::ReadHeader(frame,keys,hdr);
+            lock.unlock();
+            if ( ret != ROTCEN_ERROR_OK ) return ret;
+            if ( hdr.HasExposure ) exposure = hdr.Exposure;
+        }
+    }
+
+    return Calibrate(pix,nx,ny,exposure,pool);
+}
@@ -0,0 +1,83 @@
+#ifndef FRAME_CALIBRATOR_H
+#define FRAME_CALIBRATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "worker_pool.h"
+#include "frame_manifest.h"
+
+using namespace std;
+
+//
+// Parameters of the frames calibration. An empty filename means the master frame
+// is not applied.
+//
+struct FrameCalibratorParams
+{
+    FrameCalibratorParams();
+
+    string Bias;           // master bias
+    string Dark;           // master dark (bias subtracted)
+    string Flat;           // master flat (it is normalized by its median)
+    string ExposureKey;    // FITS-keyword of exposure to scale the dark (default "EXPTIME")
+
+    double CosmicThresh;   // threshold of cosmic-ray/hot pixel rejection in units of noise (0 - no rejection, default)
+    double CosmicContrast; // minimal ratio of a rejected pixel excess to the excess of its brightest neighbour (default 2)
+};
+
+
+//
+// In-memory calibration of the frame pixels before the detection:
+//
+//   pix = (pix - bias - dark*t_frame/t_dark)/(flat/median(flat))
+//
+// The dark is scaled only if both the frame and the master dark have the exposure
+// keyword. Pixels with non-positive flat values are not flat-corrected.
+//
+// The cosmic-ray hits and hot pixels are single-pixel spikes much sharper than the
+// PSF: a pixel is replaced by the median of its 8 neighbours if its excess over the
+// median is above CosmicThresh*noise and above CosmicContrast times the excess of
+// the brightest neighbour (the noise is the robust RMS of the excesses over the
+// image). Multi-pixel cosmic-ray tracks are not rejected.
+//
+// The bands of rows are processed concurrently. The calibrator has no state after
+// loading of the master frames and the exposures, so several frames can be calibrated concurrently.
+//
+class FrameCalibrator
+{
+public:
+    explicit FrameCalibrator(const FrameCalibratorParams &params);
+
+    // something is to be done
+    bool Active() const;
+
+    // reads the master frames (they must have the same size), returns ROTCEN_ERROR_* code
+    // (CFITSIO errors are displaced by ROTCEN_ERROR_CFITSIO)
+    int Load();
+
+    // 'exposure' is the frame exposure (non-positive means unknown). Returns
+    // ROTCEN_ERROR_BAD_DATA if the frame size differs from the master frames one.
+    int Calibrate(float *pix, size_t nx, size_t ny, double exposure, WorkerPool *pool = nullptr) const;
+
+    // takes the exposures of the frames from the scanned headers if the manifest reads
+    // ExposureKey (call it before the frames are calibrated concurrently)
+    void SetExposures(const FrameManifest &manifest);
+
+    // the frame exposure is taken from the manifest or, for a frame out of it, read from
+    // the FITS-file header if it is needed (serially if CFITSIO is not reentrant)
+    int Calibrate(const string &frame, float *pix, size_t nx, size_t ny, WorkerPool *pool = nullptr) const;
+
+private:
+    void RejectCosmics(float *pix, size_t nx, size_t ny, WorkerPool &pool) const;
+
+    FrameCalibratorParams Params;
+
+    size_t Nx, Ny; // size of the master frames (0 if none is given)
+    vector<float> Bias, Dark, FlatInv; // FlatInv = median(flat)/flat
+    double DarkExposure; // non-positive if unknown
+    map<string,double> Exposures; // frame exposures from the manifest (non-positive if unknown)
+};
+
+#endif // FRAME_CALIBRATOR_H
@@ -0,0 +1,253 @@
+#include "frame_manifest.h"
+#include "rotcen_errors.h"
+
+#include <cctype>
+#include <cstdlib>
+
+#include <fitsio.h>
+
+
+FrameHeaderKeys::FrameHeaderKeys():
+    Ra("RA"), Dec("DEC"), RotAngle("ROTANGLE"), Exposure("EXPTIME"), DateObs("DATE-OBS"),
+    RaInHours(false), Sexagesimal(false)
+{
+}
+
+
+FrameHeader::FrameHeader():
+    Filename(), HasRaDec(false), Ra(0.0), Dec(0.0), HasRotAngle(false), RotAngle(0.0),
+    HasExposure(false), Exposure(0.0), DateObs(), Width(0), Height(0)
+{
+}
+
+
+/*
+    The function removes the quotes of FITS string value ('...', inner quotes are doubled)
+    and the spaces around. Not quoted values are just trimmed.
+*/
+static string unquote_value(const char *value)
+{
+    string str = value;
+
+    size_t start = str.find_first_not_of(' ');
+    if ( start == string::npos ) return "";
+    size_t end = str.find_last_not_of(' ');
+    str = str.substr(start,end-start+1);
+
+    if ( str.size() < 2 || str.front() != '\'' || str.back() != '\'' ) return str;
+
+    string res;
+    for ( size_t i = 1; i+1 < str.size(); ++i ) {
+        res += str[i];
+        if ( str[i] == '\'' && str[i+1] == '\'' ) ++i;
+    }
+
+    end = res.find_last_not_of(' '); // trailing spaces are not significant in FITS strings
+    return end == string::npos ? "" : res.substr(0,end+1);
+}
+
+
+/*
+    The function reads the keyword value as string. It returns false if the keyword
+    is absent (it is not an error), other CFITSIO errors are set in 'fits_status'.
+*/
+static bool read_keyword(fitsfile *file, const string &key, string &value, int &fits_status)
+{
+    char key_value[FLEN_VALUE];
+
+    fits_read_keyword(file,key.c_str(),key_value,NULL,&fits_status);
+    if ( fits_status == KEY_NO_EXIST ) {
+        fits_status = 0;
+        return false;
+    }
+    if ( fits_status ) return false;
+
+    value = unquote_value(key_value);
+    return true;
+}
+
+
+/*
+    The function scans 'n' digits at 'pos' and returns their integer value or -1
+*/
+static int scan_digits(const string &str, size_t &pos, size_t n)
+{
+    int val = 0;
+    for ( size_t i = 0; i < n; ++i, ++pos ) {
+        if ( pos >= str.size() || !isdigit((unsigned char)str[pos]) ) return -1;
+        val = 10*val + (str[pos] - '0');
+    }
+    return val;
+}
+
+
+bool FrameManifest::ParseSexagesimal(const string &str, bool is_signed, double &val)
+{
+    size_t pos = str.find_first_not_of(' ');
+    if ( pos == string::npos ) return false;
+
+    double sign = 1.0;
+    if ( str[pos] == '+' || (is_signed && str[pos] == '-') ) {
+        if ( str[pos] == '-' ) sign = -1.0;
+        ++pos;
+    }
+
+    int deg = scan_digits(str,pos,2);
+    if ( deg < 0 || pos >= str.size() || str[pos++] != ':' ) return false;
+    int min = scan_digits(str,pos,2);
+    if ( min < 0 || pos >= str.size() || str[pos++] != ':' ) return false;
+    int sec = scan_digits(str,pos,2);
+    if ( sec < 0 ) return false;
+
+    double frac = 0.0;
+    if ( pos < str.size() && str[pos] == '.' ) {
+        double p = 0.1;
+        for ( ++pos; pos < str.size() && isdigit((unsigned char)str[pos]); ++pos, p *= 0.1 ) {
+            frac += (str[pos] - '0')*p;
+        }
+    }
+
+    if ( str.find_first_not_of(' ',pos) != string::npos ) return false;
+
+    val = sign*(deg + min/60.0 + (sec + frac)/3600.0);
+    return true;
+}
+
+
+bool FrameManifest::ParseNumber(const string &str, bool is_signed, double &val)
+{
+    size_t pos = str.find_first_not_of(' ');
+    if ( pos == string::npos ) return false;
+
+    string num; // the number in C form
+    if ( str[pos] == '+' || (is_signed && str[pos] == '-') ) num += str[pos++];
+
+    size_t n_digits = 0;
+    for ( ; pos < str.size() && isdigit((unsigned char)str[pos]); ++pos, ++n_digits ) num += str[pos];
+    if ( n_digits == 0 ) return false;
+
+    if ( pos < str.size() && str[pos] == '.' ) {
+        num += str[pos++];
+        for ( ; pos < str.size() && isdigit((unsigned char)str[pos]); ++pos ) num += str[pos];
+    }
+
+    if ( pos < str.size() && (str[pos] == 'E' || str[pos] == 'e' || str[pos] == 'D' || str[pos] == 'd') ) {
+        num += 'E';
+        ++pos;
+        if ( pos < str.size() && (str[pos] == '+' || str[pos] == '-') ) num += str[pos++];
+        for ( n_digits = 0; pos < str.size() && isdigit((unsigned char)str[pos]); ++pos, ++n_digits ) num += str[pos];
+        if ( n_digits == 0 ) return false;
+    }
+
+    if ( str.find_first_not_of(' ',pos) != string::npos ) return false;
+
+    val = strtod(num.c_str(),NULL);
+    return true;
+}
+
+
+int FrameManifest::ReadHeader(const string &frame, const FrameHeaderKeys &keys, FrameHeader &hdr)
+{
+    int fits_status = 0;
+    fitsfile *file;
+
+    hdr = FrameHeader();
+    hdr.Filename = frame;
+
+    fits_open_image(&file,frame.c_str(),READONLY,&fits_status);
+    if ( fits_status ) return ROTCEN_ERROR_CFITSIO + fits_status;
+
+    int ret = ROTCEN_ERROR_OK;
+    string value;
+
+    long naxes[2] = {0,0};
+    fits_get_img_size(file,2,naxes,&fits_status);
+    hdr.Width = naxes[0];
+    hdr.Height = naxes[1];
+
+    if ( !fits_status && !keys.Ra.empty() && !keys.Dec.empty() ) {
+        string ra_value, dec_value;
+
+        bool has_ra = read_keyword(file,keys.Ra,ra_value,fits_status);
+        bool has_dec = !fits_status && read_keyword(file,keys.Dec,dec_value,fits_status);
+
+        if ( has_ra && has_dec ) { // the guess position makes sense only if the both are given
+            bool ok;
+            if ( keys.Sexagesimal ) {
+                ok = ParseSexagesimal(ra_value,false,hdr.Ra) && ParseSexagesimal(dec_value,true,hdr.Dec);
+                hdr.Ra *= 15.0;
+            } else {
+                ok = ParseNumber(ra_value,false,hdr.Ra) && ParseNumber(dec_value,true,hdr.Dec);
+                if ( keys.RaInHours ) hdr.Ra *= 15.0;
+            }
+            if ( ok ) {
+                hdr.HasRaDec = true;
+            } else {
+                ret = ROTCEN_ERROR_BAD_DATA;
+            }
+        }
+    }
+
+    // the other keywords are optional, their invalid values are treated as absent ones
+
+    if ( !fits_status && !keys.RotAngle.empty() && read_keyword(file,keys.RotAngle,value,fits_status) ) {
+        hdr.HasRotAngle = ParseNumber(value,true,hdr.RotAngle);
+    }
+
+    if ( !fits_status && !keys.Exposure.empty() && read_keyword(file,keys.Exposure,value,fits_status) ) {
+        hdr.HasExposure = ParseNumber(value,false,hdr.Exposure);
+    }
+
+    if ( !fits_status && !keys.DateObs.empty() ) read_keyword(file,keys.DateObs,hdr.DateObs,fits_status);
+
+    int status = 0;
+    fits_close_file(file,&status);
+
+    if ( fits_status ) return ROTCEN_ERROR_CFITSIO + fits_status;
+
+    return ret;
+}
+
+
+FrameManifest::FrameManifest(const FrameHeaderKeys &keys): HeaderKeys(keys), Headers()
+{
+}
+
+
+int FrameManifest::Scan(const vector<string> &frames, vector<int> &status, WorkerPool *pool)
+{
+    // CFITSIO built without the thread-safety option ('--enable-reentrant') must not
+    // be called concurrently, the headers are scanned serially then
+    WorkerPool serial;
+    WorkerPool &wp = pool && fits_is_reentrant() ? *pool : serial;
+
+    Headers.assign(frames.size(),FrameHeader());
+    status.assign(frames.size(),ROTCEN_ERROR_OK);
+
+    // the headers are small, the time is spent in opening of the files
+    wp.Run(frames.size(),[&](size_t i) {
+        status[i] = ReadHeader(frames[i],HeaderKeys,Headers[i]);
+    });
+
+    for ( auto st: status ) if ( st != ROTCEN_ERROR_OK ) return st;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+size_t FrameManifest::Size() const
+{
+    return Headers.size();
+}
+
+
+const FrameHeader& FrameManifest::operator[](size_t i) const
+{
+    return Headers[i];
+}
+
+
+const FrameHeaderKeys& FrameManifest::Keys() const
+{
+    return HeaderKeys;
+}
@@ -0,0 +1,90 @@
+#ifndef FRAME_MANIFEST_H
+#define FRAME_MANIFEST_H
+
+#include <string>
+#include <vector>
+
+#include "worker_pool.h"
+
+using namespace std;
+
+//
+// Names of the FITS-keywords of the frame header. An empty name means the
+// keyword is not read.
+//
+struct FrameHeaderKeys
+{
+    FrameHeaderKeys();
+
+    string Ra;          // default "RA"
+    string Dec;         // default "DEC"
+    string RotAngle;    // rotator position angle in degrees (default "ROTANGLE")
+    string Exposure;    // default "EXPTIME"
+    string DateObs;     // default "DATE-OBS"
+
+    bool RaInHours;     // numeric RA value is in hours
+    bool Sexagesimal;   // RA and DEC are strings "hh:mm:ss[.sss]" and "[+/-]dd:mm:ss[.sss]"
+};
+
+
+//
+// Header data of a frame. The keywords which are absent in the header (or have
+// invalid values, except RA and DEC) have the corresponding Has* flag set to false.
+//
+struct FrameHeader
+{
+    FrameHeader();
+
+    string Filename;
+
+    bool HasRaDec;       // both RA and DEC are given
+    double Ra, Dec;      // degrees
+
+    bool HasRotAngle;
+    double RotAngle;     // degrees
+
+    bool HasExposure;
+    double Exposure;
+
+    string DateObs;      // empty if absent
+
+    long Width, Height;  // NAXIS1 and NAXIS2
+};
+
+
+//
+// Headers of the input frames. They are scanned once (concurrently if CFITSIO is
+// reentrant) before the frames are processed, so invalid frames are reported before
+// any external application is run.
+//
+class FrameManifest
+{
+public:
+    explicit FrameManifest(const FrameHeaderKeys &keys = FrameHeaderKeys());
+
+    // status[k] is the result for k-th frame (ROTCEN_ERROR_CFITSIO + CFITSIO error code if
+    // the header cannot be read or ROTCEN_ERROR_BAD_DATA for invalid RA or DEC value), the
+    // first non-zero one is returned
+    int Scan(const vector<string> &frames, vector<int> &status, WorkerPool *pool = nullptr);
+
+    size_t Size() const;
+    const FrameHeader& operator[](size_t i) const;
+
+    const FrameHeaderKeys& Keys() const;
+
+    static int ReadHeader(const string &frame, const FrameHeaderKeys &keys, FrameHeader &hdr);
+
+    // "[+/-]dd:mm:ss[.sss]" (sign is allowed only if 'is_signed') with possible spaces
+    // around. The sign applies to the whole value. Returns false for invalid string.
+    static bool ParseSexagesimal(const string &str, bool is_signed, double &val);
+
+    // decimal number with optional exponent ('E' or Fortran's 'D') with possible spaces
+    // around. Returns false for invalid string.
+    static bool ParseNumber(const string &str, bool is_signed, double &val);
+
+private:
+    FrameHeaderKeys HeaderKeys;
+    vector<FrameHeader> Headers;
+};
+
+#endif // FRAME_MANIFEST_H
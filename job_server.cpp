@@ -0,0 +1,194 @@
+#include "job_server.h"
+#include "rotcen_errors.h"
+
+#include <list>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+/*
+    The function fills the socket address, it returns false if the path is too long
+*/
+static bool unix_address(const string &path, struct sockaddr_un &addr)
+{
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if ( path.empty() || path.size() >= sizeof(addr.sun_path) ) return false;
+    memcpy(addr.sun_path,path.c_str(),path.size());
+    return true;
+}
+
+
+/*
+    The function writes the whole buffer (the socket may accept it partially)
+*/
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while ( len ) {
+        ssize_t n = send(fd,data,len,MSG_NOSIGNAL);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+JobServer::JobServer(const string &socket_path, const Handler &handler):
+    SocketPath(socket_path), RequestHandler(handler), ListenFd(-1)
+{
+    struct sockaddr_un addr;
+    if ( !unix_address(SocketPath,addr) ) return;
+
+    int fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if ( fd < 0 ) return;
+
+    struct stat st;
+    if ( lstat(SocketPath.c_str(),&st) == 0 ) {
+        if ( !S_ISSOCK(st.st_mode) ) { // never remove a regular file
+            close(fd);
+            return;
+        }
+        // a socket file of a running server must not be replaced
+        if ( connect(fd,(struct sockaddr*)&addr,sizeof(addr)) == 0 || errno != ECONNREFUSED ) {
+            close(fd);
+            return;
+        }
+        close(fd);
+        unlink(SocketPath.c_str());
+
+        fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+        if ( fd < 0 ) return;
+    }
+
+    if ( bind(fd,(struct sockaddr*)&addr,sizeof(addr)) || listen(fd,SOMAXCONN) ) {
+        close(fd);
+        return;
+    }
+
+    ListenFd = fd;
+}
+
+
+JobServer::~JobServer()
+{
+    if ( ListenFd >= 0 ) {
+        close(ListenFd);
+        unlink(SocketPath.c_str());
+    }
+}
+
+
+bool JobServer::good() const
+{
+    return ListenFd >= 0;
+}
+
+
+void JobServer::ServeConnection(int fd, const function<bool()> &stop) const
+{
+    string buff;
+    char chunk[4096];
+    size_t scan_pos = 0; // the buffer before the position has no newline
+
+    for (;;) {
+        size_t eol = buff.find('\n',scan_pos);
+        if ( eol != string::npos ) {
+            string request = buff.substr(0,eol);
+            buff.erase(0,eol+1);
+            scan_pos = 0;
+
+            if ( !request.empty() && request.back() == '\r' ) request.pop_back();
+            if ( request.empty() ) continue;
+
+            string response = RequestHandler(request);
+            response += '\n';
+            if ( !write_all(fd,response.data(),response.size()) ) break;
+            continue;
+        }
+        scan_pos = buff.size();
+        if ( buff.size() > MAX_REQUEST_LENGTH ) break;
+
+        // wait for data with timeout to notice the server stop
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ret = poll(&pfd,1,500);
+        if ( ret < 0 && errno != EINTR ) break;
+        if ( ret <= 0 ) {
+            if ( stop() ) break;
+            continue;
+        }
+
+        ssize_t n = recv(fd,chunk,sizeof(chunk),0);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) break; // closed by the client
+        buff.append(chunk,n);
+    }
+
+    close(fd);
+}
+
+
+int JobServer::Serve(const function<bool()> &stop, int poll_ms)
+{
+    if ( ListenFd < 0 ) return ROTCEN_ERROR_CMD;
+
+    // the finished connections are joined while the server runs, so a long-running
+    // server does not accumulate the threads
+    struct Connection
+    {
+        Connection(): Thread(), Finished(false) {}
+
+        thread Thread;
+        atomic<bool> Finished;
+    };
+
+    list<Connection> connections;
+    int ret_code = ROTCEN_ERROR_OK;
+
+    while ( !stop() ) {
+        for ( auto it = connections.begin(); it != connections.end(); ) {
+            if ( it->Finished ) {
+                it->Thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        struct pollfd pfd = {ListenFd, POLLIN, 0};
+        int ret = poll(&pfd,1,poll_ms);
+        if ( ret < 0 ) {
+            if ( errno == EINTR ) continue;
+            ret_code = ROTCEN_ERROR_CMD;
+            break;
+        }
+        if ( ret == 0 ) continue;
+
+        int fd = accept4(ListenFd,nullptr,nullptr,SOCK_CLOEXEC);
+        if ( fd < 0 ) {
+            if ( errno == EINTR || errno == ECONNABORTED || errno == EAGAIN ) continue;
+            ret_code = ROTCEN_ERROR_CMD;
+            break;
+        }
+
+        connections.emplace_back();
+        Connection &conn = connections.back(); // list elements are never moved
+        conn.Thread = thread([this,fd,&stop,&conn]() {
+            ServeConnection(fd,stop);
+            conn.Finished = true;
+        });
+    }
+
+    for ( auto &conn: connections ) conn.Thread.join();
+
+    return ret_code;
+}
@@ -0,0 +1,47 @@
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+#include <string>
+#include <functional>
+
+using namespace std;
+
+//
+// Server of text requests on a local (Unix domain) stream socket.
+//
+// A client sends requests as lines, the server answers each of them by one
+// response line (the handler result) in the order of the requests. A client may
+// send any number of requests through one connection. Each connection is served
+// by its own thread, so the requests of different clients are handled concurrently
+// (the handler must be thread-safe).
+//
+class JobServer
+{
+public:
+    typedef function<string(const string &request)> Handler;
+
+    // a stale socket file (no server is listening) is replaced
+    JobServer(const string &socket_path, const Handler &handler);
+    ~JobServer(); // the socket file is removed
+
+    JobServer(const JobServer&) = delete;
+    JobServer& operator=(const JobServer&) = delete;
+
+    bool good() const;
+
+    // accepts connections until 'stop' returns true (it is checked at least every 'poll_ms'
+    // milliseconds), then waits for the running requests. Returns ROTCEN_ERROR_OK or
+    // ROTCEN_ERROR_CMD if the socket fails.
+    int Serve(const function<bool()> &stop, int poll_ms = 500);
+
+    static const size_t MAX_REQUEST_LENGTH = 1 << 20; // longer requests close the connection
+
+private:
+    void ServeConnection(int fd, const function<bool()> &stop) const;
+
+    string SocketPath;
+    Handler RequestHandler;
+    int ListenFd;
+};
+
+#endif // JOB_SERVER_H
@@ -0,0 +1,241 @@
+#include "product_cache.h"
+#include "rotcen_errors.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// it is changed when the set or the format of the cached products is changed
+static const char ROTCEN_CACHE_VERSION[] = "rotcen-cache-1";
+
+static const size_t ROTCEN_CACHE_BUFFER_SIZE = 1 << 20;
+
+// options of 'sex' and 'solve-field' whose values are the files read by the application
+static const vector<string> ROTCEN_CACHE_FILE_OPTIONS = {
+    "-c", "-PARAMETERS_NAME", "-FILTER_NAME", "-STARNNW_NAME", "-PSF_NAME", // sex
+    "-b", "--config", "--backend-config"                                    // solve-field
+};
+
+// the commandline of 'sex' run by 'solve-field' is passed as a single option value
+static const string ROTCEN_CACHE_NESTED_OPTION = "--sextractor-path";
+
+
+/*
+    The function copies the file content. The destination file is created or truncated.
+    It returns false on any error (the partial destination file is removed).
+*/
+static bool copy_file(const string &src, const string &dst)
+{
+    int in_fd = open(src.c_str(),O_RDONLY | O_CLOEXEC);
+    if ( in_fd < 0 ) return false;
+
+    int out_fd = open(dst.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+    if ( out_fd < 0 ) {
+        close(in_fd);
+        return false;
+    }
+
+    vector<char> buff(ROTCEN_CACHE_BUFFER_SIZE);
+    bool ok = true;
+
+    for (;;) {
+        ssize_t n = read(in_fd,buff.data(),buff.size());
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) {
+            ok = n == 0;
+            break;
+        }
+        for ( ssize_t done = 0; done < n; ) {
+            ssize_t m = write(out_fd,buff.data()+done,n-done);
+            if ( m < 0 && errno == EINTR ) continue;
+            if ( m <= 0 ) {
+                ok = false;
+                break;
+            }
+            done += m;
+        }
+        if ( !ok ) break;
+    }
+
+    close(in_fd);
+    if ( close(out_fd) ) ok = false;
+    if ( !ok ) unlink(dst.c_str());
+
+    return ok;
+}
+
+
+static bool file_exists(const string &filename)
+{
+    struct stat st;
+    return stat(filename.c_str(),&st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+/*
+    The function continues the hash with the file content. It returns false if the
+    file cannot be read.
+*/
+static bool hash_file(const string &filename, uint64_t &hash)
+{
+    int fd = open(filename.c_str(),O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) return false;
+
+    posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+
+    vector<char> buff(ROTCEN_CACHE_BUFFER_SIZE);
+    for (;;) {
+        ssize_t n = read(fd,buff.data(),buff.size());
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n < 0 ) {
+            close(fd);
+            return false;
+        }
+        if ( n == 0 ) break;
+        hash = ProductCache::Hash(buff.data(),n,hash);
+    }
+    close(fd);
+
+    return true;
+}
+
+
+/*
+    The function continues the hash with the content of the files referenced by the
+    file-valued options of the commandline (configurations, filters, parameter lists).
+    An unreadable file contributes its name only (the application fails on it anyway).
+    'sex' without "-c" reads "default.sex" of the working directory if it exists.
+*/
+static void hash_referenced_files(const vector<string> &args, uint64_t &hash)
+{
+    bool is_sex = !args.empty() && (args[0] == "sex" ||
+                  (args[0].size() > 4 && args[0].compare(args[0].size()-4,4,"/sex") == 0));
+    bool has_config = false;
+
+    for ( size_t i = 0; i+1 < args.size(); ++i ) {
+        if ( args[i] == ROTCEN_CACHE_NESTED_OPTION ) {
+            vector<string> nested;
+            size_t start = 0;
+            while ( start < args[i+1].size() ) {
+                size_t end = args[i+1].find(' ',start);
+                if ( end == string::npos ) end = args[i+1].size();
+                if ( end > start ) nested.push_back(args[i+1].substr(start,end-start));
+                start = end + 1;
+            }
+            hash_referenced_files(nested,hash);
+            continue;
+        }
+
+        if ( find(ROTCEN_CACHE_FILE_OPTIONS.begin(),ROTCEN_CACHE_FILE_OPTIONS.end(),args[i]) ==
+             ROTCEN_CACHE_FILE_OPTIONS.end() ) continue;
+
+        if ( args[i] == "-c" ) has_config = true;
+        hash_file(args[i+1],hash);
+    }
+
+    if ( is_sex && !has_config && file_exists("default.sex") ) hash_file("default.sex",hash);
+}
+
+
+ProductCache::ProductCache(const string &dir):
+    CacheDir(dir), Good(false)
+{
+    if ( CacheDir.empty() ) return;
+    if ( CacheDir.back() != '/' ) CacheDir += '/';
+
+    if ( mkdir(CacheDir.c_str(),0755) && errno != EEXIST ) return;
+
+    struct stat st;
+    Good = stat(CacheDir.c_str(),&st) == 0 && S_ISDIR(st.st_mode) && access(CacheDir.c_str(),W_OK) == 0;
+}
+
+
+bool ProductCache::good() const
+{
+    return Good;
+}
+
+
+const string& ProductCache::Dir() const
+{
+    return CacheDir;
+}
+
+
+uint64_t ProductCache::Hash(const void *data, size_t len, uint64_t hash)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    for ( size_t i = 0; i < len; ++i ) {
+        hash ^= p[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
+
+int ProductCache::Key(const string &input_file, const vector<string> &args, string &key) const
+{
+    uint64_t hash = Hash(ROTCEN_CACHE_VERSION,sizeof(ROTCEN_CACHE_VERSION));
+
+    if ( !hash_file(input_file,hash) ) return ROTCEN_ERROR_INVALID_FILENAME;
+
+    for ( auto &arg: args ) hash = Hash(arg.c_str(),arg.size()+1,hash); // with terminating zero as separator
+
+    hash_referenced_files(args,hash);
+
+    char str[17];
+    snprintf(str,sizeof(str),"%016llx",(unsigned long long)hash);
+    key = str;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+string ProductCache::CachedPath(const string &key, const string &suffix) const
+{
+    return CacheDir + key + suffix;
+}
+
+
+bool ProductCache::Fetch(const string &key, const vector<CacheProduct> &products) const
+{
+    if ( !Good ) return false;
+
+    for ( auto &prod: products ) {
+        if ( !file_exists(CachedPath(key,prod.Suffix)) ) return false;
+    }
+
+    // the working files are always copies: an application run later with other
+    // parameters would overwrite a hard-linked product in place
+    for ( auto &prod: products ) {
+        if ( !copy_file(CachedPath(key,prod.Suffix),prod.Path) ) return false;
+    }
+
+    return true;
+}
+
+
+bool ProductCache::Store(const string &key, const vector<CacheProduct> &products) const
+{
+    static atomic<unsigned long> tmp_counter(0);
+
+    if ( !Good ) return false;
+
+    for ( auto &prod: products ) {
+        string cached = CachedPath(key,prod.Suffix);
+        string tmp = cached + ".tmp." + to_string(getpid()) + "." + to_string(tmp_counter++);
+
+        if ( !copy_file(prod.Path,tmp) ) return false;
+        if ( rename(tmp.c_str(),cached.c_str()) ) {
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
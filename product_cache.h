@@ -0,0 +1,66 @@
+#ifndef PRODUCT_CACHE_H
+#define PRODUCT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+//
+// Persistent content-addressed cache of the external applications products
+// ('sex' catalogs, 'solve-field' RDLS, XYLS and solved-files).
+//
+// The key of a frame is 64-bit FNV-1a hash of the input file content followed by
+// the effective commandline of the application (without the frame-specific
+// filenames) and the content of the files referenced by the commandline
+// (configurations, filters, parameter lists), so an edited configuration does not
+// hit the products of the old one. The products of a key are stored in the cache
+// directory as <key><suffix> files, e.g. "0123456789abcdef.rdls".
+//
+// The cached products are copied to the locations where the application would
+// create them, so the rest of the processing does not distinguish a cache hit from
+// a real run. Files are stored through a temporary file and rename(), so concurrent
+// runs and frames never see partially written products. Cached files are never
+// deleted by the program.
+//
+struct CacheProduct
+{
+    string Suffix; // suffix of the product in the cache directory
+    string Path;   // working location of the product
+};
+
+
+class ProductCache
+{
+public:
+    // the directory is created if it does not exist
+    explicit ProductCache(const string &dir);
+
+    bool good() const;
+    const string& Dir() const;
+
+    // returns ROTCEN_ERROR_OK or ROTCEN_ERROR_INVALID_FILENAME if the input file cannot be read
+    int Key(const string &input_file, const vector<string> &args, string &key) const;
+
+    // copy the cached products to their working locations, returns false
+    // if any of the products is not in the cache (nothing is changed then)
+    bool Fetch(const string &key, const vector<CacheProduct> &products) const;
+
+    // returns false if any of the products cannot be stored
+    bool Store(const string &key, const vector<CacheProduct> &products) const;
+
+    // FNV-1a hash of a memory block (continued from 'hash')
+    static uint64_t Hash(const void *data, size_t len, uint64_t hash = HASH_OFFSET);
+
+    static const uint64_t HASH_OFFSET = UINT64_C(14695981039346656037);
+    static const uint64_t HASH_PRIME = UINT64_C(1099511628211);
+
+private:
+    string CachedPath(const string &key, const string &suffix) const;
+
+    string CacheDir;
+    bool Good;
+};
+
+#endif // PRODUCT_CACHE_H
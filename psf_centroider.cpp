@@ -0,0 +1,741 @@
+#include "psf_centroider.h"
+#include "fits_image.h"
+#include "stage_profiler.h"
+#include "rotcen_errors.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define PSF_CENTROIDER_AVX2
+#endif
+
+
+static const size_t PSF_N_PARS = 5; // X0, Y0, A, B, W
+static const size_t PSF_N_NORMAL = PSF_N_PARS*(PSF_N_PARS+1)/2; // upper triangle of the normal matrix
+
+enum {PSF_X0, PSF_Y0, PSF_A, PSF_B, PSF_W};
+
+static const double PSF_MAX_LAMBDA = 1.0e10;
+static const double PSF_CONVERGED_SHIFT = 1.0e-4; // pixels
+
+
+PsfFitParams::PsfFitParams(): Model(Gaussian), StampRadius(5), MoffatBeta(2.5), MaxIter(20), MaxShift(2.0)
+{
+}
+
+
+//
+// Stamps and fit state of a batch of objects. The arrays of the lanes are the
+// innermost ones, so the SIMD kernels of Evaluate load the parameters of
+// adjacent lanes into one register.
+//
+struct PsfCentroider::Batch
+{
+    static const size_t B = BATCH_SIZE;
+
+    explicit Batch(size_t stamp_radius):
+        N_pix((2*stamp_radius+1)*(2*stamp_radius+1)), Dx(N_pix), Dy(N_pix), Values(N_pix*B)
+    {
+        size_t size = 2*stamp_radius+1;
+        for ( size_t p = 0; p < N_pix; ++p ) {
+            Dx[p] = (double)(p % size) - (double)stamp_radius;
+            Dy[p] = (double)(p / size) - (double)stamp_radius;
+        }
+    }
+
+    size_t N_pix;
+    vector<double> Dx, Dy; // pixel offsets from the stamp center
+    vector<double> Values; // Values[p*B + lane]
+
+    size_t Row[B];         // catalog row of the object
+    long Cx[B], Cy[B];     // stamp center (0-based pixel)
+    bool Fitted[B];        // the lane has an object with valid initial guess
+    bool Active[B];        // the fit is not finished (still set after FitBatch if it did not converge)
+    bool TrialValid[B];
+
+    double Pars[PSF_N_PARS][B];
+    double Trial[PSF_N_PARS][B];
+    double Init[2][B];     // initial X0 and Y0
+    double Chi2[B], TrialChi2[B];
+    double Lambda[B];
+
+    double Normal[PSF_N_NORMAL][B]; // J^T*J
+    double Rhs[PSF_N_PARS][B];      // J^T*(data - model)
+};
+
+
+PsfCentroider::PsfCentroider(const PsfFitParams &params): Params(params)
+{
+    if ( Params.StampRadius < 1 ) Params.StampRadius = 1;
+}
+
+
+/*
+    Approximations of exp and log evaluated by the same sequence of operations in
+    the scalar functions and in the SIMD kernels below, so all the paths give the
+    same results (no FMA is used).
+
+    exp(x) = 2^k*exp(r), k = round(x/ln2), |r| <= ln2/2, exp(r) by Taylor polynomial
+    of degree 12 (relative error below 1e-15). The argument is clamped to [-708,708],
+    i.e. the result neither underflows nor overflows, NaN gives NaN.
+
+    log(q) = e*ln2 + log(m), q = m*2^e, sqrt(2)/2 < m <= sqrt(2), log(m) = 2*atanh(s)
+    with s = (m-1)/(m+1) by the series up to s^21. Only positive normal numbers are
+    valid arguments (the model has q >= 1).
+*/
+static const double PSF_EXP_MIN = -708.0;
+static const double PSF_EXP_MAX = 708.0;
+static const double PSF_LOG2E = 1.4426950408889634;
+static const double PSF_LN2 = 0.6931471805599453;
+static const double PSF_LN2_HI = 6.93147180369123816490e-01; // ln2 = LN2_HI + LN2_LO, k*LN2_HI is exact
+static const double PSF_LN2_LO = 1.90821492927058770002e-10;
+static const double PSF_ROUND = 6755399441055744.0;          // 1.5*2^52: x + ROUND - ROUND rounds x to integer
+static const double PSF_SQRT2 = 1.4142135623730951;
+static const double PSF_EXP_2P52 = 4503599627370496.0;       // 2^52
+
+static const uint64_t PSF_EXP_BIAS = 1023;
+static const uint64_t PSF_MANTISSA_MASK = UINT64_C(0x000FFFFFFFFFFFFF);
+static const uint64_t PSF_ONE_BITS = UINT64_C(0x3FF0000000000000);      // 1.0
+static const uint64_t PSF_2P52_BITS = UINT64_C(0x4330000000000000);     // 2^52
+
+static const size_t PSF_EXP_ORDER = 12;
+static const double PSF_EXP_COEFFS[PSF_EXP_ORDER+1] = { // 1/n!, the highest order first
+    1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0, 1.0/362880.0, 1.0/40320.0, 1.0/5040.0,
+    1.0/720.0, 1.0/120.0, 1.0/24.0, 1.0/6.0, 1.0/2.0, 1.0, 1.0
+};
+
+static const size_t PSF_LOG_ORDER = 10;
+static const double PSF_LOG_COEFFS[PSF_LOG_ORDER+1] = { // 1/(2n+1), the highest order first
+    1.0/21.0, 1.0/19.0, 1.0/17.0, 1.0/15.0, 1.0/13.0, 1.0/11.0, 1.0/9.0, 1.0/7.0, 1.0/5.0, 1.0/3.0, 1.0
+};
+
+
+static inline uint64_t double_bits(double x)
+{
+    uint64_t bits;
+    memcpy(&bits,&x,sizeof(bits));
+    return bits;
+}
+
+
+static inline double bits_double(uint64_t bits)
+{
+    double x;
+    memcpy(&x,&bits,sizeof(x));
+    return x;
+}
+
+
+static inline double exp_approx(double x)
+{
+    x = PSF_EXP_MIN > x ? PSF_EXP_MIN : x; // as _mm_max_pd(MIN,x), NaN is kept
+    x = PSF_EXP_MAX < x ? PSF_EXP_MAX : x;
+
+    double t = x*PSF_LOG2E + PSF_ROUND;
+    double k = t - PSF_ROUND;
+    double r = (x - k*PSF_LN2_HI) - k*PSF_LN2_LO;
+
+    double p = PSF_EXP_COEFFS[0];
+    for ( size_t i = 1; i <= PSF_EXP_ORDER; ++i ) p = p*r + PSF_EXP_COEFFS[i];
+
+    return p*bits_double((double_bits(t) + PSF_EXP_BIAS) << 52); // the low bits of t are k
+}
+
+
+static inline double log_approx(double q)
+{
+    uint64_t bits = double_bits(q);
+    double e = bits_double((bits >> 52) | PSF_2P52_BITS) - PSF_EXP_2P52 - (double)PSF_EXP_BIAS;
+    double m = bits_double((bits & PSF_MANTISSA_MASK) | PSF_ONE_BITS);
+    if ( m > PSF_SQRT2 ) {
+        m = m*0.5;
+        e = e + 1.0;
+    }
+
+    double s = (m - 1.0)/(m + 1.0);
+    double s2 = s*s;
+
+    double p = PSF_LOG_COEFFS[0];
+    for ( size_t i = 1; i <= PSF_LOG_ORDER; ++i ) p = p*s2 + PSF_LOG_COEFFS[i];
+
+    return e*PSF_LN2 + 2.0*s*p;
+}
+
+
+/*
+    Value and derivatives of the profile f(r^2;W): df_dr2 by r^2 and df_dw by W
+*/
+static inline double gaussian_profile(double r2, double w, double &df_dr2, double &df_dw)
+{
+    double f = exp_approx(-w*r2);
+    df_dr2 = -w*f;
+    df_dw = -r2*f;
+    return f;
+}
+
+
+static inline double moffat_profile(double r2, double w, double beta, double &df_dr2, double &df_dw)
+{
+    double q = 1.0 + w*r2;
+    double f = exp_approx(-beta*log_approx(q));
+    double g = -beta*f/q;
+    df_dr2 = g*w;
+    df_dw = g*r2;
+    return f;
+}
+
+
+//
+// Stamps and parameters of the lanes of a batch (see PsfCentroider::Evaluate). The
+// sums over the stamp pixels are accumulated in the pixel order for each lane.
+//
+struct PsfLanes
+{
+    static const size_t B = PsfCentroider::BATCH_SIZE;
+
+    size_t N_pix;
+    const double *Dx, *Dy;   // pixel offsets from the stamp center
+    const double *Values;    // Values[p*B + lane]
+    const double (*Pars)[B];
+    bool Moffat;
+    double Beta;
+    bool Trial;              // chi-square only
+
+    double *Chi2;
+    double (*Normal)[B];
+    double (*Rhs)[B];
+};
+
+
+static void evaluate_scalar(const PsfLanes &d, size_t l)
+{
+    const size_t B = PsfLanes::B;
+
+    for ( ; l < B; ++l ) {
+        double chi2 = 0.0;
+        double normal[PSF_N_NORMAL] = {0.0};
+        double rhs[PSF_N_PARS] = {0.0};
+
+        double a = d.Pars[PSF_A][l];
+        double m2a = -2.0*a;
+
+        for ( size_t p = 0; p < d.N_pix; ++p ) {
+            double dx = d.Dx[p] - d.Pars[PSF_X0][l];
+            double dy = d.Dy[p] - d.Pars[PSF_Y0][l];
+            double r2 = dx*dx + dy*dy;
+
+            double df_dr2, df_dw;
+            double f = d.Moffat ? moffat_profile(r2,d.Pars[PSF_W][l],d.Beta,df_dr2,df_dw) :
+                                  gaussian_profile(r2,d.Pars[PSF_W][l],df_dr2,df_dw);
+
+            double res = d.Values[p*B+l] - (d.Pars[PSF_B][l] + a*f);
+            chi2 += res*res;
+            if ( d.Trial ) continue;
+
+            double j[PSF_N_PARS] = {m2a*df_dr2*dx, m2a*df_dr2*dy, f, 1.0, a*df_dw};
+
+            size_t k = 0;
+            for ( size_t i = 0; i < PSF_N_PARS; ++i ) {
+                rhs[i] += j[i]*res;
+                for ( size_t m = i; m < PSF_N_PARS; ++m ) normal[k++] += j[i]*j[m];
+            }
+        }
+
+        d.Chi2[l] = chi2;
+        if ( d.Trial ) continue;
+        for ( size_t k = 0; k < PSF_N_NORMAL; ++k ) d.Normal[k][l] = normal[k];
+        for ( size_t i = 0; i < PSF_N_PARS; ++i ) d.Rhs[i][l] = rhs[i];
+    }
+}
+
+
+#if defined(__SSE2__)
+
+/*
+    SSE2 kernel (2 lanes per iteration). It returns the number of the evaluated
+    lanes, the rest is left for the scalar function.
+*/
+static inline __m128d exp_sse2(__m128d x)
+{
+    x = _mm_max_pd(_mm_set1_pd(PSF_EXP_MIN),x);
+    x = _mm_min_pd(_mm_set1_pd(PSF_EXP_MAX),x);
+
+    __m128d t = _mm_add_pd(_mm_mul_pd(x,_mm_set1_pd(PSF_LOG2E)),_mm_set1_pd(PSF_ROUND));
+    __m128d k = _mm_sub_pd(t,_mm_set1_pd(PSF_ROUND));
+    __m128d r = _mm_sub_pd(_mm_sub_pd(x,_mm_mul_pd(k,_mm_set1_pd(PSF_LN2_HI))),_mm_mul_pd(k,_mm_set1_pd(PSF_LN2_LO)));
+
+    __m128d p = _mm_set1_pd(PSF_EXP_COEFFS[0]);
+    for ( size_t i = 1; i <= PSF_EXP_ORDER; ++i ) p = _mm_add_pd(_mm_mul_pd(p,r),_mm_set1_pd(PSF_EXP_COEFFS[i]));
+
+    __m128i scale = _mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(t),_mm_set1_epi64x(PSF_EXP_BIAS)),52);
+    return _mm_mul_pd(p,_mm_castsi128_pd(scale));
+}
+
+
+static inline __m128d log_sse2(__m128d q)
+{
+    __m128i bits = _mm_castpd_si128(q);
+    __m128d e = _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits,52),_mm_set1_epi64x(PSF_2P52_BITS)));
+    e = _mm_sub_pd(_mm_sub_pd(e,_mm_set1_pd(PSF_EXP_2P52)),_mm_set1_pd((double)PSF_EXP_BIAS));
+    __m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits,_mm_set1_epi64x(PSF_MANTISSA_MASK)),
+                                              _mm_set1_epi64x(PSF_ONE_BITS)));
+
+    __m128d big = _mm_cmpgt_pd(m,_mm_set1_pd(PSF_SQRT2));
+    m = _mm_or_pd(_mm_and_pd(big,_mm_mul_pd(m,_mm_set1_pd(0.5))),_mm_andnot_pd(big,m));
+    e = _mm_add_pd(e,_mm_and_pd(big,_mm_set1_pd(1.0)));
+
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d s = _mm_div_pd(_mm_sub_pd(m,one),_mm_add_pd(m,one));
+    __m128d s2 = _mm_mul_pd(s,s);
+
+    __m128d p = _mm_set1_pd(PSF_LOG_COEFFS[0]);
+    for ( size_t i = 1; i <= PSF_LOG_ORDER; ++i ) p = _mm_add_pd(_mm_mul_pd(p,s2),_mm_set1_pd(PSF_LOG_COEFFS[i]));
+
+    return _mm_add_pd(_mm_mul_pd(e,_mm_set1_pd(PSF_LN2)),_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(2.0),s),p));
+}
+
+
+static size_t evaluate_sse2(const PsfLanes &d, size_t l)
+{
+    const size_t B = PsfLanes::B;
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d neg_beta = _mm_set1_pd(-d.Beta);
+
+    for ( ; l+2 <= B; l += 2 ) {
+        __m128d x0 = _mm_loadu_pd(d.Pars[PSF_X0]+l);
+        __m128d y0 = _mm_loadu_pd(d.Pars[PSF_Y0]+l);
+        __m128d a = _mm_loadu_pd(d.Pars[PSF_A]+l);
+        __m128d b = _mm_loadu_pd(d.Pars[PSF_B]+l);
+        __m128d w = _mm_loadu_pd(d.Pars[PSF_W]+l);
+        __m128d neg_w = _mm_sub_pd(zero,w);
+        __m128d m2a = _mm_mul_pd(_mm_set1_pd(-2.0),a);
+
+        __m128d chi2 = zero;
+        __m128d normal[PSF_N_NORMAL], rhs[PSF_N_PARS];
+        for ( size_t k = 0; k < PSF_N_NORMAL; ++k ) normal[k] = zero;
+        for ( size_t i = 0; i < PSF_N_PARS; ++i ) rhs[i] = zero;
+
+        for ( size_t p = 0; p < d.N_pix; ++p ) {
+            __m128d dx = _mm_sub_pd(_mm_set1_pd(d.Dx[p]),x0);
+            __m128d dy = _mm_sub_pd(_mm_set1_pd(d.Dy[p]),y0);
+            __m128d r2 = _mm_add_pd(_mm_mul_pd(dx,dx),_mm_mul_pd(dy,dy));
+
+            __m128d f, df_dr2, df_dw;
+            if ( d.Moffat ) {
+                __m128d q = _mm_add_pd(_mm_set1_pd(1.0),_mm_mul_pd(w,r2));
+                f = exp_sse2(_mm_mul_pd(neg_beta,log_sse2(q)));
+                __m128d g = _mm_div_pd(_mm_mul_pd(neg_beta,f),q);
+                df_dr2 = _mm_mul_pd(g,w);
+                df_dw = _mm_mul_pd(g,r2);
+            } else {
+                f = exp_sse2(_mm_mul_pd(neg_w,r2));
+                df_dr2 = _mm_mul_pd(neg_w,f);
+                df_dw = _mm_mul_pd(_mm_sub_pd(zero,r2),f);
+            }
+
+            __m128d res = _mm_sub_pd(_mm_loadu_pd(d.Values+p*B+l),_mm_add_pd(b,_mm_mul_pd(a,f)));
+            chi2 = _mm_add_pd(chi2,_mm_mul_pd(res,res));
+            if ( d.Trial ) continue;
+
+            __m128d g = _mm_mul_pd(m2a,df_dr2);
+            __m128d j[PSF_N_PARS] = {_mm_mul_pd(g,dx), _mm_mul_pd(g,dy), f, _mm_set1_pd(1.0), _mm_mul_pd(a,df_dw)};
+
+            size_t k = 0;
+            for ( size_t i = 0; i < PSF_N_PARS; ++i ) {
+                rhs[i] = _mm_add_pd(rhs[i],_mm_mul_pd(j[i],res));
+                for ( size_t m = i; m < PSF_N_PARS; ++m, ++k ) normal[k] = _mm_add_pd(normal[k],_mm_mul_pd(j[i],j[m]));
+            }
+        }
+
+        _mm_storeu_pd(d.Chi2+l,chi2);
+        if ( d.Trial ) continue;
+        for ( size_t k = 0; k < PSF_N_NORMAL; ++k ) _mm_storeu_pd(d.Normal[k]+l,normal[k]);
+        for ( size_t i = 0; i < PSF_N_PARS; ++i ) _mm_storeu_pd(d.Rhs[i]+l,rhs[i]);
+    }
+
+    return l;
+}
+
+#endif // __SSE2__
+
+
+#if defined(PSF_CENTROIDER_AVX2)
+
+/*
+    AVX2 kernel (4 lanes per iteration), it is compiled for AVX2 regardless of the
+    compiler flags and used only if the CPU supports it
+*/
+__attribute__((target("avx2")))
+static inline __m256d exp_avx2(__m256d x)
+{
+    x = _mm256_max_pd(_mm256_set1_pd(PSF_EXP_MIN),x);
+    x = _mm256_min_pd(_mm256_set1_pd(PSF_EXP_MAX),x);
+
+    __m256d t = _mm256_add_pd(_mm256_mul_pd(x,_mm256_set1_pd(PSF_LOG2E)),_mm256_set1_pd(PSF_ROUND));
+    __m256d k = _mm256_sub_pd(t,_mm256_set1_pd(PSF_ROUND));
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(x,_mm256_mul_pd(k,_mm256_set1_pd(PSF_LN2_HI))),
+                              _mm256_mul_pd(k,_mm256_set1_pd(PSF_LN2_LO)));
+
+    __m256d p = _mm256_set1_pd(PSF_EXP_COEFFS[0]);
+    for ( size_t i = 1; i <= PSF_EXP_ORDER; ++i ) p = _mm256_add_pd(_mm256_mul_pd(p,r),_mm256_set1_pd(PSF_EXP_COEFFS[i]));
+
+    __m256i scale = _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t),_mm256_set1_epi64x(PSF_EXP_BIAS)),52);
+    return _mm256_mul_pd(p,_mm256_castsi256_pd(scale));
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256d log_avx2(__m256d q)
+{
+    __m256i bits = _mm256_castpd_si256(q);
+    __m256d e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits,52),_mm256_set1_epi64x(PSF_2P52_BITS)));
+    e = _mm256_sub_pd(_mm256_sub_pd(e,_mm256_set1_pd(PSF_EXP_2P52)),_mm256_set1_pd((double)PSF_EXP_BIAS));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits,_mm256_set1_epi64x(PSF_MANTISSA_MASK)),
+                                                    _mm256_set1_epi64x(PSF_ONE_BITS)));
+
+    __m256d big = _mm256_cmp_pd(m,_mm256_set1_pd(PSF_SQRT2),_CMP_GT_OQ);
+    m = _mm256_blendv_pd(m,_mm256_mul_pd(m,_mm256_set1_pd(0.5)),big);
+    e = _mm256_add_pd(e,_mm256_and_pd(big,_mm256_set1_pd(1.0)));
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(m,one),_mm256_add_pd(m,one));
+    __m256d s2 = _mm256_mul_pd(s,s);
+
+    __m256d p = _mm256_set1_pd(PSF_LOG_COEFFS[0]);
+    for ( size_t i = 1; i <= PSF_LOG_ORDER; ++i ) p = _mm256_add_pd(_mm256_mul_pd(p,s2),_mm256_set1_pd(PSF_LOG_COEFFS[i]));
+
+    return _mm256_add_pd(_mm256_mul_pd(e,_mm256_set1_pd(PSF_LN2)),_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0),s),p));
+}
+
+
+__attribute__((target("avx2")))
+static size_t evaluate_avx2(const PsfLanes &d, size_t l)
+{
+    const size_t B = PsfLanes::B;
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d neg_beta = _mm256_set1_pd(-d.Beta);
+
+    for ( ; l+4 <= B; l += 4 ) {
+        __m256d x0 = _mm256_loadu_pd(d.Pars[PSF_X0]+l);
+        __m256d y0 = _mm256_loadu_pd(d.Pars[PSF_Y0]+l);
+        __m256d a = _mm256_loadu_pd(d.Pars[PSF_A]+l);
+        __m256d b = _mm256_loadu_pd(d.Pars[PSF_B]+l);
+        __m256d w = _mm256_loadu_pd(d.Pars[PSF_W]+l);
+        __m256d neg_w = _mm256_sub_pd(zero,w);
+        __m256d m2a = _mm256_mul_pd(_mm256_set1_pd(-2.0),a);
+
+        __m256d chi2 = zero;
+        __m256d normal[PSF_N_NORMAL], rhs[PSF_N_PARS];
+        for ( size_t k = 0; k < PSF_N_NORMAL; ++k ) normal[k] = zero;
+        for ( size_t i = 0; i < PSF_N_PARS; ++i ) rhs[i] = zero;
+
+        for ( size_t p = 0; p < d.N_pix; ++p ) {
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(d.Dx[p]),x0);
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(d.Dy[p]),y0);
+            __m256d r2 = _mm256_add_pd(_mm256_mul_pd(dx,dx),_mm256_mul_pd(dy,dy));
+
+            __m256d f, df_dr2, df_dw;
+            if ( d.Moffat ) {
+                __m256d q = _mm256_add_pd(_mm256_set1_pd(1.0),_mm256_mul_pd(w,r2));
+                f = exp_avx2(_mm256_mul_pd(neg_beta,log_avx2(q)));
+                __m256d g = _mm256_div_pd(_mm256_mul_pd(neg_beta,f),q);
+                df_dr2 = _mm256_mul_pd(g,w);
+                df_dw = _mm256_mul_pd(g,r2);
+            } else {
+                f = exp_avx2(_mm256_mul_pd(neg_w,r2));
+                df_dr2 = _mm256_mul_pd(neg_w,f);
+                df_dw = _mm256_mul_pd(_mm256_sub_pd(zero,r2),f);
+            }
+
+            __m256d res = _mm256_sub_pd(_mm256_loadu_pd(d.Values+p*B+l),_mm256_add_pd(b,_mm256_mul_pd(a,f)));
+            chi2 = _mm256_add_pd(chi2,_mm256_mul_pd(res,res));
+            if ( d.Trial ) continue;
+
+            __m256d g = _mm256_mul_pd(m2a,df_dr2);
+            __m256d j[PSF_N_PARS] = {_mm256_mul_pd(g,dx), _mm256_mul_pd(g,dy), f, _mm256_set1_pd(1.0), _mm256_mul_pd(a,df_dw)};
+
+            size_t k = 0;
+            for ( size_t i = 0; i < PSF_N_PARS; ++i ) {
+                rhs[i] = _mm256_add_pd(rhs[i],_mm256_mul_pd(j[i],res));
+                for ( size_t m = i; m < PSF_N_PARS; ++m, ++k ) normal[k] = _mm256_add_pd(normal[k],_mm256_mul_pd(j[i],j[m]));
+            }
+        }
+
+        _mm256_storeu_pd(d.Chi2+l,chi2);
+        if ( d.Trial ) continue;
+        for ( size_t k = 0; k < PSF_N_NORMAL; ++k ) _mm256_storeu_pd(d.Normal[k]+l,normal[k]);
+        for ( size_t i = 0; i < PSF_N_PARS; ++i ) _mm256_storeu_pd(d.Rhs[i]+l,rhs[i]);
+    }
+
+    return l;
+}
+
+
+static bool has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif // PSF_CENTROIDER_AVX2
+
+
+/*
+    The function computes chi-square of the trial parameters ('trial') or chi-square
+    and the normal equations of the current ones for all the lanes of the batch
+*/
+void PsfCentroider::Evaluate(Batch &batch, bool trial) const
+{
+    PsfLanes d;
+    d.N_pix = batch.N_pix;
+    d.Dx = batch.Dx.data();
+    d.Dy = batch.Dy.data();
+    d.Values = batch.Values.data();
+    d.Pars = trial ? batch.Trial : batch.Pars;
+    d.Moffat = Params.Model == PsfFitParams::Moffat;
+    d.Beta = Params.MoffatBeta;
+    d.Trial = trial;
+    d.Chi2 = trial ? batch.TrialChi2 : batch.Chi2;
+    d.Normal = batch.Normal;
+    d.Rhs = batch.Rhs;
+
+    size_t done = 0;
+#if defined(PSF_CENTROIDER_AVX2)
+    if ( has_avx2() ) done = evaluate_avx2(d,done);
+#endif
+#if defined(__SSE2__)
+    done = evaluate_sse2(d,done);
+#endif
+    evaluate_scalar(d,done);
+}
+
+
+/*
+    The function solves the damped normal equations of the lane by Cholesky
+    decomposition, it returns false if the matrix is not positive definite
+*/
+static bool solve_step(const double (*normal)[PsfCentroider::BATCH_SIZE], const double (*rhs)[PsfCentroider::BATCH_SIZE],
+                       size_t l, double lambda, double *step)
+{
+    const size_t N = PSF_N_PARS;
+    double a[N][N];
+
+    size_t k = 0;
+    for ( size_t i = 0; i < N; ++i ) {
+        for ( size_t m = i; m < N; ++m ) a[i][m] = a[m][i] = normal[k++][l];
+        a[i][i] *= 1.0 + lambda;
+    }
+
+    for ( size_t i = 0; i < N; ++i ) {
+        for ( size_t m = 0; m < i; ++m ) a[i][i] -= a[i][m]*a[i][m];
+        if ( !(a[i][i] > 0.0) ) return false;
+        a[i][i] = sqrt(a[i][i]);
+        for ( size_t r = i+1; r < N; ++r ) {
+            for ( size_t m = 0; m < i; ++m ) a[r][i] -= a[r][m]*a[i][m];
+            a[r][i] /= a[i][i];
+        }
+    }
+
+    for ( size_t i = 0; i < N; ++i ) { // L*z = rhs
+        double s = rhs[i][l];
+        for ( size_t m = 0; m < i; ++m ) s -= a[i][m]*step[m];
+        step[i] = s/a[i][i];
+    }
+    for ( size_t i = N; i-- > 0; ) { // L^T*step = z
+        double s = step[i];
+        for ( size_t m = i+1; m < N; ++m ) s -= a[m][i]*step[m];
+        step[i] = s/a[i][i];
+    }
+
+    return true;
+}
+
+
+void PsfCentroider::FitBatch(Batch &batch) const
+{
+    const size_t B = Batch::B;
+
+    for ( size_t l = 0; l < B; ++l ) {
+        batch.Active[l] = batch.Fitted[l];
+        batch.Lambda[l] = 1.0e-3;
+    }
+
+    Evaluate(batch,false);
+
+    for ( size_t iter = 0; iter < Params.MaxIter; ++iter ) {
+        bool active = false;
+        double step[B][PSF_N_PARS];
+
+        for ( size_t l = 0; l < B; ++l ) {
+            for ( size_t k = 0; k < PSF_N_PARS; ++k ) batch.Trial[k][l] = batch.Pars[k][l];
+            batch.TrialValid[l] = false;
+            if ( !batch.Active[l] ) continue;
+
+            active = true;
+            if ( !solve_step(batch.Normal,batch.Rhs,l,batch.Lambda[l],step[l]) ) continue;
+
+            for ( size_t k = 0; k < PSF_N_PARS; ++k ) batch.Trial[k][l] += step[l][k];
+            batch.TrialValid[l] = batch.Trial[PSF_A][l] > 0.0 && batch.Trial[PSF_W][l] > 0.0;
+        }
+        if ( !active ) break;
+
+        Evaluate(batch,true);
+
+        for ( size_t l = 0; l < B; ++l ) {
+            if ( !batch.Active[l] ) continue;
+
+            if ( batch.TrialValid[l] && batch.TrialChi2[l] < batch.Chi2[l] ) {
+                for ( size_t k = 0; k < PSF_N_PARS; ++k ) batch.Pars[k][l] = batch.Trial[k][l];
+                batch.Lambda[l] *= 0.1;
+                if ( fabs(step[l][PSF_X0]) < PSF_CONVERGED_SHIFT && fabs(step[l][PSF_Y0]) < PSF_CONVERGED_SHIFT ) {
+                    batch.Active[l] = false;
+                }
+            } else {
+                batch.Lambda[l] *= 10.0;
+                if ( batch.Lambda[l] > PSF_MAX_LAMBDA ) batch.Active[l] = false; // no better point nearby
+            }
+        }
+
+        Evaluate(batch,false);
+    }
+}
+
+
+size_t PsfCentroider::Refine(const float *pix, size_t nx, size_t ny, Catalog &cat, const vector<Catalog::IdType> &ids) const
+{
+    const size_t B = Batch::B;
+    const long R = Params.StampRadius;
+    const size_t size = 2*R+1;
+
+    Batch batch(R);
+    vector<double> border;
+    size_t N_refined = 0;
+
+    for ( size_t start = 0; start < ids.size(); start += B ) {
+
+        // stamps and initial guesses
+
+        for ( size_t l = 0; l < B; ++l ) {
+            batch.Fitted[l] = false;
+            batch.Pars[PSF_X0][l] = batch.Pars[PSF_Y0][l] = batch.Pars[PSF_B][l] = 0.0;
+            batch.Pars[PSF_A][l] = batch.Pars[PSF_W][l] = 1.0;
+            for ( size_t p = 0; p < batch.N_pix; ++p ) batch.Values[p*B+l] = 0.0;
+
+            if ( start + l >= ids.size() ) continue;
+            Catalog::IdType id = ids[start+l];
+            if ( id < 1 || (size_t)id > cat.Size() ) continue;
+
+            size_t row = Catalog::Row(id);
+            double x = cat.X(row) - 1.0; // 0-based pixel coordinates
+            double y = cat.Y(row) - 1.0;
+            if ( !isfinite(x) || !isfinite(y) ) continue;
+
+            long cx = lround(x), cy = lround(y);
+            if ( cx < R || cy < R || cx+R >= (long)nx || cy+R >= (long)ny ) continue;
+
+            border.clear();
+            double peak = -numeric_limits<double>::infinity();
+            for ( size_t p = 0; p < batch.N_pix; ++p ) {
+                double v = pix[(cy + (long)batch.Dy[p])*(long)nx + cx + (long)batch.Dx[p]];
+                batch.Values[p*B+l] = v;
+                peak = max(peak,v);
+                if ( p < size || p >= batch.N_pix-size || p % size == 0 || p % size == size-1 ) border.push_back(v);
+            }
+
+            nth_element(border.begin(),border.begin()+border.size()/2,border.end());
+            double bkg = border[border.size()/2];
+            if ( !(peak > bkg) ) continue; // also NaN
+
+            // second moment of the excess over the background gives the initial width
+            double m0 = 0.0, m2 = 0.0;
+            for ( size_t p = 0; p < batch.N_pix; ++p ) {
+                double v = batch.Values[p*B+l] - bkg;
+                if ( v <= 0.0 ) continue;
+                double dx = batch.Dx[p] - (x - cx), dy = batch.Dy[p] - (y - cy);
+                m0 += v;
+                m2 += v*(dx*dx + dy*dy);
+            }
+            double sigma2 = m0 > 0.0 ? m2/(2.0*m0) : 1.0;
+            sigma2 = min(max(sigma2,0.25),0.25*R*R);
+
+            batch.Row[l] = row;
+            batch.Cx[l] = cx;
+            batch.Cy[l] = cy;
+            batch.Pars[PSF_X0][l] = batch.Init[0][l] = x - cx;
+            batch.Pars[PSF_Y0][l] = batch.Init[1][l] = y - cy;
+            batch.Pars[PSF_A][l] = peak - bkg;
+            batch.Pars[PSF_B][l] = bkg;
+            if ( Params.Model == PsfFitParams::Moffat ) { // the same half width at half maximum
+                batch.Pars[PSF_W][l] = (pow(2.0,1.0/Params.MoffatBeta) - 1.0)/(2.0*log(2.0)*sigma2);
+            } else {
+                batch.Pars[PSF_W][l] = 0.5/sigma2;
+            }
+            batch.Fitted[l] = true;
+        }
+
+        FitBatch(batch);
+
+        for ( size_t l = 0; l < B; ++l ) {
+            if ( !batch.Fitted[l] || batch.Active[l] ) continue; // MaxIter is exhausted
+
+            double x0 = batch.Pars[PSF_X0][l], y0 = batch.Pars[PSF_Y0][l];
+            double dx = x0 - batch.Init[0][l], dy = y0 - batch.Init[1][l];
+            if ( !isfinite(x0) || !isfinite(y0) || dx*dx + dy*dy > Params.MaxShift*Params.MaxShift ) continue;
+
+            cat.X(batch.Row[l]) = batch.Cx[l] + x0 + 1.0;
+            cat.Y(batch.Row[l]) = batch.Cy[l] + y0 + 1.0;
+            ++N_refined;
+        }
+    }
+
+    return N_refined;
+}
+
+
+int PsfCentroider::Refine(const vector<string> &frames, vector<Catalog> &cats, const IdTable &ids,
+                          vector<size_t> &N_refined, const FrameCalibrator *calibrator, WorkerPool *pool) const
+{
+    if ( frames.size() != cats.size() || frames.size() != ids.size() ) return ROTCEN_ERROR_BAD_DATA;
+
+    WorkerPool serial;
+    WorkerPool &wp = pool ? *pool : serial;
+
+    N_refined.assign(frames.size(),0);
+    vector<int> status(frames.size(),ROTCEN_ERROR_OK);
+
+    wp.Run(frames.size(),[&](size_t k) {
+        FitsImage image;
+        vector<float> pix;
+
+        {
+            ProfileScope scope("read-frame",k);
+            status[k] = image.Open(frames[k]);
+            if ( status[k] == ROTCEN_ERROR_OK ) status[k] = image.Read(pix);
+            if ( status[k] != ROTCEN_ERROR_OK ) return;
+            scope.Items(pix.size());
+        }
+
+        if ( calibrator ) {
+            ProfileScope scope("calibrate",k);
+            status[k] = calibrator->Calibrate(frames[k],pix.data(),image.Width(),image.Height());
+            if ( status[k] != ROTCEN_ERROR_OK ) return;
+        }
+
+        ProfileScope scope("psf-fit",k);
+        N_refined[k] = Refine(pix.data(),image.Width(),image.Height(),cats[k],ids[k]);
+        scope.Items(N_refined[k]);
+    });
+
+    for ( auto st: status ) if ( st != ROTCEN_ERROR_OK ) return st;
+
+    return ROTCEN_ERROR_OK;
+}
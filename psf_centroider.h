@@ -0,0 +1,78 @@
+#ifndef PSF_CENTROIDER_H
+#define PSF_CENTROIDER_H
+
+#include <string>
+#include <vector>
+
+#include "catalog.h"
+#include "worker_pool.h"
+#include "frame_calibrator.h"
+
+using namespace std;
+
+//
+// Parameters of the PSF fit
+//
+struct PsfFitParams
+{
+    PsfFitParams();
+
+    enum Profile {Gaussian, Moffat};
+
+    Profile Model;      // default Gaussian
+    size_t StampRadius; // the fitted stamp is (2*StampRadius+1)^2 pixels (default 5)
+    double MoffatBeta;  // fixed power index of Moffat profile (default 2.5)
+    size_t MaxIter;     // maximal number of Levenberg-Marquardt iterations (default 20)
+    double MaxShift;    // maximal shift of the fitted centroid from the initial one (pixels, default 2)
+};
+
+
+//
+// Sub-pixel refinement of the object positions by the fit of a circular PSF
+// model to the stamp around each object:
+//
+//   I(x,y) = B + A*exp(-W*r^2)       (Gaussian)
+//   I(x,y) = B + A*(1 + W*r^2)^-beta (Moffat)
+//
+// where r is the distance from the centroid (X0,Y0). The parameters X0, Y0, A, B
+// and W are found by Levenberg-Marquardt method.
+//
+// The objects are fitted in batches of BATCH_SIZE: the stamps and the parameters
+// are stored lane-by-lane, and the model and the normal equations of adjacent
+// lanes are computed by AVX2 (if the CPU supports it) and SSE2 kernels, with
+// polynomial approximations of exp and log. The scalar fallback uses the same
+// approximations, so the results do not depend on the instruction set. The frames
+// are processed concurrently.
+//
+// The objects whose stamps are not entirely inside the image, whose fits do not
+// converge or whose centroids move further than MaxShift keep their positions.
+//
+class PsfCentroider
+{
+public:
+    static const size_t BATCH_SIZE = 8;
+
+    explicit PsfCentroider(const PsfFitParams &params);
+
+    // refines the positions (FITS pixel coordinates, starting from 1) of the objects with
+    // the given IDs, returns the number of the refined ones
+    size_t Refine(const float *pix, size_t nx, size_t ny, Catalog &cat, const vector<Catalog::IdType> &ids) const;
+
+    // refines cats[k] objects with ids[k] IDs in the k-th frame. The frames are calibrated
+    // as for the detection if 'calibrator' is given. N_refined[k] is the number of the
+    // refined objects. Returns ROTCEN_ERROR_* code of the first failed frame (CFITSIO
+    // errors are displaced by ROTCEN_ERROR_CFITSIO).
+    int Refine(const vector<string> &frames, vector<Catalog> &cats, const IdTable &ids,
+               vector<size_t> &N_refined, const FrameCalibrator *calibrator = nullptr,
+               WorkerPool *pool = nullptr) const;
+
+private:
+    struct Batch;
+
+    void Evaluate(Batch &batch, bool trial) const;
+    void FitBatch(Batch &batch) const;
+
+    PsfFitParams Params;
+};
+
+#endif // PSF_CENTROIDER_H
@@ -1,5 +1,6 @@
 #include<iostream>
 #include<fstream>
+#include<sstream>
 #include <iomanip>
 //#include<libgen.h>
 //#include<cstdlib>
@@ -7,6 +8,12 @@
 #include<list>
 #include<regex>
 #include<ctime>
+#include<cmath>
+#include<mutex>
+#include<atomic>
+#include<memory>
+#include<algorithm>
+#include<csignal>
 
 #define BOOST_NO_CXX11_SCOPED_ENUMS // special definition to fix Boost's copy_file and -std=c++11 linking error
 #include<boost/program_options.hpp>
@@ -14,36 +21,20 @@
 #include<boost/algorithm/string.hpp>
 
 #include<fitsio.h>
-#include<gsl/gsl_linalg.h>
 
-#include"ascii_file.h"
+#include"rotcen.h"
+#include"frame_manifest.h"
+#include"external_process.h"
+#include"product_cache.h"
+#include"directory_watcher.h"
+#include"job_server.h"
+#include"stage_profiler.h"
 
 using namespace std;
 
 namespace po = boost::program_options;
 
-#define ROTCEN_ERROR_OK 0
-#define ROTCEN_ERROR_HELP 1
-#define ROTCEN_ERROR_CMD 10
-#define ROTCEN_ERROR_INPUT_LIST 20
-#define ROTCEN_ERROR_UNKNOWN_OPT 30
-#define ROTCEN_ERROR_INVALID_OPT_VALUE 40
-#define ROTCEN_ERROR_INVALID_FILENAME 50
-#define ROTCEN_ERROR_UNAVAILABLE_CMD 60
-#define ROTCEN_ERROR_NOT_ENOUGH_FILES 70
-#define ROTCEN_ERROR_APP_FAILED 80
-#define ROTCEN_ERROR_CANNOT_CREATE_FILE 90
-#define ROTCEN_ERROR_BAD_DATA 100
-#define ROTCEN_ERROR_EMPTY_CAT 110
-#define ROTCEN_ERROR_BAD_ALLOC 120
-#define ROTCEN_ERROR_BAD_MATCH 130
-#define ROTCEN_ERROR_CANNOT_SOLVE 140
-#define ROTCEN_ERROR_CANNOT_CREATE_RESULT_FILE 150
-
-#define ROTCEN_ERROR_CFITSIO 1000 // displacement for CFITSIO error code
-
 static string ROTCEN_SEX_PARAM_FILE = "sex.param";
-static string ROTCEN_MATCH_REF_CAT = "ref.cat";
 
 static string ROTCEN_SEX_EXE = "sex";
 static string ROTCEN_AST_EXE = "solve-field";
@@ -52,180 +43,912 @@ static string ROTCEN_MATCH_EXE = "match";
 
 
 /*
-    The function tries to execute external application given by 'cmd_str' string.
-    It checks exit code of the application.
+    The function tries to execute external application given by 'argv' vector
+    (the first element is the application name). It checks exit code of the application.
+    The standard error of the application is returned in 'err_str'.
+*/
+static int run_external(const vector<string> &argv, string &err_str)
+{
+    return ExternalProcess::Run(argv,&err_str);
+}
+
+
+/*
+    The function appends arguments to the commandline vector
+*/
+static void add_args(vector<string> &argv, const vector<string> &args)
+{
+    argv.insert(argv.end(),args.begin(),args.end());
+}
+
+
+/*
+    The function searches for value of the parameter 'key' in the commandline vector
+    (SExtractor's style: "-KEY value"). It returns false if the parameter is not found.
+*/
+static bool find_arg_value(const vector<string> &args, const string &key, string &value)
+{
+    for ( size_t i = 0; i+1 < args.size(); ++i ) {
+        if ( args[i] == key ) {
+            value = args[i+1];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+    The function sets parameters of the built-in triangle matcher from 'match' application
+    commandline ("key=value" items). The ID-columns and output-related items are ignored.
+    It returns false for invalid values or unsupported transformation types.
+*/
+static bool parse_match_pars(const vector<string> &args, TriangleMatcherParams &pars)
+{
+    for ( auto &arg: args ) {
+        size_t pos = arg.find('=');
+        string key = arg.substr(0,pos);
+
+        if ( pos == string::npos ) {
+            if ( key == "quadratic" || key == "cubic" ) return false; // only linear transformation is supported
+            continue;
+        }
+
+        try {
+            string val = arg.substr(pos+1);
+            if ( key == "min_scale" ) {
+                pars.MinScale = stod(val);
+            } else if ( key == "max_scale" ) {
+                pars.MaxScale = stod(val);
+            } else if ( key == "trirad" ) {
+                pars.TriangleRadius = stod(val);
+            } else if ( key == "nobj" ) {
+                pars.N_objects = stoul(val);
+            } else if ( key == "matchrad" ) {
+                pars.MatchRadius = stod(val);
+            }
+        } catch (exception &ex) {
+            return false;
+        }
+    }
+
+    return pars.MinScale > 0.0 && pars.MinScale <= pars.MaxScale && pars.N_objects >= 3;
+}
+
+
+/*
+    The functions convert names of the solver options (commandline values) to the parameters.
+    They return false for unknown names.
 */
-static int run_external(string &cmd_str)
+static bool parse_robust_loss(const string &name, RobustSolverParams &pars)
 {
-    int ret = system(cmd_str.c_str()); // try to run external command
+    if ( name == "tukey" ) {
+        pars.Loss = RobustSolverParams::Tukey;
+    } else if ( name == "huber" ) {
+        pars.Loss = RobustSolverParams::Huber;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-    int exit_code = WEXITSTATUS(ret);
 
-    if ( ret == -1 ) {
-        return ret;
+static bool parse_circle_fit(const string &name, CenterSolver::CircleFit &fit)
+{
+    if ( name == "kasa" ) {
+        fit = CenterSolver::Kasa;
+    } else if ( name == "pratt" ) {
+        fit = CenterSolver::Pratt;
+    } else if ( name == "taubin" ) {
+        fit = CenterSolver::Taubin;
+    } else {
+        return false;
     }
-    if ( exit_code != 0 ) {
-        return exit_code;
+    return true;
+}
+
+
+static bool parse_bootstrap_mode(const string &name, BootstrapParams &pars)
+{
+    if ( name == "stars" ) {
+        pars.Mode = BootstrapParams::Stars;
+    } else if ( name == "frames" ) {
+        pars.Mode = BootstrapParams::Frames;
+    } else if ( name == "both" ) {
+        pars.Mode = BootstrapParams::StarsFrames;
+    } else if ( name == "jackknife" ) {
+        pars.Mode = BootstrapParams::Jackknife;
+    } else {
+        return false;
     }
+    return true;
+}
+
+
+/*
+    The function creates the solver by its name ('--solver' option value),
+    it returns NULL for unknown name
+*/
+static Solver* create_solver(const string &name, const RobustSolverParams &robust_pars,
+                             CenterSolver::CircleFit fit, WorkerPool *pool)
+{
+    if ( name == "normal" ) return new NormalSolver(pool);
+    if ( name == "qr" ) return new QRSolver(pool);
+    if ( name == "robust" ) return new RobustSolver(robust_pars,pool);
+    if ( name == "circles" ) return new CircleSolver(fit,pool);
+    if ( name == "rigid" ) return new RigidSolver(pool);
+
+    return nullptr;
+}
+
+
+/*
+    The function prints the whole string at once. It is used to report results
+    of the concurrently executed per-frame steps without interleaving of the lines.
+*/
+static void print_line(const string &str)
+{
+    static mutex print_mutex;
 
-    return 0;
+    lock_guard<mutex> lock(print_mutex);
+    cout << str << flush;
 }
 
 
-static int read_catalog(string &filename, size_t N_items, vector<vector<double> > &data)
+/*
+    Settings of the watch mode
+*/
+struct WatchSettings
+{
+    string Dir;
+    regex Pattern;          // names of the frames
+    size_t N_frames;        // number of frames to be processed (0 means until interrupted)
+    list<string> Initial;   // frames processed before the watched ones
+    string ResultFile;
+};
+
+
+static volatile sig_atomic_t stop_requested = 0; // set by SIGINT or SIGTERM in the watch and daemon modes
+
+static void stop_signal_handler(int)
 {
-    AsciiFile cat(filename.c_str());
+    stop_requested = 1;
+}
+
 
-    if ( !cat.good() ) return ROTCEN_ERROR_INVALID_FILENAME;
+/*
+    Watch mode. The frames are processed one by one as they appear in the watched directory:
+    the first frame with detected objects is the reference one, the next frames are matched
+    against it by the built-in triangle matcher and the center is updated after each of them.
+    A frame which cannot be detected or matched is skipped. The center after each frame is
+    printed and appended to the result file (if given). It runs until SIGINT or SIGTERM or
+    until the given number of frames is processed.
+*/
+static int watch_frames(const WatchSettings &ws, const Detector &detector, Matcher &matcher)
+{
+    DirectoryWatcher watcher(ws.Dir);
+    if ( !watcher.good() ) {
+        cerr << "Cannot watch directory " << ws.Dir << "!\n";
+        return ROTCEN_ERROR_INVALID_FILENAME;
+    }
+
+    ofstream rfile;
+    if ( !ws.ResultFile.empty() ) {
+        rfile.open(ws.ResultFile);
+        if ( !rfile.good() ) {
+            cerr << "Cannot open result file!\n";
+            return ROTCEN_ERROR_CANNOT_CREATE_RESULT_FILE;
+        }
+        rfile << "# \n";
+        rfile << "# Rotation center updated frame by frame (watch of " << ws.Dir << " directory)\n";
+        rfile << "# \n";
+        rfile << "# Columns: number of frames, number of tracks, X, Y, residual, the last frame\n";
+        rfile << "# \n" << flush;
+    }
 
-    data.clear();
+    struct sigaction sa, old_int, old_term;
+    sa.sa_handler = stop_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // no SA_RESTART: poll() is interrupted
+    sigaction(SIGINT,&sa,&old_int);
+    sigaction(SIGTERM,&sa,&old_term);
 
-    data = vector<vector<double> >(N_items);
+    Catalog ref_cat;
+    CenterAccumulator acc;
+    CenterSolution sol;
+    bool solved = false;
+
+    list<string> initial = ws.Initial;
+    size_t N_seen = 0, N_used = 0;
+    int ret_status = ROTCEN_ERROR_OK;
+
+    cout << "\nWatching " << ws.Dir << " for new frames (interrupt to stop):\n";
+
+    while ( !stop_requested && (ws.N_frames == 0 || N_seen < ws.N_frames) ) {
+        string frame;
+
+        if ( !initial.empty() ) {
+            frame = initial.front();
+            initial.pop_front();
+        } else {
+            int ret = watcher.Next(frame,500); // the timeout bounds the reaction on a signal delivered to other thread
+            if ( ret < 0 ) {
+                cerr << "Watch of " << ws.Dir << " directory is broken!\n";
+                ret_status = ROTCEN_ERROR_INVALID_FILENAME;
+                break;
+            }
+            if ( ret == 0 ) continue;
+            if ( !regex_search(boost::filesystem::path(frame).filename().string(),ws.Pattern) ) continue;
+        }
+
+        ++N_seen;
+        cout << "  " << frame << " ... " << flush;
+
+        Catalog cat;
+        if ( detector.Detect(frame,cat) != ROTCEN_ERROR_OK || cat.Empty() ) {
+            cout << "no objects, skipped!\n";
+            continue;
+        }
+
+        if ( ref_cat.Empty() ) {
+            cout << cat.Size() << " objects, reference frame\n";
+            matcher.SetReference(cat);
+            for ( size_t i = 0; i < cat.Size(); ++i ) acc.Add(cat.Id(i),cat.X(i),cat.Y(i));
+            ref_cat = move(cat);
+            ++N_used;
+            continue;
+        }
+
+        vector<Matcher::MatchedPair> pairs;
+        if ( matcher.Match(cat,pairs) != ROTCEN_ERROR_OK ) {
+            cout << "cannot match, skipped!\n";
+            continue;
+        }
+        for ( auto &p: pairs ) acc.Add(ref_cat.Id(p.first),cat.X(p.second),cat.Y(p.second));
+        ++N_used;
 
-    vector<double> vec;
-    AsciiFile::AsciiFileFlag line_flag;
+        cout << "matched " << pairs.size() << " objects";
+        if ( acc.Solve(sol) != ROTCEN_ERROR_OK ) {
+            cout << ", cannot solve yet\n";
+            continue;
+        }
+        solved = true;
 
+        double residual = sqrt(sol.ResidualSS)/(sol.N_eq-1);
+        cout << ", center: [" << sol.X << ", " << sol.Y << "] (residual: " << residual << ")\n" << flush;
 
-    while ( (line_flag = cat.ReadLine(N_items,&vec)) != AsciiFile::Eof ) {
-        if ( line_flag == AsciiFile::InvalidData ) {
-            cat.close();
-            return ROTCEN_ERROR_BAD_DATA;
+        if ( rfile.is_open() ) {
+            rfile << N_used << " " << acc.Tracks() << " " << sol.X << " " << sol.Y << " " << residual << " " << frame << endl;
         }
-        if ( line_flag == AsciiFile::DataString ) {
-            for ( size_t i = 0; i < N_items; ++i ) data[i].push_back(vec[i]);
+    }
+
+    sigaction(SIGINT,&old_int,nullptr);
+    sigaction(SIGTERM,&old_term,nullptr);
+
+    cout << "\nSolution (" << N_used << " of " << N_seen << " frames): " << endl;
+    if ( solved ) {
+        cout << "  rotation center: [" << sol.X << ", " << sol.Y << "]" <<
+                " (residual: " << sqrt(sol.ResidualSS)/(sol.N_eq-1) << ")\n";
+    } else {
+        cout << "  not solved!\n";
+        if ( ret_status == ROTCEN_ERROR_OK ) ret_status = ROTCEN_ERROR_CANNOT_SOLVE;
+    }
+
+    return ret_status;
+}
+
+
+/*
+    Settings of the daemon mode. The detector and the matcher parameters are common for all
+    the jobs, the solver ones are the defaults of the jobs.
+*/
+struct DaemonSettings
+{
+    string SocketPath;
+    const Detector *DetectorPtr;
+    bool NativeMatch;
+    TriangleMatcherParams MatcherPars;  // built-in matcher
+    vector<string> MatchArgs;           // 'match' application
+    double MatchRadius;
+    WorkerPool *Pool;                   // shared by the concurrent jobs
+
+    string SolverName;
+    string RobustLoss;
+    double InlierThresh;
+    string CircleFit;
+    string BootstrapMode;
+    size_t N_replicates;
+};
+
+
+/*
+    The function returns the string as JSON string literal
+*/
+static string json_string(const string &str)
+{
+    string res = "\"";
+    for ( char c: str ) {
+        if ( c == '"' || c == '\\' ) {
+            res += '\\';
+            res += c;
+        } else if ( (unsigned char)c < 0x20 ) {
+            char buff[8];
+            snprintf(buff,sizeof(buff),"\\u%04x",c);
+            res += buff;
+        } else {
+            res += c;
         }
     }
+    return res + "\"";
+}
 
-    cat.close();
-    return ROTCEN_ERROR_OK;
+
+/*
+    The function returns the number in JSON form (NaN and infinity are not allowed there)
+*/
+static string json_number(double val)
+{
+    if ( !isfinite(val) ) return "null";
+
+    ostringstream ss;
+    ss << setprecision(10) << val;
+    return ss.str();
 }
 
 
 /*
-    The routine reads data from FITS binary table. It assumes the binary table format
-    is according to RDLS-files of 'solve-field' application
+    The function returns JSON response of the failed job
 */
-static int read_fits_catalog(string &filename, vector<vector<double> > &data)
+static string job_error(const string &id, int status, const string &msg)
 {
-    int fits_status = 0;
-    fitsfile *file;
-    int ret_code = ROTCEN_ERROR_OK;
-    long opt_nrows,nrows;
-    double *ra = nullptr;
-    double *dec = nullptr;
+    return "{\"id\":" + json_string(id) + ",\"status\":" + to_string(status) + ",\"error\":" + json_string(msg) + "}";
+}
+
+
+/*
+    Daemon mode job. The request is a commandline of the job: the frames (at least 3, the first
+    is the reference one) and the options '--id' (echoed in the response), '--solver',
+    '--robust-loss', '--inlier-thresh', '--circle-fit', '--bootstrap' and '--bootstrap-mode'.
+    The function returns JSON response: "status" (ROTCEN_ERROR_* code) and "error" message or
+    the solution ("center", "residual", number of "frames" and "objects" and, for the
+    corresponding solvers, "inliers", "circles" and "bootstrap").
+*/
+static string run_job(const string &request, const DaemonSettings &ds)
+{
+    string id;
+    vector<string> frames;
+    string solver_name = ds.SolverName;
+    string robust_loss = ds.RobustLoss;
+    string circle_fit_name = ds.CircleFit;
+    string bootstrap_mode = ds.BootstrapMode;
+    RobustSolverParams robust_pars;
+    CenterSolver::CircleFit circle_fit;
+    BootstrapParams bootstrap_pars;
+
+    robust_pars.InlierThresh = ds.InlierThresh;
+    bootstrap_pars.N_replicates = ds.N_replicates;
+
+    po::options_description job_opts("");
+    job_opts.add_options()
+        ("id",po::value<string>(&id))
+        ("solver",po::value<string>(&solver_name))
+        ("robust-loss",po::value<string>(&robust_loss))
+        ("inlier-thresh",po::value<double>(&robust_pars.InlierThresh))
+        ("circle-fit",po::value<string>(&circle_fit_name))
+        ("bootstrap",po::value<size_t>(&bootstrap_pars.N_replicates))
+        ("bootstrap-mode",po::value<string>(&bootstrap_mode))
+        ("frame",po::value<vector<string> >(&frames));
+
+    po::positional_options_description pos_arg;
+    pos_arg.add("frame",-1);
 
     try {
-        fits_open_table(&file,filename.c_str(),READONLY,&fits_status);
-        if ( fits_status ) throw fits_status;
+        po::variables_map vm;
+        po::store(po::command_line_parser(po::split_unix(request)).options(job_opts).positional(pos_arg).run(),vm);
+        po::notify(vm);
+    } catch (po::error &ex) {
+        return job_error(id,ROTCEN_ERROR_CMD,ex.what());
+    }
+
+    if ( !parse_robust_loss(robust_loss,robust_pars) || !parse_circle_fit(circle_fit_name,circle_fit) ||
+         !parse_bootstrap_mode(bootstrap_mode,bootstrap_pars) || !(robust_pars.InlierThresh > 0.0) ) {
+        return job_error(id,ROTCEN_ERROR_INVALID_OPT_VALUE,"invalid solver option value");
+    }
+    unique_ptr<Solver> solver(create_solver(solver_name,robust_pars,circle_fit,ds.Pool));
+    if ( !solver ) return job_error(id,ROTCEN_ERROR_INVALID_OPT_VALUE,"invalid solver name");
+
+    bool use_bootstrap = bootstrap_pars.N_replicates > 0 || bootstrap_pars.Mode == BootstrapParams::Jackknife;
+
+    if ( frames.size() < 3 ) return job_error(id,ROTCEN_ERROR_NOT_ENOUGH_FILES,"at least 3 frames must be given");
+    for ( auto &frame: frames ) {
+        if ( !boost::filesystem::exists(frame) ) return job_error(id,ROTCEN_ERROR_INVALID_FILENAME,"cannot find " + frame);
+    }
+
+    unique_ptr<Matcher> matcher;
+    if ( ds.NativeMatch ) {
+        matcher.reset(new NativeMatcher(ds.MatcherPars));
+    } else {
+        matcher.reset(new ExternalMatcher(ds.MatchArgs,ds.MatchRadius));
+    }
+
+    RotationCenter rotcen(ds.DetectorPtr,*matcher,*solver,ds.Pool);
+
+    vector<Catalog> cats;
+    vector<int> status;
+    int ret = rotcen.Detect(frames,cats,status);
+    for ( size_t i = 0; i < frames.size(); ++i ) {
+        if ( ret != ROTCEN_ERROR_OK && status[i] != ROTCEN_ERROR_OK ) {
+            return job_error(id,status[i],"cannot detect objects in " + frames[i]);
+        }
+        if ( cats[i].Empty() ) return job_error(id,ROTCEN_ERROR_EMPTY_CAT,"no objects in " + frames[i]);
+    }
+
+    IdTable ids;
+    vector<size_t> N_matched;
+    ret = rotcen.Match(cats,ids,N_matched);
+    if ( ret != ROTCEN_ERROR_OK ) {
+        if ( ret == ROTCEN_ERROR_EMPTY_CAT ) return job_error(id,ret,"no matching objects in the frames");
+        return job_error(id,ret,"cannot match objects of " + frames[min(N_matched.size(),frames.size()-1)]);
+    }
+
+    StarTracks tracks;
+    CenterSolution sol;
+    ret = rotcen.Solve(cats,ids,tracks,sol);
+    if ( ret != ROTCEN_ERROR_OK ) return job_error(id,ret,"cannot solve the system");
+
+    BootstrapResult boot;
+    if ( use_bootstrap ) {
+        ret = solver->Bootstrap(tracks,bootstrap_pars,boot);
+        if ( ret != ROTCEN_ERROR_OK ) return job_error(id,ret,"too few bootstrap replicates were solved");
+    }
+
+    ostringstream resp;
+    resp << "{\"id\":" << json_string(id) << ",\"status\":0" <<
+            ",\"center\":[" << json_number(sol.X) << "," << json_number(sol.Y) << "]" <<
+            ",\"residual\":" << json_number(sqrt(sol.ResidualSS)/(sol.N_eq-1)) <<
+            ",\"frames\":" << tracks.Frames() << ",\"objects\":" << tracks.Stars();
+
+    if ( !sol.Inliers.empty() ) {
+        size_t N_inliers = 0;
+        for ( auto n: sol.Inliers ) N_inliers += n;
+        resp << ",\"inliers\":" << N_inliers;
+    }
+
+    if ( !sol.Circles.empty() ) {
+        size_t N_valid = 0;
+        for ( auto &c: sol.Circles ) if ( c.Valid ) ++N_valid;
+        resp << ",\"circles\":" << N_valid;
+    }
 
-        fits_get_num_rows(file, &nrows, &fits_status);
-        if ( fits_status ) throw fits_status;
+    if ( !sol.Rotations.empty() ) {
+        resp << ",\"rotations\":[";
+        for ( size_t k = 0; k < sol.Rotations.size(); ++k ) resp << (k ? "," : "") << json_number(sol.Rotations[k]);
+        resp << "]";
+    }
+
+    if ( use_bootstrap ) {
+        resp << ",\"bootstrap\":{\"replicates\":" << boot.N_replicates << ",\"failed\":" << boot.N_failed <<
+                ",\"sigma\":[" << json_number(sqrt(boot.Cxx)) << "," << json_number(sqrt(boot.Cyy)) << "]" <<
+                ",\"correlation\":" << json_number(boot.Cxy/sqrt(boot.Cxx*boot.Cyy)) <<
+                ",\"ellipse\":[" << json_number(boot.EllipseA) << "," << json_number(boot.EllipseB) << "," <<
+                json_number(boot.EllipseAngle) << "]}";
+    }
+    resp << "}";
 
-        fits_get_rowsize(file,&opt_nrows,&fits_status);
-        if ( fits_status ) throw fits_status;
+    return resp.str();
+}
 
-        if ( opt_nrows > nrows ) opt_nrows = nrows;
 
-        ra = new double[opt_nrows];
-        dec = new double[opt_nrows];
+/*
+    Daemon mode. Jobs are accepted on the Unix socket (one request line, one JSON response
+    line, see run_job) and run concurrently on the shared pool of workers until SIGINT or SIGTERM.
+*/
+static int serve_jobs(const DaemonSettings &ds)
+{
+    atomic<unsigned long> N_jobs(0);
 
-        data = vector<vector<double> >(3);
+    JobServer server(ds.SocketPath,[&](const string &request) {
+        unsigned long job = ++N_jobs;
+        print_line("  Job " + to_string(job) + ": " + request + "\n");
 
-        long n_chunk = nrows/opt_nrows;
-        long N_rest = nrows - n_chunk*opt_nrows;
+        string resp = run_job(request,ds);
 
+        print_line("  Job " + to_string(job) + " is done: " + resp + "\n");
+        return resp;
+    });
 
-        for ( long i = 0; i < n_chunk; ++i ) {
-            fits_read_col(file,TDOUBLE,1,i*opt_nrows+1,1,opt_nrows,NULL,(void*)ra,NULL,&fits_status);
-            if ( fits_status ) throw fits_status;
+    if ( !server.good() ) {
+        cerr << "Cannot listen on socket " << ds.SocketPath << " (invalid path or it is in use)!\n";
+        return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+    }
 
-            fits_read_col(file,TDOUBLE,2,i*opt_nrows+1,1,opt_nrows,NULL,(void*)dec,NULL,&fits_status);
-            if ( fits_status ) throw fits_status;
+    struct sigaction sa, old_int, old_term;
+    sa.sa_handler = stop_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT,&sa,&old_int);
+    sigaction(SIGTERM,&sa,&old_term);
 
-            auto it = data[1].end();
-            data[1].insert(it,ra,ra+opt_nrows);
+    cout << "\nServing jobs on " << ds.SocketPath << " (interrupt to stop):\n" << flush;
 
-            it = data[2].end();
-            data[2].insert(it,dec,dec+opt_nrows);
+    int ret = server.Serve([]() { return stop_requested != 0; });
+    if ( ret != ROTCEN_ERROR_OK ) cerr << "Socket " << ds.SocketPath << " is broken!\n";
+
+    sigaction(SIGINT,&old_int,nullptr);
+    sigaction(SIGTERM,&old_term,nullptr);
+
+    cout << "\n" << N_jobs << " jobs are served\n";
+
+    return ret;
+}
+
+
+/*
+    The function creates the objects detector of the watch, daemon and batch modes: the built-in
+    one (it calibrates the frames if the calibrator is active) or SExtractor (it uses the product
+    cache if it is given)
+*/
+static Detector* create_detector(bool native, const SourceDetectorParams &pars, const FrameCalibrator &calibrator,
+                                 WorkerPool *pool, const vector<string> &sex_args, const string &cat_prefix,
+                                 bool keep_catalogs, const ProductCache *cache)
+{
+    if ( native ) {
+        NativeDetector *detector = new NativeDetector(pars,pool);
+        if ( calibrator.Active() ) detector->SetCalibrator(&calibrator);
+        return detector;
+    }
+
+    SExtractorDetector *detector = new SExtractorDetector(sex_args,cat_prefix,keep_catalogs);
+    detector->SetCache(cache);
+    return detector;
+}
+
+
+/*
+    The function reads names of the frames from the input list file (a comment line starts
+    with '#') and checks the frames exist
+*/
+static int read_frame_list(const string &filename, vector<string> &frames)
+{
+    ifstream list_file(filename);
+    if ( !list_file.good() ) {
+        cerr << "Cannot find file of input frames list!\n";
+        return ROTCEN_ERROR_INVALID_FILENAME;
+    }
+
+    string frame;
+    while ( (list_file >> frame).good() ) {
+        boost::algorithm::trim(frame);
+        if ( frame[0] == '#' ) continue; // comment
+        if ( !boost::filesystem::exists(frame) ) {
+            cerr << "Cannot find " << frame << " input file!\n";
+            return ROTCEN_ERROR_INVALID_FILENAME;
         }
-        if ( N_rest ) {
-            fits_read_col(file,TDOUBLE,1,n_chunk*opt_nrows+1,1,N_rest,NULL,(void*)ra,NULL,&fits_status);
-            if ( fits_status ) throw fits_status;
+        frames.push_back(frame);
+    }
 
-            fits_read_col(file,TDOUBLE,2,n_chunk*opt_nrows+1,1,N_rest,NULL,(void*)dec,NULL,&fits_status);
-            if ( fits_status ) throw fits_status;
+    return ROTCEN_ERROR_OK;
+}
+
+
+/*
+    The function returns name of the product file of the frame:
+    <frame directory>/<prefix><frame basename><suffix>
+*/
+static string frame_product(const string &frame, const string &prefix, const string &suffix)
+{
+    string path = boost::filesystem::path(frame).parent_path().string();
+    if ( path.empty() ) path = ".";
 
-            auto it = data[0].end();
-            data[0].insert(it,ra,ra+N_rest);
+    return path + boost::filesystem::path::preferred_separator + prefix + boost::filesystem::basename(frame) + suffix;
+}
 
-            it = data[1].end();
-            data[1].insert(it,dec,dec+N_rest);
+
+/*
+    Settings of the astrometry of the batch mode
+*/
+struct AstrometrySettings
+{
+    vector<string> Args;        // 'solve-field' commandline without the output files and the frame name
+    bool SaveWcs;               // save WCS-calibrated frames as <WcsPrefix><frame basename>.fits
+    string WcsPrefix;
+    const ProductCache *Cache;  // NULL - the products are not cached
+};
+
+
+/*
+    Batch mode astrometry. 'solve-field' is run for each frame concurrently (with the guess RA
+    and DEC of the frame header if they are given there), then RA and DEC of the index objects
+    are read from the RDLS-files into 'sky_cats' and their pixel coordinates from the XYLS-files
+    into 'pix_cats'. The failures are reported, the function returns the first one.
+*/
+static int solve_frames(const AstrometrySettings &as, const vector<string> &frames, const FrameManifest &manifest,
+                        WorkerPool &pool, vector<Catalog> &sky_cats, vector<Catalog> &pix_cats)
+{
+    // the applications are run concurrently, so at first prepare commands for all frames
+
+    vector<vector<string> > frame_cmds; // commandline for each frame
+    vector<vector<string> > frame_key_args; // commandline without frame-specific filenames (cache key)
+    vector<vector<CacheProduct> > frame_products; // products of the application to be cached
+
+    for ( size_t i_frame = 0; i_frame < frames.size(); ++i_frame ) {
+        const string &frame_name = frames[i_frame];
+
+        string rdls_file = frame_product(frame_name,"",".rdls");
+        string xyls_file = frame_product(frame_name,"","-indx.xyls");
+        string solved_file = frame_product(frame_name,"",".solved");
+        string wcs_file = frame_product(frame_name,as.WcsPrefix,".fits");
+
+        vector<string> cmd_argv = {ROTCEN_AST_EXE};
+        add_args(cmd_argv,as.Args);
+
+        if ( as.SaveWcs ) { // save WCS-calibrated FITS-file
+            add_args(cmd_argv,{"-N", wcs_file});
+        } else {
+            add_args(cmd_argv,{"-N", "none"});
         }
-        // generate IDs column (just from 1 to size(RAcol))
-        for ( double i = 1; i <= data[1].size(); ++i ) data[0].push_back(i);
-    } catch (int err) {
-        ret_code =  err + ROTCEN_ERROR_CFITSIO;
-    } catch (bad_alloc &ex) {
-        ret_code = ROTCEN_ERROR_BAD_ALLOC;
+
+        if ( manifest[i_frame].HasRaDec ) { // guess RA and DEC from FITS header
+            add_args(cmd_argv,{"--ra", to_string(manifest[i_frame].Ra), "--dec", to_string(manifest[i_frame].Dec)});
+        }
+
+        vector<string> key_args = cmd_argv; // without input file
+        vector<CacheProduct> products = {{".rdls", rdls_file}, {"-indx.xyls", xyls_file}, {".solved", solved_file}};
+        if ( as.SaveWcs ) {
+            find(key_args.begin(),key_args.end(),wcs_file)->assign("wcs");
+            products.push_back({".wcs.fits", wcs_file});
+        }
+
+        cmd_argv.push_back(frame_name);
+
+        frame_cmds.push_back(cmd_argv);
+        frame_key_args.push_back(key_args);
+        frame_products.push_back(products);
     }
 
-    delete[] ra;
-    delete[] dec;
+    // run 'solve-field' for each frame on the pool of workers
 
-    fits_close_file(file,&fits_status);
+    vector<int> frame_status(frames.size(),0);
+    vector<string> frame_errors(frames.size()); // captured stderr of the applications
+    atomic<bool> frame_failed(false);
+    atomic<size_t> N_cached(0);
 
-    return ret_code;
+    ProfileScope detection_scope("detection");
+    detection_scope.Items(frames.size());
+
+    pool.Run(frames.size(),[&](size_t i_frame) {
+        if ( frame_failed ) return; // do not start new frames after a failure
+
+        ProfileScope scope("astrometry",i_frame);
+
+        int ret;
+        string key;
+        bool cached = false;
+        if ( as.Cache && as.Cache->Key(frames[i_frame],frame_key_args[i_frame],key) == ROTCEN_ERROR_OK ) {
+            cached = as.Cache->Fetch(key,frame_products[i_frame]);
+        }
+        ret = cached ? 0 : run_external(frame_cmds[i_frame],frame_errors[i_frame]);
+
+        // 'solve-field' must create the solved-file
+        if ( !ret && !boost::filesystem::exists(frame_product(frames[i_frame],"",".solved")) ) ret = -1;
+
+        if ( !ret && !cached && !key.empty() ) { // not fatal, the frame is just processed again next time
+            if ( !as.Cache->Store(key,frame_products[i_frame]) ) print_line("  Cannot store products of " + frames[i_frame] + " in the cache!\n");
+        }
+        if ( cached ) ++N_cached;
+
+        frame_status[i_frame] = ret;
+        if ( ret ) frame_failed = true;
+        print_line("  Run solve-field for " + frames[i_frame] + " ... " + (ret ? "Failed!\n" : (cached ? "OK (cached)!\n" : "OK!\n")));
+    });
+
+    detection_scope.Close();
+
+    int ret_status = ROTCEN_ERROR_OK;
+    for ( size_t i_frame = 0; i_frame < frames.size(); ++i_frame ) { // keep the order of the input list
+        if ( frame_status[i_frame] ) {
+            cerr << "ret=" << frame_status[i_frame] << endl;
+            cerr << "Something wrong while run application 'solve-field' for " << frames[i_frame] << "!\n";
+            if ( !frame_errors[i_frame].empty() ) cerr << frame_errors[i_frame];
+            ret_status = ROTCEN_ERROR_APP_FAILED;
+        }
+    }
+    if ( ret_status != ROTCEN_ERROR_OK ) return ret_status;
+
+    if ( as.Cache ) {
+        cout << "  " << N_cached << " of " << frames.size() << " frames are taken from the cache " << as.Cache->Dir() << "\n";
+    }
+
+    // ID, RA and DEC from RDLS-files, ID, X and Y from XYLS-files (all the tables concurrently)
+
+    sky_cats.clear();
+    sky_cats.resize(frames.size());
+    pix_cats.clear();
+    pix_cats.resize(frames.size());
+    vector<int> xyls_status(frames.size());
+
+    ProfileScope catalogs_scope("catalogs");
+
+    // CFITSIO built without '--enable-reentrant' must not be called concurrently
+    WorkerPool serial;
+    WorkerPool &fits_pool = fits_is_reentrant() ? pool : serial;
+
+    fits_pool.Run(2*frames.size(),[&](size_t i) {
+        size_t i_cat = i/2;
+        ProfileScope scope("read-catalog",i_cat);
+        if ( i % 2 ) {
+            xyls_status[i_cat] = read_fits_catalog(frame_product(frames[i_cat],"","-indx.xyls"),pix_cats[i_cat],"X","Y");
+            scope.Items(pix_cats[i_cat].Size());
+        } else {
+            frame_status[i_cat] = read_fits_catalog(frame_product(frames[i_cat],"",".rdls"),sky_cats[i_cat],"RA","DEC");
+            scope.Items(sky_cats[i_cat].Size());
+        }
+    });
+
+    catalogs_scope.Close();
+
+    for ( size_t i_cat = 0; i_cat < frames.size(); ++i_cat ) {
+        if ( frame_status[i_cat] == ROTCEN_ERROR_OK ) frame_status[i_cat] = xyls_status[i_cat];
+        if ( frame_status[i_cat] != ROTCEN_ERROR_OK ) {
+            cerr << "Something wrong while reading catalogs of " << frames[i_cat] << " file!\n";
+            return frame_status[i_cat];
+        }
+        if ( sky_cats[i_cat].Empty() ) {
+            cerr << "Empty catalog for " << frames[i_cat] << " file!\n";
+            return ROTCEN_ERROR_EMPTY_CAT;
+        }
+    }
+
+    return ROTCEN_ERROR_OK;
 }
 
+
 /*
-    The function rearranges table of object IDs according to new vector of IDs for the first column.
-    The table rows will be permutted according to new order of ID numbers in the new_id vector.
-    NOTE: the algorithm assumes:
-               1) new_id contains of unique numbers
-               2) all numbers from new_id are members of table[0] vector
+    The function prints the solution (the center and the solver-specific details)
 */
-static void rearrange_table(vector<vector<double> > &table, size_t last_col, vector<double> &new_id)
+static void print_solution(const StarTracks &tracks, const CenterSolution &sol)
 {
-    size_t j;
-    double tmp;
+    size_t N_circles = tracks.Stars();
+    size_t N_objs = tracks.Frames();
+
+    cout << "Solution: " << endl;
+    cout << "  rotation center: [" << sol.X << ", " << sol.Y << "]" <<
+            " (residual: " << sqrt(sol.ResidualSS)/(sol.N_eq-1) << ")\n";
+
+    if ( !sol.Inliers.empty() ) {
+        size_t N_inliers = 0, N_bad_stars = 0;
+        for ( auto n: sol.Inliers ) {
+            N_inliers += n;
+            if ( n < N_objs ) ++N_bad_stars;
+        }
+        cout << "  inlier points: " << N_inliers << " of " << N_circles*N_objs <<
+                " (" << N_bad_stars << " objects have outliers)\n";
+    }
 
-    for ( size_t i = 0; i < new_id.size(); ++i ) {
-        j = i;
-        while ( table[0].at(j) != new_id[i]) ++j;
-        for ( size_t k = 0; k <= last_col; ++k ) { // swap elements
-            tmp = table[k].at(i);
-            table[k].at(i) = table[k].at(j);
-            table[k].at(j) = tmp;
+    if ( !sol.Circles.empty() ) {
+        vector<double> rms;
+        for ( auto &c: sol.Circles ) if ( c.Valid ) rms.push_back(c.Rms);
+        cout << "  fitted circles: " << rms.size() << " of " << N_circles;
+        if ( !rms.empty() ) {
+            nth_element(rms.begin(),rms.begin()+rms.size()/2,rms.end());
+            cout << " (median RMS of radial residuals: " << rms[rms.size()/2] << ")";
         }
+        cout << endl;
     }
-    for ( size_t k = 0; k <= last_col; ++k ) { // resize table columns
-        table[k].resize(new_id.size());
+
+    if ( !sol.Rotations.empty() ) {
+        cout << "  frame rotations (degrees):";
+        for ( size_t k = 1; k < sol.Rotations.size(); ++k ) cout << " " << sol.Rotations[k];
+        cout << endl;
     }
 }
 
 
 /*
-    The function convert string sexagesimal presentation of the celestial coordinates
-    to degrees value. The sexagesimal presentation is "[+/-]dd:mm:ss[.sss]" for DEC and
-    "hh::mm:ss[.sss]" for RA with possible space characters before and after the string.
+    The function returns description of the solver for the result file
+*/
+static string solver_description(const string &name, const string &robust_loss, double inlier_thresh,
+                                 const string &circle_fit_name)
+{
+    if ( name == "qr" ) return "QR decomposition of the full system";
+
+    if ( name == "robust" ) {
+        ostringstream ss;
+        ss << "robust (RANSAC and IRLS with " << robust_loss << " weights, inliers threshold " << inlier_thresh << " pixels)";
+        return ss.str();
+    }
+
+    if ( name == "circles" ) return "per-object circle fits (" + circle_fit_name + "), inverse covariance weighted mean of the centers";
+    if ( name == "rigid" ) return "per-frame rigid rotation fits (Procrustes), least-squares fixed point of the rotations";
+
+    return "normal equations";
+}
+
 
-    The function does not check validness of the input string!
+/*
+    The function writes the result file of the batch mode. 'method' and 'solver' are the
+    descriptions of the matching and the solver, 'boot' is NULL if no bootstrap is done.
 */
-static float sex2deg(string str, bool hours = false)
+static int write_result(const string &filename, const string &app_name, const string &input_list,
+                        const string &method, const string &solver, const vector<string> &frames,
+                        const StarTracks &tracks, const CenterSolution &sol,
+                        const BootstrapResult *boot, const string &bootstrap_mode)
 {
-    string s = str;
-    float val = 0.0;
-    float p = 1.0;
-    size_t idx;
+    size_t N_circles = tracks.Stars();
+    size_t N_objs = tracks.Frames();
 
-    for ( int i = 0; i < 3; ++i, p *= 60.0 ) {
-        val += stof(s,&idx)/p;
-        if (idx < s.length() ) s = s.substr(idx+1);
+    ofstream rfile(filename);
+    if ( !rfile.good() ) {
+        cerr << "Cannot open result file!\n";
+        return ROTCEN_ERROR_CANNOT_CREATE_RESULT_FILE;
     }
 
-    if ( hours ) val *= 15.0;
 
-    return val;
+    rfile << "# \n";
+    rfile << "# Computation of rotation center ('" << app_name << "' application, ";
+
+    time_t t = time(nullptr);
+    string tt = asctime(localtime(&t));
+    rfile <<  tt.substr(0,tt.length()-1) << ")\n"; // delete trailng '\n' from asctime-string
+
+    rfile << "# \n";
+    rfile << "# Input file: " << input_list << "\n";
+    rfile << "# Method: " << method << "\n";
+    rfile << "# Solver: " << solver << "\n";
+    rfile << "# \n";
+    rfile << "# Number of points per circle: " << N_objs << endl;
+    rfile << "# Number of circles: " << N_circles << endl;
+    rfile << "# \n";
+    rfile << "# Rotation center in pixel coordinates: \n";
+
+    rfile << std::fixed << std::setprecision(1) << sol.X << " " <<
+             std::fixed << std::setprecision(1) << sol.Y << endl;
+
+    if ( boot ) {
+        rfile << "# \n";
+        rfile << "# Bootstrap (" << bootstrap_mode << " resampling, " << boot->N_replicates << " replicates, " <<
+                 boot->N_failed << " failed): \n";
+        rfile << std::setprecision(4);
+        rfile << "#   mean center: " << boot->X << " " << boot->Y << endl;
+        rfile << "#   covariance (XX XY YY): " << boot->Cxx << " " << boot->Cxy << " " << boot->Cyy << endl;
+        rfile << "#   95% confidence ellipse (semi-axes, position angle in degrees): " <<
+                 boot->EllipseA << " " << boot->EllipseB << " " << std::setprecision(1) << boot->EllipseAngle << endl;
+    }
+
+    if ( !sol.Inliers.empty() ) {
+        rfile << "# \n";
+        rfile << "# Number of inlier points per object (object ID in the first frame, inliers of " << N_objs << "): \n";
+        for ( size_t star = 0; star < N_circles; ++star ) {
+            rfile << "#   " << tracks.Id(star) << " " << sol.Inliers[star] << endl;
+        }
+    }
+
+    if ( !sol.Circles.empty() ) {
+        rfile << "# \n";
+        rfile << "# Circles of the objects (object ID in the first frame, center X and Y, radius, RMS of radial residuals): \n";
+        for ( size_t star = 0; star < N_circles; ++star ) {
+            const TrackCircle &c = sol.Circles[star];
+            rfile << "#   " << tracks.Id(star);
+            if ( c.Valid ) {
+                rfile << std::setprecision(2) << " " << c.X << " " << c.Y << " " << c.R <<
+                         std::setprecision(3) << " " << c.Rms << endl;
+            } else {
+                rfile << " failed\n";
+            }
+        }
+    }
+
+    if ( !sol.Rotations.empty() ) {
+        rfile << "# \n";
+        rfile << "# Rotation of the frames relative to the first one (degrees): \n";
+        for ( size_t k = 0; k < sol.Rotations.size(); ++k ) {
+            rfile << "#   " << frames[k] << " " << std::setprecision(4) << sol.Rotations[k] << endl;
+        }
+    }
+
+    rfile.close();
+
+    return ROTCEN_ERROR_OK;
 }
 
 
@@ -263,6 +986,27 @@ int main(int argc, char* argv[])
     string input_list_filename;
     string result_file;
 
+    long N_jobs = 1; // number of concurrently processed frames
+    string solver_name = "normal";
+    string robust_loss = "tukey";
+    string circle_fit_name = "taubin";
+    string bootstrap_mode = "stars";
+    BootstrapParams bootstrap_pars;
+    CenterSolver::CircleFit circle_fit = CenterSolver::Taubin;
+    RobustSolverParams robust_pars;
+    string cache_dir; // persistent cache of the external applications products
+    string watch_dir;
+    string watch_pattern = "\\.fits?$";
+    size_t watch_N_frames = 0;
+    string daemon_socket;
+    string rot_key;    // FITS-keyword of the rotator angle (rotator-guided matching)
+    string rot_center; // initial estimate of the center "X,Y"
+    RotatorMatcherParams rot_pars;
+    FrameCalibratorParams calib_pars; // in-memory calibration of the frames (built-in detector)
+    string psf_model;  // PSF model of the centroids refinement (empty - no refinement)
+    PsfFitParams psf_pars;
+    string profile_prefix; // output files of the stages timings (empty - no profiling)
+
     int ret_status = ROTCEN_ERROR_OK;
 
     // commandline options and arguments definitions
@@ -274,10 +1018,35 @@ int main(int argc, char* argv[])
         ("radius,r", po::value<vector<float> >(&match_tol), "radius of coordinate matching [arcsecs for astrometrical solution]")
         ("use-match,m","use of 'match' application instead of astrometry (explicitly set '-s' option)")
         ("use-sex,s","use of sextractor to detect objects (in case of astrometrical solution)")
+        ("native-detect","use of built-in objects detector instead of sextractor (in case of '--use-match')")
+        ("native-match","use of built-in triangle matcher instead of 'match' application (in case of '--use-match')")
+        ("bias",po::value<string>(&calib_pars.Bias), "master bias subtracted from the frames before the detection (with '--native-detect' only)")
+        ("dark",po::value<string>(&calib_pars.Dark), "master dark (bias subtracted) subtracted from the frames before the detection, it is scaled by the exposures ratio if the frames have EXPTIME keyword (with '--native-detect' only)")
+        ("flat",po::value<string>(&calib_pars.Flat), "master flat the frames are divided by (normalized by its median) before the detection (with '--native-detect' only)")
+        ("cosmic-thresh",po::value<double>(&calib_pars.CosmicThresh), "replace the cosmic-ray hits and hot pixels above the threshold (in units of noise) by the neighbours median before the detection (with '--native-detect' only, default 0, no rejection)")
+        ("psf-fit",po::value<string>(&psf_model), "refine the centroids of the matched objects by the fit of 'gaussian' or 'moffat' PSF before the solving (not in the watch and daemon modes)")
+        ("psf-radius",po::value<size_t>(&psf_pars.StampRadius), "half-size of the stamp fitted by '--psf-fit' (pixels, default 5)")
+        ("profile",po::value<string>(&profile_prefix), "write wall and CPU times and item counts of the processing stages and the external applications into <prefix>.json (summary by stage, application and frame) and <prefix>.trace.json (Chrome trace, see chrome://tracing) (not in the watch and daemon modes)")
+        ("rot-key",po::value<string>(&rot_key), "match the objects at the positions predicted by the rotator angle from the FITS-keyword (in case of '--use-match', instead of triangle matching)")
+        ("rot-center",po::value<string>(&rot_center), "initial estimate of the rotation center for '--rot-key' as \"X,Y\" (default is the image center)")
+        ("rot-window",po::value<double>(&rot_pars.Window), "search radius around the positions predicted by the initial center for '--rot-key' (pixels, default 20)")
+        ("rot-sign",po::value<int>(&rot_pars.AngleSign), "direction of the image rotation for increasing rotator angle for '--rot-key': 1 (counterclockwise), -1 (clockwise) or 0 (determined from the data, default)")
         ("sex-pars",po::value<vector<string> >(), "sextractor's parameters")
         ("solve-field-pars",po::value<vector<string> >(), "'solve-field' parameters")
         ("match-pars",po::value<vector<string> >(), "'match' parameters")
         ("dont-delete,d","do not delete temporary files")
+        ("watch",po::value<string>(&watch_dir), "watch the directory for new frames and update the center after each of them (with '--use-match --native-match' and 'normal' solver only, the input list is optional)")
+        ("watch-pattern",po::value<string>(&watch_pattern), "regular expression for names of the watched frames (case-insensitive, default '\\.fits?$')")
+        ("watch-frames",po::value<size_t>(&watch_N_frames), "stop the watch after the given number of frames (default 0, until interrupted)")
+        ("daemon",po::value<string>(&daemon_socket), "serve jobs on the Unix socket until interrupted (with '--use-match' only, no input list). A job is a line of frames and solver options ('--id', '--solver', '--robust-loss', '--inlier-thresh', '--circle-fit', '--bootstrap', '--bootstrap-mode'; the given ones are the defaults), the response is a JSON line")
+        ("cache-dir",po::value<string>(&cache_dir), "directory of persistent cache of 'sex' and 'solve-field' products (they are reused for the same frame content and parameters)")
+        ("jobs,j",po::value<long>(&N_jobs), "number of frames processed concurrently (0 means number of CPU cores, default 1)")
+        ("solver",po::value<string>(&solver_name), "rotation center solver: 'normal' (normal equations, default), 'qr' (QR decomposition of the full system), 'robust' (RANSAC and IRLS with outliers rejection), 'circles' (per-object circle fits) or 'rigid' (per-frame rigid rotation fits)")
+        ("circle-fit",po::value<string>(&circle_fit_name), "circle fit of the 'circles' solver: 'kasa', 'pratt' or 'taubin' (default)")
+        ("bootstrap",po::value<size_t>(&bootstrap_pars.N_replicates), "number of bootstrap replicates to estimate the center uncertainty (default 0, no bootstrap)")
+        ("bootstrap-mode",po::value<string>(&bootstrap_mode), "bootstrap resampling: 'stars' (default), 'frames', 'both' or 'jackknife' (leave-one-frame-out)")
+        ("robust-loss",po::value<string>(&robust_loss), "weight function of the robust solver: 'tukey' (default) or 'huber'")
+        ("inlier-thresh",po::value<double>(&robust_pars.InlierThresh), "maximal deviation of an inlier point from its circle for the robust solver (pixels, default 2)")
         ("solve-field-config,c",po::value<vector<string> >(), "filename with full path of 'solve-field' config")
         ("ra",po::value<vector<float> >(), "Guess RA for the field (in degrees)")
         ("dec",po::value<vector<float> >(), "Guess DEC for the field (in degrees)")
@@ -291,7 +1060,7 @@ int main(int argc, char* argv[])
 
     po::options_description hidden_opts("");
     hidden_opts.add_options()
-            ("input-file", po::value<string>()->required())
+            ("input-file", po::value<string>())
             ("result-file", po::value<string>());
 
     po::options_description cmd_opts("");
@@ -310,8 +1079,12 @@ int main(int argc, char* argv[])
             string head_str = "Usage: " + boost::filesystem::basename(argv[0]);
             string skip_str(head_str.length()+1,' ');
 
-            cout << head_str << " [-h] [-t num] [-r num] [-d] [--solve-field-pars]\n" << skip_str <<
-                                "[--use-match] [--match-pars str] \n" << skip_str <<
+            cout << head_str << " [-h] [-t num] [-r num] [-d] [-j num] [--cache-dir dir] [--solve-field-pars]\n" << skip_str <<
+                                "[--watch dir] [--watch-pattern regex] [--watch-frames num] [--daemon socket]\n" << skip_str <<
+                                "[--use-match] [--match-pars str] [--native-detect] [--native-match]\n" << skip_str <<
+                                "[--bias file] [--dark file] [--flat file] [--cosmic-thresh num]\n" << skip_str <<
+                                "[--psf-fit str] [--psf-radius num] [--profile prefix]\n" << skip_str <<
+                                "[--rot-key str] [--rot-center x,y] [--rot-window num] [--rot-sign num]\n" << skip_str <<
                                 "[--use-sex] [--sex-pars str]\n" << skip_str <<
                                 "[--ra num] [--deg num] [--search-radius num]\n" << skip_str <<
                                 "[--ra-key str] [--dec-key str] [--ra-in-hours] [--ra-dec-str]\n" << skip_str <<
@@ -322,6 +1095,8 @@ int main(int argc, char* argv[])
         }
 
         po::notify(vm);
+
+        if ( !vm.count("input-file") && !vm.count("watch") && !vm.count("daemon") ) throw po::required_option("input-file"); // optional in the watch and daemon modes
     } catch (boost::program_options::required_option& e) {
         cerr << "The input list of files is missed! Try '-h' option!\n";
         return ROTCEN_ERROR_INPUT_LIST;
@@ -352,6 +1127,67 @@ int main(int argc, char* argv[])
         match_tol = vm["radius"].as<vector<float> >();
     }
 
+    if ( N_jobs < 0 ) {
+        cerr << "Invalid number of jobs! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( solver_name != "normal" && solver_name != "qr" && solver_name != "robust" && solver_name != "circles" && solver_name != "rigid" ) {
+        cerr << "Invalid solver name! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( !parse_robust_loss(robust_loss,robust_pars) ) {
+        cerr << "Invalid robust loss function name! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( !parse_circle_fit(circle_fit_name,circle_fit) ) {
+        cerr << "Invalid circle fit name! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( !parse_bootstrap_mode(bootstrap_mode,bootstrap_pars) ) {
+        cerr << "Invalid bootstrap mode! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+    bool use_bootstrap = bootstrap_pars.N_replicates > 0 || (vm.count("bootstrap-mode") && bootstrap_pars.Mode == BootstrapParams::Jackknife);
+
+    if ( !(robust_pars.InlierThresh > 0.0) ) {
+        cerr << "Inliers threshold must be positive! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( vm.count("psf-fit") ) {
+        if ( psf_model == "gaussian" ) {
+            psf_pars.Model = PsfFitParams::Gaussian;
+        } else if ( psf_model == "moffat" ) {
+            psf_pars.Model = PsfFitParams::Moffat;
+        } else {
+            cerr << "Invalid PSF model name! Try '-h' option!\n";
+            return ROTCEN_ERROR_INVALID_OPT_VALUE;
+        }
+        if ( psf_pars.StampRadius < 1 ) {
+            cerr << "Invalid PSF fit stamp size! Try '-h' option!\n";
+            return ROTCEN_ERROR_INVALID_OPT_VALUE;
+        }
+        if ( vm.count("watch") || vm.count("daemon") ) {
+            cerr << "The centroids refinement cannot be used in the watch and daemon modes!\n";
+            return ROTCEN_ERROR_CMD;
+        }
+    }
+
+    if ( vm.count("profile") ) {
+        if ( profile_prefix.empty() ) {
+            cerr << "Invalid profile files prefix! Try '-h' option!\n";
+            return ROTCEN_ERROR_INVALID_OPT_VALUE;
+        }
+        if ( vm.count("watch") || vm.count("daemon") ) {
+            cerr << "The profiling cannot be used in the watch and daemon modes!\n";
+            return ROTCEN_ERROR_CMD;
+        }
+    }
+
     if ( vm.count("sex-pars") ) {
         sex_pars.erase(sex_pars.begin(),sex_pars.end());
         sex_pars.push_back(vm["sex-pars"].as<vector<string> >().back());
@@ -380,16 +1216,74 @@ int main(int argc, char* argv[])
         result_file = vm["result-file"].as<string>();
     }
 
+    ProductCache cache(cache_dir);
+    bool use_cache = !cache_dir.empty();
+    if ( use_cache && !cache.good() ) {
+        cerr << "Cannot create or write into the cache directory " << cache_dir << "!\n";
+        return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+    }
+
 
     bool use_match = false;
     bool use_sex = false;
     bool use_guess_radec = false;
     bool save_wcs = false;
+    bool native_detect = false;
+    bool native_match = false;
+    bool rotator_match = false;
+
+    SourceDetectorParams detector_pars;
+    TriangleMatcherParams matcher_pars;
+
+    // commandline arguments of the external applications (without application name)
+
+    vector<string> sex_args = po::split_unix(sex_pars.back());
+    vector<string> solve_field_args = po::split_unix(solve_field_pars.back());
+    vector<string> match_args = po::split_unix(match_pars.back());
+
+    if ( (vm.count("native-detect") || vm.count("native-match")) && !vm.count("use-match") ) {
+        cerr << "The built-in objects detector and matcher can be used only with '--use-match' option!\n";
+        return ROTCEN_ERROR_CMD;
+    }
+
+    if ( (vm.count("bias") || vm.count("dark") || vm.count("flat") || vm.count("cosmic-thresh")) && !vm.count("native-detect") ) {
+        cerr << "The calibration of the frames can be used only with '--native-detect' option!\n";
+        return ROTCEN_ERROR_CMD;
+    }
+    if ( calib_pars.CosmicThresh < 0.0 ) {
+        cerr << "Invalid threshold of the cosmic-ray rejection! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( vm.count("rot-key") ) {
+        if ( !vm.count("use-match") || vm.count("native-match") || vm.count("watch") || vm.count("daemon") ) {
+            cerr << "The rotator-guided matching can be used only with '--use-match' option (without '--native-match', '--watch' and '--daemon')!\n";
+            return ROTCEN_ERROR_CMD;
+        }
+        if ( !(rot_pars.Window > 0.0) || rot_pars.AngleSign < -1 || rot_pars.AngleSign > 1 ) {
+            cerr << "Invalid rotator-guided matching parameters! Try '-h' option!\n";
+            return ROTCEN_ERROR_INVALID_OPT_VALUE;
+        }
+        if ( vm.count("rot-center") ) {
+            size_t pos = rot_center.find(',');
+            try {
+                if ( pos == string::npos ) throw invalid_argument(rot_center);
+                rot_pars.CenterX = stod(rot_center.substr(0,pos));
+                rot_pars.CenterY = stod(rot_center.substr(pos+1));
+            } catch (exception &ex) {
+                cerr << "Invalid initial estimate of the rotation center! Try '-h' option!\n";
+                return ROTCEN_ERROR_INVALID_OPT_VALUE;
+            }
+        }
+        rotator_match = true;
+    }
 
     if ( vm.count("use-match") ) {
-        int ret = system("match --help  >/dev/null 2>&1"); // try to run command 'match'
-        int exit_code = WEXITSTATUS(ret);
-        if ( ret == -1 || exit_code == 127 ) {
+        if ( vm.count("native-match") ) {
+            native_match = true;
+        } else if ( rotator_match ) {
+            // no 'match' application is needed
+        } else if ( !ExternalProcess::Available({ROTCEN_MATCH_EXE,"--help"}) ) { // try to run command 'match'
             cerr << "Application 'match' is not available!\n";
             return ROTCEN_ERROR_UNAVAILABLE_CMD;
         }
@@ -400,41 +1294,57 @@ int main(int argc, char* argv[])
             match_tol = {1.0};
         }
 
+        if ( native_match ) {
+            if ( !parse_match_pars(match_args,matcher_pars) ) {
+                cerr << "Invalid or unsupported 'match' parameters for the built-in matcher!\n";
+                return ROTCEN_ERROR_INVALID_OPT_VALUE;
+            }
+            matcher_pars.MatchRadius = match_tol.back();
+        }
 
-        sex_pars.back() += " -PARAMETERS_NAME " + ROTCEN_SEX_PARAM_FILE + " -CATALOG_TYPE ASCII" +
-                           " -DETECT_THRESH " + to_string(sex_thresh.back()) +
-                           " -ANALYSIS_THRESH " + to_string(sex_thresh.back());
 
+        if ( vm.count("native-detect") ) { // built-in detector. It understands some of SExtractor's parameters
+            native_detect = true;
 
-        // create SExtractor's parameter file
-        ofstream sex_param_file;
-        sex_param_file.open(ROTCEN_SEX_PARAM_FILE);
-        if ( !sex_param_file.good() ) {
-            return ROTCEN_ERROR_CANNOT_CREATE_FILE;
-        }
+            detector_pars.Thresh = sex_thresh.back();
+
+            string val;
+            try {
+                if ( find_arg_value(sex_args,"-DETECT_MINAREA",val) ) detector_pars.MinArea = stoul(val);
+                if ( find_arg_value(sex_args,"-BACK_SIZE",val) ) detector_pars.MeshSize = stoul(val);
+            } catch (exception &ex) {
+                cerr << "Invalid value of SExtractor's parameter '" << val << "'!\n";
+                return ROTCEN_ERROR_INVALID_OPT_VALUE;
+            }
+        } else {
+            add_args(sex_args,{"-PARAMETERS_NAME", ROTCEN_SEX_PARAM_FILE, "-CATALOG_TYPE", "ASCII",
+                               "-DETECT_THRESH", to_string(sex_thresh.back()),
+                               "-ANALYSIS_THRESH", to_string(sex_thresh.back())});
 
 
-        sex_param_file << "NUMBER\n";
-        sex_param_file << "X_IMAGE\n";
-        sex_param_file << "Y_IMAGE\n";
-        sex_param_file << "MAG_BEST\n";
+            // create SExtractor's parameter file
+            ofstream sex_param_file;
+            sex_param_file.open(ROTCEN_SEX_PARAM_FILE);
+            if ( !sex_param_file.good() ) {
+                return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+            }
 
-        sex_param_file.close();
 
+            sex_param_file << "NUMBER\n";
+            sex_param_file << "X_IMAGE\n";
+            sex_param_file << "Y_IMAGE\n";
+            sex_param_file << "MAG_BEST\n";
+
+            sex_param_file.close();
+        }
     } else { // use of 'solve-field' from astrometry.net
-        int ret = system("solve-field --help  >/dev/null 2>&1"); // try to run command 'solve-field'
-        int exit_code = WEXITSTATUS(ret);
-        if ( ret == -1 || exit_code == 127 ) {
+        if ( !ExternalProcess::Available({ROTCEN_AST_EXE,"--help"}) ) { // try to run command 'solve-field'
             cerr << "Application 'solve-field' is not available!\n";
             return ROTCEN_ERROR_UNAVAILABLE_CMD;
         }
 
-        if ( vm.count("solve-field-config") ) {
-            solve_field_config.back() = vm["solve-field-config"].as<vector<float> >().back();
-        }
-
 //        solve_field_pars.back() += " --config " + solve_field_config.back();
-        solve_field_pars.back() += " -b " + solve_field_config.back();
+        add_args(solve_field_args,{"-b", solve_field_config.back()});
 
         if ( vm.count("ra") && vm.count("dec") ) { // it makes sense only if the both are given
             use_guess_radec = true;
@@ -442,7 +1352,7 @@ int main(int argc, char* argv[])
             ra_deg = vm["ra"].as<vector<float> >();
             dec_deg = vm["dec"].as<vector<float> >();
 
-            solve_field_pars.back() += " --ra " + to_string(ra_deg.back()) + " --dec " + to_string(dec_deg.back());
+            add_args(solve_field_args,{"--ra", to_string(ra_deg.back()), "--dec", to_string(dec_deg.back())});
         }
 
         if ( vm.count("search-radius") ) {
@@ -450,7 +1360,7 @@ int main(int argc, char* argv[])
 //            solve_field_pars.back() += " --radius " + to_string(ast_radius.back());
         }
 
-        solve_field_pars.back() += " --radius " + to_string(ast_radius.back());
+        add_args(solve_field_args,{"--radius", to_string(ast_radius.back())});
 
         if ( vm.count("ra-key") ) {
             ra_keyword = vm["ra-key"].as<vector<string> >();
@@ -470,635 +1380,407 @@ int main(int argc, char* argv[])
     }
 
     if ( vm.count("use-sex") ) {
-        int ret = system("sex  >/dev/null 2>&1"); // try to run command 'sex' (Bertin's sextractor)
-        int exit_code = WEXITSTATUS(ret);
-        if ( ret == -1 || exit_code == 127 ) {
+        if ( !ExternalProcess::Available({ROTCEN_SEX_EXE}) ) { // try to run command 'sex' (Bertin's sextractor)
             cerr << "Application 'sex' is not available!\n";
             return ROTCEN_ERROR_UNAVAILABLE_CMD;
         }
 
         use_sex = true;
 
-        solve_field_pars.back() += " --use-sextractor";
-        sex_pars.back() += " -DETECT_THRESH " + to_string(sex_thresh.back()) +
-                           " -ANALYSIS_THRESH " + to_string(sex_thresh.back());
-        solve_field_pars.back() += " --sextractor-path \"" + ROTCEN_SEX_EXE + " " + sex_pars.back() + "\" ";
+        solve_field_args.push_back("--use-sextractor");
+        add_args(sex_args,{"-DETECT_THRESH", to_string(sex_thresh.back()),
+                           "-ANALYSIS_THRESH", to_string(sex_thresh.back())});
+
+        // 'solve-field' gets the whole SExtractor's commandline as a single argument
+        vector<string> sex_path = {ROTCEN_SEX_EXE};
+        add_args(sex_path,sex_args);
+        add_args(solve_field_args,{"--sextractor-path", boost::algorithm::join(sex_path," ")});
 
         if ( !vm.count("radius") ) { // use default value
             match_tol = {0.5};
         }
     } else {
-        solve_field_pars.back() += " --sigma " + to_string(sex_thresh.back());
+        add_args(solve_field_args,{"--sigma", to_string(sex_thresh.back())});
     }
 
-
-    list<string> input_files;
-    list<string> sex_cats, ast_cat;
-    string str;
-
-    ifstream input_list_file;
-
-    try {
-        input_list_file.open(input_list_filename.c_str());
-        if ( !input_list_file.good() ) {
-            cerr << "Cannot find file of input frames list!\n";
-            return ROTCEN_ERROR_INVALID_FILENAME;
+    // master frames are read once for all the frames
+    FrameCalibrator calibrator(calib_pars);
+    if ( calibrator.Active() ) {
+        ret_status = calibrator.Load();
+        if ( ret_status != ROTCEN_ERROR_OK ) {
+            cerr << "Cannot read the master calibration frames (or they have different sizes)!\n";
+            return ret_status;
         }
+    }
 
-        // check input files
 
-        while ( (input_list_file >> str).good() ) {
-            boost::algorithm::trim(str);
-            if ( str[0] == '#' ) continue; // comment
-            if ( !boost::filesystem::exists(str) ) {
-                cerr << "Cannot find " << str.c_str() << " input file!\n";
-                throw (int)ROTCEN_ERROR_INVALID_FILENAME;
-            }
-            input_files.push_back(str);
+    if ( vm.count("watch") ) {
+        if ( !native_match ) {
+            cerr << "The watch mode can be used only with '--use-match --native-match' options!\n";
+            return ROTCEN_ERROR_CMD;
         }
-
-        input_list_file.close();
-
-        if ( input_files.size() < 3 ) {
-            cerr << "At least 3 files must be given in the input list!\n";
-            throw (int)ROTCEN_ERROR_NOT_ENOUGH_FILES;
+        if ( solver_name != "normal" || use_bootstrap ) {
+            cerr << "Only 'normal' solver without bootstrap can be used in the watch mode!\n";
+            return ROTCEN_ERROR_CMD;
         }
 
-        // run object detection and astrometry
-
-        cout << "\nObjects detection:\n";
-
-        for ( auto it_file = input_files.begin(); it_file != input_files.end(); ++it_file ) {
-            boost::filesystem::path pp = *it_file;
-            string path = pp.parent_path().string();
-            if ( path.empty() ) path = ".";
-            string file = boost::filesystem::basename(*it_file);
-
-            if ( use_match ) { // skip astrometry, just detect objects using sextractor
-
-                file = path + boost::filesystem::path::preferred_separator + sex_cat_prefix.back() + file + ".cat";
-
-                string cmd_str = ROTCEN_SEX_EXE + " " + sex_pars.back() + " -CATALOG_NAME " +
-                                 file + " " + *it_file + " >/dev/null 2>&1";
-
-                cout << "  Run SExtractor for " + *it_file + " ... ";
-
-                int ret = run_external(cmd_str); // try to run command 'sex' (Bertin's sextractor)
-                if ( ret ) {
-                    cout << "Failed!\n";
-                    cerr << "Something wrong while run application 'sex'!\n";
-                    throw (int)ROTCEN_ERROR_APP_FAILED;
-                }
+        WatchSettings ws;
+        ws.Dir = watch_dir;
+        ws.N_frames = watch_N_frames;
+        ws.ResultFile = result_file;
 
-                cout << "OK!\n";
+        try {
+            ws.Pattern = regex(watch_pattern,regex::ECMAScript | regex::icase);
+        } catch (regex_error &ex) {
+            cerr << "Invalid regular expression of the watched frames names! Try '-h' option!\n";
+            return ROTCEN_ERROR_INVALID_OPT_VALUE;
+        }
 
-                sex_cats.push_back(file);
-            } else { // perform astrometry
-//                file = path + boost::filesystem::path::preferred_separator + ast_prefix.back() + file + ".fits";
+        if ( !input_list_filename.empty() ) { // already acquired frames
+            vector<string> frames;
+            ret_status = read_frame_list(input_list_filename,frames);
+            if ( ret_status != ROTCEN_ERROR_OK ) return ret_status;
+            ws.Initial.assign(frames.begin(),frames.end());
+        }
 
-//                string cmd_str = ROTCEN_AST_EXE + " " + solve_field_pars.back() +
-//                                 " -R " + file;
+        WorkerPool pool(WorkerPool::JobsNumber(N_jobs)-1);
+        NativeMatcher matcher(matcher_pars);
+        unique_ptr<Detector> detector(create_detector(native_detect,detector_pars,calibrator,&pool,sex_args,
+                                                      sex_cat_prefix.back(),dont_delete,use_cache ? &cache : nullptr));
 
-                string solved_file = path + boost::filesystem::path::preferred_separator + file + ".solved";
-                string rdls_file = path + boost::filesystem::path::preferred_separator + file + ".rdls";
+        ret_status = watch_frames(ws,*detector,matcher);
 
-//                cmd_str += " -S " + solved_file + " -N none";
+        if ( !native_detect && !dont_delete ) boost::filesystem::remove(ROTCEN_SEX_PARAM_FILE);
 
-                string cmd_str = ROTCEN_AST_EXE + " " + solve_field_pars.back();
+        return ret_status;
+    }
 
-                if ( save_wcs ) { // save WCS-calibrated FITS-file
-                    cmd_str += " -N " + path + boost::filesystem::path::preferred_separator + ast_prefix.back() + file + ".fits";
-                } else {
-                    cmd_str += " -N none";
-                }
 
-                if ( !use_guess_radec ) { // no user's guess RA and DEC in commandline
-                    int fits_status = 0;      // try to read RA and DEC from FITS header
-                    fitsfile* file;
+    if ( vm.count("daemon") ) {
+        if ( !use_match ) {
+            cerr << "The daemon mode can be used only with '--use-match' option!\n";
+            return ROTCEN_ERROR_CMD;
+        }
+        if ( vm.count("watch") ) {
+            cerr << "The daemon and watch modes cannot be combined!\n";
+            return ROTCEN_ERROR_CMD;
+        }
 
-                    char key_value[81];
+        WorkerPool pool(WorkerPool::JobsNumber(N_jobs)-1);
+        unique_ptr<Detector> detector(create_detector(native_detect,detector_pars,calibrator,&pool,sex_args,
+                                                      sex_cat_prefix.back(),dont_delete,use_cache ? &cache : nullptr));
+
+        DaemonSettings ds;
+        ds.SocketPath = daemon_socket;
+        ds.DetectorPtr = detector.get();
+        ds.NativeMatch = native_match;
+        ds.MatcherPars = matcher_pars;
+        ds.MatchArgs = match_args;
+        ds.MatchRadius = match_tol.back();
+        ds.Pool = &pool;
+        ds.SolverName = solver_name;
+        ds.RobustLoss = robust_loss;
+        ds.InlierThresh = robust_pars.InlierThresh;
+        ds.CircleFit = circle_fit_name;
+        ds.BootstrapMode = bootstrap_mode;
+        ds.N_replicates = bootstrap_pars.N_replicates;
+
+        ret_status = serve_jobs(ds);
+
+        if ( !native_detect && !dont_delete ) boost::filesystem::remove(ROTCEN_SEX_PARAM_FILE);
+
+        return ret_status;
+    }
 
-                    fits_open_image(&file,(*it_file).c_str(),READONLY,&fits_status);
-                    if ( fits_status ) {
-                        cerr << "Something wrong while opening " << *it_file << " file!\n";
-                        throw ROTCEN_ERROR_CFITSIO + fits_status;
-                    }
 
-                    fits_read_keyword(file,ra_keyword.back().c_str(),key_value,NULL,&fits_status);
-                    if ( fits_status == KEY_NO_EXIST ) goto jmp; // No RA keyword. Just skip
-                    if ( fits_status ) {
-                        cerr << "Something wrong while reading '" << ra_keyword.back() << "' keyword in " << *it_file << " file!\n";
-                        throw ROTCEN_ERROR_CFITSIO + fits_status;
-                    }
-                    if ( vm.count("ra-dec-str") ) { // RA should be in sexagesimal form
-                        if (regex_match(key_value,regex("^ *'.+' *$"))) { // for SCORPIO format of the FITS keyword
-                            string ss = key_value;
-                            boost::algorithm::trim(ss);
-                            size_t len = ss.copy(key_value,ss.length()-2,1);
-                            key_value[len] = '\0';
-                        }
-                        if (!regex_match(key_value,regex("^ *\\+?\\d\\d:\\d\\d:\\d\\d(\\.{1}\\d*)? *$")) ) { // is it in sexagesimal?
-                            cerr << "Invalid RA value in " << ra_keyword.back() << " FITS-keyword of " << *it_file << " file!\n";
-                            fits_close_file(file,&fits_status);
-                            throw (int)ROTCEN_ERROR_BAD_DATA;
-                        }
-                        // convert to degrees
-                        ra_deg.back() = sex2deg(key_value,true);
-                    } else { // RA should be non-negative numeric values
-                        if (!regex_match(key_value,regex("^ *\\+?\\d+(\\.{1}\\d*)?([EeDd][+-]?\\d+)? *$")) ) { // is it a number?
-                            cerr << "Invalid RA value in " << ra_keyword.back() << " FITS-keyword of " << *it_file << " file!\n";
-                            fits_close_file(file,&fits_status);
-                            throw (int)ROTCEN_ERROR_BAD_DATA;
-                        }
-
-                        ra_deg.back() = stof(key_value);
-
-                        if ( vm.count("ra-in-hours") ) {
-                            ra_deg.back() *= 15.0;
-                        }
-                    }
+    vector<string> frame_names;
+    vector<string> ast_frames; // frames with the astrometry products to be deleted
 
-                    fits_read_keyword(file,dec_keyword.back().c_str(),key_value,NULL,&fits_status);
-                    if ( fits_status == KEY_NO_EXIST ) goto jmp; // No DEC keyword. just skip
-                    if ( fits_status ) {
-                        cerr << "Something wrong while reading '" << ra_keyword.back() << "' keyword in " << *it_file << " file!\n";
-                        throw ROTCEN_ERROR_CFITSIO + fits_status;
-                    }
-                    if ( vm.count("ra-dec-str") ) { // DEC should be in sexagesimal form
-                        if (regex_match(key_value,regex("^ *'.+' *$"))) { // for SCORPIO format of the FITS keyword
-                            string ss = key_value;
-                            boost::algorithm::trim(ss);
-                            size_t len = ss.copy(key_value,ss.length()-2,1);
-                            key_value[len] = '\0';
-                        }
-                        if (!regex_match(key_value,regex("^ *[+-]?\\d\\d:\\d\\d:\\d\\d(\\.{1}\\d*)? *$")) ) { // is it in sexagesimal?
-                            cerr << "Invalid DEC value in " << dec_keyword.back() << " FITS-keyword of " << *it_file << " file!\n";
-                            fits_close_file(file,&fits_status);
-                            throw (int)ROTCEN_ERROR_BAD_DATA;
-                        }
-                        // convert to degrees
-                        dec_deg.back() = sex2deg(key_value);
-                    } else { // DEC should be non-negative numeric values
-                        if (!regex_match(key_value,regex("^ *[+-]?\\d+(\\.{1}\\d*)?([EeDd][+-]?\\d+)? *$")) ) { // is it a number?
-                            cerr << "Invalid DEC value in " << dec_keyword.back() << " FITS-keyword of " << *it_file << " file!\n";
-                            fits_close_file(file,&fits_status);
-                            throw (int)ROTCEN_ERROR_BAD_DATA;
-                        }
-                        dec_deg.back() = stof(key_value);
-                    }
+    StageProfiler profiler;
+    if ( !profile_prefix.empty() ) StageProfiler::Install(&profiler);
 
-                    cmd_str += " --ra " + to_string(ra_deg.back()) + " --dec " + to_string(dec_deg.back());
+    try {
+        ret_status = read_frame_list(input_list_filename,frame_names);
+        if ( ret_status != ROTCEN_ERROR_OK ) throw ret_status;
 
-                    fits_close_file(file,&fits_status);
-                }
-                jmp:
+        if ( frame_names.size() < 3 ) {
+            cerr << "At least 3 files must be given in the input list!\n";
+            throw (int)ROTCEN_ERROR_NOT_ENOUGH_FILES;
+        }
 
-                cmd_str +=  " " + *it_file + "  >/dev/null 2>&1";
-//                cmd_str +=  " " + *it_file
+        profiler.SetFrames(frame_names);
 
-                cout << "  Run solve-field for " + *it_file + " ... ";
+        WorkerPool pool(WorkerPool::JobsNumber(N_jobs)-1); // the calling thread is also a worker
 
-//                cout << cmd_str << endl;
+        // read headers of all the frames at once, so invalid ones are reported before
+        // any external application is run
 
-                int ret = run_external(cmd_str); // try to run command 'solve-field'
-                bool ok = boost::filesystem::exists(solved_file);
-                if ( ret || !ok ) {
-                    cerr << "ret=" << ret << endl;
-                    cout << "Failed!\n";
-                    cerr << "Something wrong while run application 'solve-field'!\n";
-                    throw (int)ROTCEN_ERROR_APP_FAILED;
+        FrameHeaderKeys header_keys;
+        if ( use_match || use_guess_radec ) { // the guess position is not taken from the headers
+            header_keys.Ra.clear();
+            header_keys.Dec.clear();
+        } else {
+            header_keys.Ra = ra_keyword.back();
+            header_keys.Dec = dec_keyword.back();
+            header_keys.RaInHours = vm.count("ra-in-hours");
+            header_keys.Sexagesimal = vm.count("ra-dec-str");
+        }
+        if ( rotator_match ) header_keys.RotAngle = rot_key;
+
+        FrameManifest manifest(header_keys);
+        vector<int> header_status;
+
+        ProfileScope headers_scope("headers");
+        int scan_status = manifest.Scan(frame_names,header_status,&pool);
+        headers_scope.Items(frame_names.size());
+        headers_scope.Close();
+
+        if ( scan_status != ROTCEN_ERROR_OK ) {
+            for ( size_t i_frame = 0; i_frame < frame_names.size(); ++i_frame ) {
+                if ( header_status[i_frame] == ROTCEN_ERROR_BAD_DATA ) {
+                    cerr << "Invalid RA or DEC value in " << header_keys.Ra << " or " << header_keys.Dec << " FITS-keyword of " << frame_names[i_frame] << " file!\n";
+                } else if ( header_status[i_frame] != ROTCEN_ERROR_OK ) {
+                    cerr << "Something wrong while reading header of " << frame_names[i_frame] << " file!\n";
                 }
-
-                cout << "OK!\n";
-
-//                ast_cat.push_back(file);
-                ast_cat.push_back(rdls_file);
             }
+            for ( auto st: header_status ) if ( st != ROTCEN_ERROR_OK ) throw st;
         }
 
-        // matching objects
-
-        vector<vector<double> > obj_cat(3*input_files.size()); // NUMBER, X_IMAGE and Y_IMAGE columns
-        vector<vector<double> > obj_id(input_files.size());
-        vector<vector<double> > current_cat;
-
-
-        if ( use_match ) { // use of 'match' application
-            cout << "\nMatching objects (use of 'match' application):\n";
-
-            auto it_file = sex_cats.begin();
-            ++it_file; // point to the second catalog
-
-
-            boost::filesystem::copy_file(sex_cats.front(),ROTCEN_MATCH_REF_CAT,boost::filesystem::copy_option::overwrite_if_exists);
-
-            // read the first catalog
-            int ret = read_catalog(sex_cats.front(), 3, current_cat);
-            if ( ret != ROTCEN_ERROR_OK ) {
-                cerr << "Something wrong while reading " << sex_cats.front() << " file!\n";
-                throw ret;
-            }
-            obj_cat[0] = current_cat[0]; // NUMBER
-            obj_cat[1] = current_cat[1]; // X_IMAGE
-            obj_cat[2] = current_cat[2]; // Y_IMAGE
-
-            string cmd_str;
-
-            string matchedA = "matched.mtA";
-            string matchedB = "matched.mtB";
-
-            for ( long i_cat = 1; it_file != sex_cats.end(); ++it_file, ++i_cat ) {
-
-                // read current catalog
-
-                ret = read_catalog(*it_file, 3, current_cat);
-                if ( ret != ROTCEN_ERROR_OK ) {
-                    cerr << "Something wrong while reading " << *it_file << " file!\n";
-                    throw ret;
-                }
-                if ( current_cat[0].empty() ) {
-                    cerr << "Empty catalog in file " << *it_file << " file!\n";
-                    throw (int)ROTCEN_ERROR_EMPTY_CAT;
-                }
-                obj_cat[i_cat*3] = current_cat[0]; // NUMBER
-                obj_cat[i_cat*3+1] = current_cat[1]; // X_IMAGE
-                obj_cat[i_cat*3+2] = current_cat[2]; // Y_IMAGE
-
-                cmd_str = ROTCEN_MATCH_EXE + " " + ROTCEN_MATCH_REF_CAT + " 1 2 3 " + *it_file + " 1 2 3 " +
-                match_pars.back() + " matchrad=" + to_string(match_tol.back()) + " >/dev/null 2>&1";
-
-                cout << "  Run match for " + *it_file + " ... ";
-
-                int ret = run_external(cmd_str);
-                if ( ret ) {
-                    cout << "Failed!\n";
-                    cerr << "Something wrong while run application 'match'!\n";
-                    throw (int)ROTCEN_ERROR_APP_FAILED;
+        vector<double> frame_angles; // rotator angles for the rotator-guided matching
+        if ( rotator_match ) {
+            for ( size_t i_frame = 0; i_frame < manifest.Size(); ++i_frame ) {
+                if ( !manifest[i_frame].HasRotAngle ) {
+                    cerr << "No valid rotator angle in " << rot_key << " FITS-keyword of " << frame_names[i_frame] << " file!\n";
+                    throw (int)ROTCEN_ERROR_BAD_DATA;
                 }
-
-                cout << "OK!\n";
-
-                // read result matched catalogs (only ID(NUMBER) columns)
-
-                ret = read_catalog(matchedA, 1, current_cat);
-                if ( ret != ROTCEN_ERROR_OK ) {
-                    cerr << "Something wrong while reading matched.mtA file!\n";
-                    throw ret;
-                }
-                if ( current_cat[0].empty() ) {
-                    cerr << "Empty catalog in file " << matchedA << " file!\n";
-                    throw (int)ROTCEN_ERROR_EMPTY_CAT;
-                }
-
-                cout << "    Matched " << current_cat[0].size() << " objects\n";
-
-                if ( i_cat > 1 ) rearrange_table(obj_id,i_cat-1,current_cat[0]); else obj_id[0] = current_cat[0];
-
-                ret = read_catalog(matchedB, 1, current_cat);
-                if ( ret != ROTCEN_ERROR_OK ) {
-                    cerr << "Something wrong while reading matched.mtB file!\n";
-                    throw ret;
-                }
-                if ( current_cat[0].empty() ) {
-                    cerr << "Empty catalog in file " << matchedB << " file!\n";
-                    throw (int)ROTCEN_ERROR_EMPTY_CAT;
-                }
-                obj_id[i_cat] = current_cat[0];
-
-                boost::filesystem::copy_file(matchedA,ROTCEN_MATCH_REF_CAT,boost::filesystem::copy_option::overwrite_if_exists);
+                frame_angles.push_back(manifest[i_frame].RotAngle);
             }
-
-//            cout << endl << endl;
-//            for (size_t k = 0; k < input_files.size(); ++k ) {
-//                cout << obj_cat[3*k+1].at(obj_id[k].at(0)-1) << ", " << obj_cat[3*k+2].at(obj_id[k].at(0)-1) << ", ";
-//            }
-//            cout << endl << endl;
-
-        } else { // use of astrometrical solution
-            cout << "\nMatching objects using astrometrical solution:\n";
-
-            auto it_file = ast_cat.begin();
-            ++it_file; // point to the second catalog
-
-            // read the first catalog
-            int ret = read_fits_catalog(ast_cat.front(),current_cat);
-            if ( ret != ROTCEN_ERROR_OK ) {
-                cerr << "Something is wrong while reading " << ast_cat.front() << " file!\n";
-                throw ret;
+            if ( !vm.count("rot-center") ) { // center of the reference image (1-based pixel coordinates)
+                rot_pars.CenterX = (manifest[0].Width + 1)/2.0;
+                rot_pars.CenterY = (manifest[0].Height + 1)/2.0;
             }
-            obj_cat[0] = current_cat[0]; // ID
-            obj_cat[1] = current_cat[1]; // RA values
-            obj_cat[2] = current_cat[2]; // DEC values
+            rot_pars.MatchRadius = match_tol.back();
+        }
 
-            obj_id[0] = current_cat[0];
+        if ( calibrator.Active() ) calibrator.SetExposures(manifest); // no header reopening while detecting
 
-            double min_dist = match_tol.back()*match_tol.back()/3600.0/3600.0; // in square degrees
-            double dist;
+        unique_ptr<Detector> detector; // astrometry is not a detector of the library, see solve_frames
+        if ( use_match ) {
+            detector.reset(create_detector(native_detect,detector_pars,calibrator,&pool,sex_args,sex_cat_prefix.back(),
+                                           dont_delete,use_cache ? &cache : nullptr));
+        }
 
-//            vector<double> dist(current_cat[0].size());
+        string match_title, method;
+        unique_ptr<Matcher> matcher;
+        if ( rotator_match ) {
+            ostringstream title;
+            title << "predicted by rotator angles from " << rot_key << " FITS-keyword, initial center [" <<
+                     rot_pars.CenterX << ", " << rot_pars.CenterY << "]";
+            match_title = title.str();
+            method = "rotator-guided matching (positions predicted by " + rot_key + " FITS-keyword angles)";
+            matcher.reset(new RotatorMatcher(rot_pars));
+        } else if ( native_match ) {
+            match_title = "built-in triangle matcher";
+            method = "match application (pixel coordinates matching using triangles)";
+            matcher.reset(new NativeMatcher(matcher_pars));
+        } else if ( use_match ) {
+            match_title = "use of 'match' application";
+            method = "match application (pixel coordinates matching using triangles)";
+            matcher.reset(new ExternalMatcher(match_args,match_tol.back()));
+        } else {
+            method = "astrometrical solution (astrometry.net 'solve-field' application)";
+            matcher.reset(new SkyMatcher(match_tol.back()/3600.0)); // in degrees
+        }
 
-            for ( long i_cat = 1; it_file != ast_cat.end(); ++it_file, ++i_cat ) {
-                // read current catalog
-                ret = read_fits_catalog(*it_file,current_cat);
-                if ( ret != ROTCEN_ERROR_OK ) {
-                    cerr << "Something is wrong while reading " << *it_file << " file!\n";
-                    throw ret;
-                }
+        unique_ptr<Solver> solver(create_solver(solver_name,robust_pars,circle_fit,&pool));
 
-                long cat_col = 3*i_cat;
-
-                obj_cat[cat_col] = current_cat[0]; // ID
-                obj_cat[cat_col+1] = current_cat[1]; // RA
-                obj_cat[cat_col+2] = current_cat[2]; // DEC
-
-                // matching
-
-                cout << "  0 <--> " << i_cat << ", ";
-                long N_matched = 0;
-                for ( long idx = 0; idx < obj_id[0].size(); ++idx ) {
-//                    double min_d = min_dist;
-                    long min_ind = 0;
-                    for ( long j = 0; j < obj_cat[cat_col].size(); ++j ) {
-
-                        /*
-                            Actually, here one can use strict equality for RA and DEC because of
-                            solve-field RDLS-files consist of coordinates from index-file. By other
-                            words the RA and DEC in 'obj_cat' catalogs are not computed.
-                        */
-
-
-                        if ( (obj_cat[1].at(obj_id[0].at(idx)-1) == obj_cat[cat_col+1].at(j)) &&
-                             (obj_cat[2].at(obj_id[0].at(idx)-1) == obj_cat[cat_col+2].at(j)) ) {
-
-                            current_cat[0].at(N_matched) = obj_id[0].at(idx);
-                            min_ind = obj_cat[cat_col].at(j);
-                            break;
-                        }
-
-                        /*
-                         * The closest points realization ...
-                         *
-                        // compute distance ("-1" in the index computation since ID starts from 1!)
-                        double rd = obj_cat[1].at(obj_id[0].at(idx)-1) - obj_cat[cat_col+1].at(j);
-                        double dd = obj_cat[2].at(obj_id[0].at(idx)-1) - obj_cat[cat_col+2].at(j);
-
-                        dist = rd*rd + dd*dd;
-
-                        if ( dist < min_d ) { // store ID of matched objects
-                            if ( N_matched == current_cat[0].size() ) {
-                                cerr << "Something wrong while matching objects!\n";
-                                cerr << "It seems there was to big matching radius!\n";
-                                throw ROTCEN_ERROR_BAD_MATCH;
-                            }
-                            current_cat[0].at(N_matched) = obj_id[0].at(idx);
-                            min_ind = obj_cat[cat_col].at(j);
-                            min_d = dist;     // search for the closest objects
-                        }
-
-                        */
-                    }
-                    if ( min_ind ) {
-                        obj_id[i_cat].push_back(min_ind);
-                        ++N_matched;
-                    }
-                }
+        RotationCenter rotcen(detector.get(),*matcher,*solver,&pool);
 
-                if ( !N_matched ) {
-                    cerr << "No matching objects in the input catalogs!\n";
-                    throw (int)ROTCEN_ERROR_EMPTY_CAT;
-                }
+        // run object detection or astrometry
 
-                cout << N_matched << " objects were matched\n";
-                if ( N_matched != current_cat[0].size() ) current_cat[0].resize(N_matched);
+        cout << "\nObjects detection:\n";
 
-                if ( i_cat > 1 ) {
-                    rearrange_table(obj_id,i_cat-1,current_cat[0]);
+        vector<Catalog> obj_cat; // catalogs to be matched
+        vector<Catalog> pix_cat; // pixel coordinates of the objects if they are not in obj_cat (astrometry)
+        int ret;
+
+        if ( use_match ) {
+            const SExtractorDetector *sex_detector = dynamic_cast<const SExtractorDetector*>(detector.get());
+            string msg = native_detect ? "  Detect objects in " : "  Run SExtractor for ";
+            vector<int> frame_status;
+
+            ProfileScope detection_scope("detection");
+            detection_scope.Items(frame_names.size());
+            ret = rotcen.Detect(frame_names,obj_cat,frame_status,[&](size_t i_frame, int status) {
+                bool failed = status != ROTCEN_ERROR_OK && status != ROTCEN_ERROR_EMPTY_CAT;
+                print_line(msg + frame_names[i_frame] + " ... " + (failed ? "Failed!\n" : "OK!\n"));
+            });
+            detection_scope.Close();
+
+            for ( size_t i_frame = 0; i_frame < frame_names.size(); ++i_frame ) { // keep the order of the input list
+                if ( frame_status[i_frame] == ROTCEN_ERROR_EMPTY_CAT ) {
+                    cerr << "Empty catalog for " << frame_names[i_frame] << " file!\n";
+                } else if ( frame_status[i_frame] != ROTCEN_ERROR_OK ) {
+                    if ( native_detect ) {
+                        cerr << "Something wrong while detecting objects in " << frame_names[i_frame] << "!\n";
+                    } else if ( frame_status[i_frame] == ROTCEN_ERROR_APP_FAILED ) {
+                        cerr << "Something wrong while run application 'sex' for " << frame_names[i_frame] << "!\n";
+                        cerr << sex_detector->ErrorOutput(frame_names[i_frame]);
+                    } else {
+                        cerr << "Something wrong while reading catalogs of " << frame_names[i_frame] << " file!\n";
+                    }
                 }
             }
+            if ( ret != ROTCEN_ERROR_OK ) throw ret;
 
-            // read catalogs with pixel coordinates
-            size_t i_cat = 0;
-            for ( it_file = ast_cat.begin(); it_file != ast_cat.end(); ++it_file, ++i_cat ) {
-                boost::filesystem::path pp = *it_file;
-                string path = pp.parent_path().string();
-                if ( path.empty() ) path = ".";
-                string file = boost::filesystem::basename(*it_file);
-
-                file = path + boost::filesystem::path::preferred_separator + file + "-indx.xyls";
-
-                int ret = read_fits_catalog(file,current_cat);
-                if ( ret != ROTCEN_ERROR_OK ) {
-                    cerr << "Something is wrong while reading " << file << " file!\n";
-                    throw ret;
-                }
-
-                obj_cat[i_cat*3] = current_cat[0]; // ID
-                obj_cat[i_cat*3+1] = current_cat[1]; // X values
-                obj_cat[i_cat*3+2] = current_cat[2]; // Y values
+            if ( sex_detector && use_cache ) {
+                cout << "  " << sex_detector->CachedFrames() << " of " << frame_names.size() <<
+                        " frames are taken from the cache " << cache.Dir() << "\n";
             }
+        } else {
+            AstrometrySettings as;
+            as.Args = solve_field_args;
+            as.SaveWcs = save_wcs;
+            as.WcsPrefix = ast_prefix.back();
+            as.Cache = use_cache ? &cache : nullptr;
+
+            ast_frames = frame_names;
+            ret = solve_frames(as,frame_names,manifest,pool,obj_cat,pix_cat);
+            if ( ret != ROTCEN_ERROR_OK ) throw ret;
+        }
 
+        // matching objects
 
-//            cout << endl << endl;
-//            for ( size_t j = 0; j < obj_id[0].size(); ++j ) {
-//                for (size_t k = 0; k < input_files.size(); ++k ) {
-////                    cout << obj_cat[3*k+1].at(obj_id[k].at(0)-1) << ", " << obj_cat[3*k+2].at(obj_id[k].at(0)-1) << ", ";
-//                    cout << obj_id[k].at(j) << " ";
-//                }
-//                cout << endl;
-//            }
-//            cout << endl << endl;
-
-//            for (size_t k = 0; k < input_files.size(); ++k ) {
-//                cout << obj_cat[3*k+1].at(obj_id[k].at(0)-1) << ", " << obj_cat[3*k+2].at(obj_id[k].at(0)-1) << ", ";
-//            }
-//            cout << endl << endl;
+        if ( use_match ) {
+            cout << "\nMatching objects (" << match_title << "):\n";
+        } else {
+            cout << "\nMatching objects using astrometrical solution:\n";
         }
 
-        // compute rotation center
+        IdTable obj_id;
+        vector<size_t> N_matched;
 
+        ProfileScope matching_scope("matching");
+        ret = rotcen.Match(obj_cat,obj_id,N_matched,rotator_match ? &frame_angles : nullptr);
+        matching_scope.Items(obj_id[0].size());
+        matching_scope.Close();
 
-        cout << "\nSolving ... ";
+        for ( size_t i_cat = 1; i_cat < N_matched.size(); ++i_cat ) {
+            cout << "  Match for " << frame_names[i_cat] << " ... OK!\n";
+            cout << "    Matched " << N_matched[i_cat] << " objects\n";
+        }
+        if ( ret != ROTCEN_ERROR_OK ) {
+            if ( N_matched.size() < frame_names.size() ) cout << "  Match for " << frame_names[N_matched.size()] << " ... Failed!\n";
+            if ( ret == ROTCEN_ERROR_EMPTY_CAT ) {
+                cerr << "No matching objects in the input catalogs!\n";
+            } else if ( ret == ROTCEN_ERROR_APP_FAILED ) {
+                cerr << "Something wrong while run application 'match'!\n";
+            } else {
+                cerr << "Cannot match objects in the input catalogs!\n";
+            }
+            throw ret;
+        }
 
-        gsl_matrix* sys_mat = NULL;
-        gsl_vector *b = NULL;
-        gsl_vector *x = NULL;
-        gsl_vector *tau = NULL;
-        gsl_vector *res = NULL;
 
-        size_t N_circles = obj_id[0].size();
-        size_t N_objs = obj_id.size();
+        // compute rotation center
 
-        size_t N_eq = N_circles*(N_objs-1)*N_objs/2; // number of linear equations
 
-        try {
-            gsl_error_handler_t *gsl_eh =  gsl_set_error_handler_off(); // turn off GSL default error handler
+        StarTracks tracks;
+        CenterSolution sol;
 
-            sys_mat = gsl_matrix_alloc(N_eq,2);
-            if ( sys_mat == NULL ) {
-                cerr << "Cannot allocate memory for system matrix!\n";
-                throw (int)ROTCEN_ERROR_BAD_ALLOC;
-            }
+        vector<Catalog> &pos_cat = pix_cat.empty() ? obj_cat : pix_cat; // pixel coordinates
 
-            b = gsl_vector_alloc(N_eq);
-            if ( b == NULL ) {
-                cerr << "Cannot allocate memory for system right-hand part!\n";
-                throw (int)ROTCEN_ERROR_BAD_ALLOC;
-            }
-
-            x = gsl_vector_alloc(2);
-            if ( x == NULL ) {
-                cerr << "Cannot allocate memory for system solution vector!\n";
-                throw (int)ROTCEN_ERROR_BAD_ALLOC;
-            }
+        if ( !psf_model.empty() ) {
+            cout << "\nRefining centroids (" << psf_model << " PSF fit):\n";
 
-            tau = gsl_vector_alloc(2);
-            if ( tau == NULL ) {
-                cerr << "Cannot allocate memory for QR decomposition tau vector!\n";
-                throw (int)ROTCEN_ERROR_BAD_ALLOC;
+            vector<size_t> N_refined;
+            ProfileScope centroids_scope("centroids");
+            ret = PsfCentroider(psf_pars).Refine(frame_names,pos_cat,obj_id,N_refined,
+                                                 calibrator.Active() ? &calibrator : nullptr,&pool);
+            centroids_scope.Items(obj_id[0].size());
+            centroids_scope.Close();
+            if ( ret != ROTCEN_ERROR_OK ) {
+                cerr << "Cannot read or calibrate the frames to refine the centroids!\n";
+                throw ret;
             }
-
-            res = gsl_vector_alloc(N_eq);
-            if ( res == NULL ) {
-                cerr << "Cannot allocate memory for system residual vector!\n";
-                throw (int)ROTCEN_ERROR_BAD_ALLOC;
+            for ( size_t i_cat = 0; i_cat < N_refined.size(); ++i_cat ) {
+                cout << "  " << frame_names[i_cat] << ": " << N_refined[i_cat] << " of " << obj_id[i_cat].size() << " objects\n";
             }
+        }
 
+        cout << "\nSolving ... ";
 
-            // fill system matrix and right-hand part:
-            size_t i = 0;
-            for ( size_t i_circ = 0; i_circ < N_circles; ++i_circ ) {
-                for ( size_t i_obj = 0; i_obj < (N_objs-1); ++i_obj ) {
-                    size_t i_col1 = i_obj*3;
-                    // "-1" in the index computation since ID starts from 1!
-                    double x1 = obj_cat[i_col1 + 1].at(obj_id[i_obj].at(i_circ)-1);
-                    double y1 = obj_cat[i_col1 + 2].at(obj_id[i_obj].at(i_circ)-1);
-
-                    for ( size_t j = i_obj+1; j < N_objs; ++j ) {
-                        size_t i_col2 = j*3;
-
-                        // "-1" in the index computation since ID starts from 1!
-                        double x2 = obj_cat[i_col2 + 1].at(obj_id[j].at(i_circ)-1);
-                        double y2 = obj_cat[i_col2 + 2].at(obj_id[j].at(i_circ)-1);
-
-
-                        gsl_matrix_set(sys_mat,i,0,2.0*(x2-x1));
-                        gsl_matrix_set(sys_mat,i,1,2.0*(y2-y1));
-
-                        gsl_vector_set(b,i,x2*x2+y2*y2-x1*x1-y1*y1);
-                        ++i;
-                    }
+        ProfileScope solving_scope("solving");
+        ret = rotcen.Solve(pos_cat,obj_id,tracks,sol);
+        solving_scope.Items(tracks.Stars());
+        solving_scope.Close();
 
-                }
+        if ( ret ) {
+            cout << "Failed!\n";
+            if ( ret == ROTCEN_ERROR_BAD_ALLOC ) {
+                cerr << "Cannot allocate memory for the linear system!\n";
+            } else {
+                cerr << "Something wrong while system solving!\n";
             }
+            throw ret;
+        }
 
+        cout << "OK!\n\n";
+        print_solution(tracks,sol);
 
-            int ret = gsl_linalg_QR_decomp(sys_mat,tau);
+        BootstrapResult boot;
+        if ( use_bootstrap ) {
+            cout << "\nBootstrap (" << bootstrap_mode << " resampling) ... ";
+            ret = solver->Bootstrap(tracks,bootstrap_pars,boot);
             if ( ret ) {
-                cerr << "Something wrong while QR decomposition!\n";
-                throw ROTCEN_ERROR_CANNOT_SOLVE;
-            }
-
-            ret = gsl_linalg_QR_lssolve(sys_mat,tau,b,x,res);
-            if ( ret ) {
-                cerr << "Something wrong while system solving!\n";
-                throw ROTCEN_ERROR_CANNOT_SOLVE;
-            }
-
-            // compute residual
-            double residual = 0.0;
-            for ( size_t i = 0; i < N_eq; ++i ) {
-                residual += gsl_vector_get(res,i)*gsl_vector_get(res,i);
+                cout << "Failed!\n";
+                cerr << "Too few bootstrap replicates were solved!\n";
+                throw ret;
             }
+            cout << "OK!\n";
+            cout << "  replicates: " << boot.N_replicates << " (failed: " << boot.N_failed << ")\n";
+            cout << "  center uncertainty: sigma X = " << sqrt(boot.Cxx) << ", sigma Y = " << sqrt(boot.Cyy) <<
+                    ", correlation = " << boot.Cxy/sqrt(boot.Cxx*boot.Cyy) << endl;
+            cout << "  95% confidence ellipse: semi-axes " << boot.EllipseA << " and " << boot.EllipseB <<
+                    ", position angle " << boot.EllipseAngle << " degrees\n";
+        }
 
-            cout << "OK!\n\n";
-            cout << "Solution: " << endl;
-            cout << "  rotation center: [" << gsl_vector_get(x,0) << ", " << gsl_vector_get(x,1) << "]" <<
-                    " (residual: " << sqrt(residual)/(N_eq-1) << ")\n";
-
-            // save result file if given
-
-            if ( !result_file.empty() ) {
-                ofstream rfile(result_file);
-                if ( !rfile.good() ) {
-                    cerr << "Cannot open result file!\n";
-                    throw (int)ROTCEN_ERROR_CANNOT_CREATE_RESULT_FILE;
-                }
-
-
-                rfile << "# \n";
-                rfile << "# Computation of rotation center ('" << boost::filesystem::basename(argv[0]) << "' application, ";
-
-                time_t t = time(nullptr);
-                string tt = asctime(localtime(&t));
-                rfile <<  tt.substr(0,tt.length()-1) << ")\n"; // delete trailng '\n' from asctime-string
-
-                rfile << "# \n";
-                rfile << "# Input file: " << input_list_filename << "\n";
-                rfile << "# Method: ";
-                if ( use_match ) {
-                    rfile << "match application (pixel coordinates matching using triangles)\n";
-                } else {
-                    rfile << "astrometrical solution (astrometry.net 'solve-field' application)\n";
-                }
-                rfile << "# \n";
-                rfile << "# Number of points per circle: " << N_objs << endl;
-                rfile << "# Number of circles: " << N_circles << endl;
-                rfile << "# \n";
-                rfile << "# Rotation center in pixel coordinates: \n";
-
-                rfile << std::fixed << std::setprecision(1) << gsl_vector_get(x,0) << " " <<
-                         std::fixed << std::setprecision(1) << gsl_vector_get(x,1) << endl;
+        // save result file if given
 
-                rfile.close();
-            }
+        if ( !result_file.empty() ) {
+            string solver_str = solver_description(solver_name,robust_loss,robust_pars.InlierThresh,circle_fit_name);
 
-        } catch (int err) {
-            gsl_matrix_free(sys_mat);
-            gsl_vector_free(b);
-            gsl_vector_free(x);
-            gsl_vector_free(tau);
-            gsl_vector_free(res);
-            throw err;
+            ret = write_result(result_file,boost::filesystem::basename(argv[0]),input_list_filename,method,solver_str,
+                               frame_names,tracks,sol,use_bootstrap ? &boot : nullptr,bootstrap_mode);
+            if ( ret != ROTCEN_ERROR_OK ) throw ret;
         }
 
-        gsl_matrix_free(sys_mat);
-        gsl_vector_free(b);
-        gsl_vector_free(x);
-        gsl_vector_free(tau);
-        gsl_vector_free(res);
-
 
     } catch (int err) {
-        input_list_file.close();
         ret_status = err;
     }
 
-    // delete temporary files
-    if ( use_match ) {
-        if ( !dont_delete ) {
-            boost::filesystem::remove(ROTCEN_SEX_PARAM_FILE);
-            for (auto filename = sex_cats.begin(); filename != sex_cats.end(); ++filename) {
-                boost::filesystem::remove(*filename);
-            }
-            boost::filesystem::remove("matched.mtA");
-            boost::filesystem::remove("matched.mtB");
-            boost::filesystem::remove("matched.unA");
-            boost::filesystem::remove("matched.unB");
-            boost::filesystem::remove(ROTCEN_MATCH_REF_CAT);
+    if ( !profile_prefix.empty() ) { // also for the failed runs
+        StageProfiler::Install(nullptr);
+        if ( profiler.WriteSummary(profile_prefix + ".json") != ROTCEN_ERROR_OK ||
+             profiler.WriteTrace(profile_prefix + ".trace.json") != ROTCEN_ERROR_OK ) {
+            cerr << "Cannot write the profile files " << profile_prefix << ".json and " << profile_prefix << ".trace.json!\n";
+            if ( ret_status == ROTCEN_ERROR_OK ) ret_status = ROTCEN_ERROR_CANNOT_CREATE_FILE;
+        } else {
+            cout << "\nProfile: " << profile_prefix << ".json, " << profile_prefix << ".trace.json\n";
         }
-    } else {
-        if ( !dont_delete ) {
-            for (auto filename = ast_cat.begin(); filename != ast_cat.end(); ++filename) {
-                boost::filesystem::remove(*filename);
-
-                boost::filesystem::path pp = *filename;
-                string path = pp.parent_path().string();
-                string file = boost::filesystem::basename(*filename);
-
-                boost::filesystem::remove(path + boost::filesystem::path::preferred_separator + file + "-indx.xyls");
-                boost::filesystem::remove(path + boost::filesystem::path::preferred_separator + file + ".rdls");
-                boost::filesystem::remove(path + boost::filesystem::path::preferred_separator + file + ".axy");
-                boost::filesystem::remove(path + boost::filesystem::path::preferred_separator + file + ".solved");
+    }
+
+    // delete temporary files (SExtractor's catalogs are deleted by the detector)
+    if ( !dont_delete ) {
+        if ( use_match ) {
+            boost::filesystem::remove(ROTCEN_SEX_PARAM_FILE);
+        } else {
+            for ( auto &frame: ast_frames ) {
+                boost::filesystem::remove(frame_product(frame,"","-indx.xyls"));
+                boost::filesystem::remove(frame_product(frame,"",".rdls"));
+                boost::filesystem::remove(frame_product(frame,"",".axy"));
+                boost::filesystem::remove(frame_product(frame,"",".solved"));
             }
         }
     }
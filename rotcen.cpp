@@ -0,0 +1,679 @@
+#include "rotcen.h"
+#include "external_process.h"
+#include "stage_profiler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+
+#include <unistd.h>
+
+
+// the working files of concurrent calls (also of different detectors and matchers,
+// e.g. the daemon jobs) never share the name
+static atomic<unsigned long> N_work_files(0);
+
+
+/*
+    The function returns "_<pid>_<sequential number>": the process-wide unique part
+    of a working file name
+*/
+static string unique_suffix()
+{
+    return "_" + to_string(getpid()) + "_" + to_string(N_work_files++);
+}
+
+
+/*
+    The function returns directory part of the path ("." if there is no one)
+    and the file name without directory and the last extension
+*/
+static void split_path(const string &path, string &dir, string &base)
+{
+    size_t pos = path.rfind('/');
+    dir = pos == string::npos ? "." : path.substr(0,pos);
+    if ( dir.empty() ) dir = "/";
+
+    base = pos == string::npos ? path : path.substr(pos+1);
+    pos = base.rfind('.');
+    if ( pos != string::npos && pos > 0 ) base.erase(pos);
+}
+
+
+/*
+    The function copies the catalog with IDs replaced by the row numbers
+    (starting from 1), so the IDs of the external applications output are rows
+*/
+static Catalog row_numbered(const Catalog &cat)
+{
+    Catalog res(cat.Size());
+    for ( size_t i = 0; i < cat.Size(); ++i ) {
+        res.Id(i) = i + 1;
+        res.X(i) = cat.X(i);
+        res.Y(i) = cat.Y(i);
+        res.Mag(i) = cat.Mag(i);
+    }
+    return res;
+}
+
+
+//
+// Solvers
+//
+
+Solver::Solver(WorkerPool *pool): Engine(pool)
+{
+}
+
+
+int Solver::Solve(const StarTracks &tracks, CenterSolution &sol) const
+{
+    return SolveBy(Engine,tracks,sol);
+}
+
+
+int Solver::Bootstrap(const StarTracks &tracks, const BootstrapParams &params, BootstrapResult &res) const
+{
+    ProfileScope scope("bootstrap");
+
+    int ret = Engine.Bootstrap(tracks,[this](const CenterSolver &engine, const StarTracks &t, CenterSolution &sol) {
+        return SolveBy(engine,t,sol);
+    },params,res);
+
+    scope.Items(res.N_replicates);
+    return ret;
+}
+
+
+NormalSolver::NormalSolver(WorkerPool *pool): Solver(pool)
+{
+}
+
+
+int NormalSolver::SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const
+{
+    return engine.SolveNormal(tracks,sol);
+}
+
+
+QRSolver::QRSolver(WorkerPool *pool): Solver(pool)
+{
+}
+
+
+int QRSolver::SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const
+{
+    return engine.SolveQR(tracks,sol);
+}
+
+
+RobustSolver::RobustSolver(const RobustSolverParams &params, WorkerPool *pool): Solver(pool), Params(params)
+{
+}
+
+
+int RobustSolver::SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const
+{
+    return engine.SolveRobust(tracks,Params,sol);
+}
+
+
+RigidSolver::RigidSolver(WorkerPool *pool): Solver(pool)
+{
+}
+
+
+int RigidSolver::SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const
+{
+    return engine.SolveRigid(tracks,sol);
+}
+
+
+CircleSolver::CircleSolver(CenterSolver::CircleFit fit, WorkerPool *pool): Solver(pool), Fit(fit)
+{
+}
+
+
+int CircleSolver::SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const
+{
+    return engine.SolveCircles(tracks,Fit,sol);
+}
+
+
+//
+// Detectors
+//
+
+NativeDetector::NativeDetector(const SourceDetectorParams &params, WorkerPool *pool): Impl(params,pool)
+{
+}
+
+
+int NativeDetector::Detect(const string &frame, Catalog &cat) const
+{
+    return Impl.Detect(frame,cat);
+}
+
+
+void NativeDetector::SetCalibrator(const FrameCalibrator *calibrator)
+{
+    Impl.SetCalibrator(calibrator);
+}
+
+
+SExtractorDetector::SExtractorDetector(const vector<string> &args, const string &catalog_prefix, bool keep_catalogs):
+    Args(args), CatalogPrefix(catalog_prefix), KeepCatalogs(keep_catalogs), Cache(nullptr), N_cached(0),
+    Errors(), ErrorsMutex()
+{
+}
+
+
+void SExtractorDetector::SetCache(const ProductCache *cache)
+{
+    Cache = cache;
+}
+
+
+size_t SExtractorDetector::CachedFrames() const
+{
+    return N_cached;
+}
+
+
+string SExtractorDetector::ErrorOutput(const string &frame) const
+{
+    lock_guard<mutex> lock(ErrorsMutex);
+
+    auto it = Errors.find(frame);
+    return it == Errors.end() ? string() : it->second;
+}
+
+
+string SExtractorDetector::CatalogName(const string &frame) const
+{
+    string dir, base;
+    split_path(frame,dir,base);
+
+    return dir + "/" + CatalogPrefix + base + ".cat";
+}
+
+
+int SExtractorDetector::Detect(const string &frame, Catalog &cat) const
+{
+    // 'sex' writes the catalog under a unique name, the calls detecting the same frame
+    // do not overwrite or remove each other's catalogs
+    string cat_name = CatalogName(frame);
+    string cat_file = cat_name.substr(0,cat_name.size()-4) + unique_suffix() + ".cat";
+
+    vector<string> argv = {"sex"};
+    argv.insert(argv.end(),Args.begin(),Args.end());
+
+    // the key is the commandline without the catalog and frame names (as in the CLI batch mode)
+    string key;
+    vector<CacheProduct> products = {{".cat", cat_file}};
+    bool cached = false;
+    if ( Cache && Cache->Key(frame,argv,key) == ROTCEN_ERROR_OK ) {
+        cached = Cache->Fetch(key,products);
+    }
+
+    argv.insert(argv.end(),{"-CATALOG_NAME", cat_file, frame});
+
+    int ret = ROTCEN_ERROR_APP_FAILED;
+    string err;
+    if ( cached || ExternalProcess::Run(argv,&err) == 0 ) {
+        if ( cached ) ++N_cached;
+        if ( !cached && !key.empty() ) Cache->Store(key,products); // not fatal
+        ret = read_ascii_catalog<NumberColumn,XImageColumn,YImageColumn,MagBestColumn>(cat_file,cat);
+    } else {
+        lock_guard<mutex> lock(ErrorsMutex);
+        Errors[frame] = err;
+    }
+    if ( !KeepCatalogs || rename(cat_file.c_str(),cat_name.c_str()) ) unlink(cat_file.c_str());
+
+    return ret;
+}
+
+
+//
+// Matchers
+//
+
+int Matcher::MatchRotated(const Catalog &cat, double, vector<MatchedPair> &pairs) const
+{
+    return Match(cat,pairs);
+}
+
+
+NativeMatcher::NativeMatcher(const TriangleMatcherParams &params): Impl(params), HasReference(false)
+{
+}
+
+
+int NativeMatcher::SetReference(const Catalog &ref)
+{
+    if ( ref.Empty() ) return ROTCEN_ERROR_EMPTY_CAT;
+
+    Impl.SetReference(ref);
+    HasReference = true;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int NativeMatcher::Match(const Catalog &cat, vector<MatchedPair> &pairs) const
+{
+    if ( !HasReference ) return ROTCEN_ERROR_BAD_MATCH;
+
+    return Impl.Match(cat,pairs);
+}
+
+
+ExternalMatcher::ExternalMatcher(const vector<string> &args, double match_radius, const string &work_dir):
+    Args(), WorkDir(work_dir), RefFile(), RefSize(0)
+{
+    // the first column of the catalogs is ID: the matched objects are identified by it
+    bool has_id1 = false, has_id2 = false;
+    for ( auto &arg: args ) {
+        if ( arg.compare(0,4,"id1=") == 0 ) has_id1 = true;
+        if ( arg.compare(0,4,"id2=") == 0 ) has_id2 = true;
+    }
+    if ( !has_id1 ) Args.push_back("id1=0");
+    if ( !has_id2 ) Args.push_back("id2=0");
+
+    Args.insert(Args.end(),args.begin(),args.end());
+
+    char rad[32];
+    snprintf(rad,sizeof(rad),"matchrad=%g",match_radius);
+    Args.push_back(rad);
+
+    if ( WorkDir.empty() ) WorkDir = ".";
+}
+
+
+ExternalMatcher::~ExternalMatcher()
+{
+    if ( !RefFile.empty() ) unlink(RefFile.c_str());
+}
+
+
+string ExternalMatcher::TempName(const string &suffix) const
+{
+    return WorkDir + "/rotcen_match" + unique_suffix() + suffix;
+}
+
+
+int ExternalMatcher::SetReference(const Catalog &ref)
+{
+    if ( ref.Empty() ) return ROTCEN_ERROR_EMPTY_CAT;
+
+    if ( RefFile.empty() ) RefFile = TempName(".cat");
+    RefSize = ref.Size();
+
+    return write_ascii_catalog(RefFile,row_numbered(ref));
+}
+
+
+int ExternalMatcher::Match(const Catalog &cat, vector<MatchedPair> &pairs) const
+{
+    if ( RefFile.empty() ) return ROTCEN_ERROR_BAD_MATCH;
+
+    string base = TempName("");
+    string cat_file = base + ".cat";
+
+    int ret = write_ascii_catalog(cat_file,row_numbered(cat));
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+    vector<string> argv = {"match", RefFile, "1", "2", "3", cat_file, "1", "2", "3"};
+    argv.insert(argv.end(),Args.begin(),Args.end());
+    argv.push_back("outfile=" + base);
+
+    Catalog matched_ref, matched_cat;
+
+    if ( ExternalProcess::Run(argv) != 0 ) {
+        ret = ROTCEN_ERROR_APP_FAILED;
+    } else {
+        ret = read_ascii_catalog<NumberColumn>(base + ".mtA",matched_ref);
+        if ( ret == ROTCEN_ERROR_OK ) ret = read_ascii_catalog<NumberColumn>(base + ".mtB",matched_cat);
+        if ( ret == ROTCEN_ERROR_OK && matched_ref.Size() != matched_cat.Size() ) ret = ROTCEN_ERROR_BAD_DATA;
+    }
+
+    for ( auto &suffix: {".cat", ".mtA", ".mtB", ".unA", ".unB"} ) unlink((base + suffix).c_str());
+
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+    // the IDs are row numbers (see row_numbered)
+    pairs.clear();
+    for ( size_t i = 0; i < matched_ref.Size(); ++i ) {
+        Catalog::IdType id_ref = matched_ref.Id(i);
+        Catalog::IdType id_cat = matched_cat.Id(i);
+        if ( id_ref < 1 || (size_t)id_ref > RefSize || id_cat < 1 || (size_t)id_cat > cat.Size() ) continue;
+        pairs.push_back(make_pair(Catalog::Row(id_ref),Catalog::Row(id_cat)));
+    }
+    sort(pairs.begin(),pairs.end());
+
+    return pairs.empty() ? ROTCEN_ERROR_BAD_MATCH : ROTCEN_ERROR_OK;
+}
+
+
+SkyMatcher::SkyMatcher(double radius):
+    Radius(radius), Ra0(0.0), Dec0(0.0), CosDec0(1.0), RefX(), RefY(), RefTree()
+{
+}
+
+
+void SkyMatcher::Project(const Catalog &cat, vector<double> &x, vector<double> &y) const
+{
+    const double *ra = cat.X();
+    const double *dec = cat.Y();
+    x.resize(cat.Size());
+    y.resize(cat.Size());
+    for ( size_t i = 0; i < cat.Size(); ++i ) {
+        double dra = ra[i] - Ra0;
+        if ( dra > 180.0 ) dra -= 360.0; else if ( dra < -180.0 ) dra += 360.0; // RA wrapping
+        x[i] = dra*CosDec0;
+        y[i] = dec[i] - Dec0;
+    }
+}
+
+
+int SkyMatcher::SetReference(const Catalog &ref)
+{
+    if ( ref.Empty() ) return ROTCEN_ERROR_EMPTY_CAT;
+
+    Ra0 = ref.X(0);
+    Dec0 = 0.0;
+    for ( size_t i = 0; i < ref.Size(); ++i ) Dec0 += ref.Y(i);
+    Dec0 /= ref.Size();
+    CosDec0 = cos(Dec0*M_PI/180.0);
+
+    Project(ref,RefX,RefY);
+    RefTree.Build(RefX.data(),RefY.data(),RefX.size());
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int SkyMatcher::Match(const Catalog &cat, vector<MatchedPair> &pairs) const
+{
+    if ( RefX.empty() ) return ROTCEN_ERROR_BAD_MATCH;
+
+    vector<double> cat_x, cat_y;
+    Project(cat,cat_x,cat_y);
+    KdTree cat_tree(cat_x.data(),cat_y.data(),cat_x.size());
+
+    // an object pair is accepted only if the objects are mutually the closest ones
+    pairs.clear();
+    for ( size_t i_ref = 0; i_ref < RefX.size(); ++i_ref ) {
+        long j = cat_tree.Nearest(RefX[i_ref],RefY[i_ref],Radius);
+        if ( j < 0 ) continue;
+        if ( RefTree.Nearest(cat_x[j],cat_y[j],Radius) != (long)i_ref ) continue;
+        pairs.push_back(make_pair(i_ref,(size_t)j));
+    }
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+RotatorMatcherParams::RotatorMatcherParams():
+    CenterX(0.0), CenterY(0.0), Window(20.0), MatchRadius(2.0), AngleSign(0)
+{
+}
+
+
+RotatorMatcher::RotatorMatcher(const RotatorMatcherParams &params):
+    Params(params), RefX(), RefY(), RefTree()
+{
+}
+
+
+int RotatorMatcher::SetReference(const Catalog &ref)
+{
+    if ( ref.Empty() ) return ROTCEN_ERROR_EMPTY_CAT;
+
+    RefX.assign(ref.X(),ref.X()+ref.Size());
+    RefY.assign(ref.Y(),ref.Y()+ref.Size());
+    RefTree.Build(RefX.data(),RefY.data(),RefX.size());
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int RotatorMatcher::Match(const Catalog &, vector<MatchedPair> &pairs) const
+{
+    pairs.clear();
+    return ROTCEN_ERROR_BAD_MATCH; // nothing to predict without the rotation
+}
+
+
+void RotatorMatcher::PredictedPairs(const Catalog &cat, const KdTree &cat_tree, double cx, double cy, double angle,
+                                    double radius, vector<MatchedPair> &pairs) const
+{
+    double cos_a = cos(angle);
+    double sin_a = sin(angle);
+
+    pairs.clear();
+    for ( size_t i_ref = 0; i_ref < RefX.size(); ++i_ref ) {
+        double dx = RefX[i_ref] - cx;
+        double dy = RefY[i_ref] - cy;
+        long j = cat_tree.Nearest(cx + cos_a*dx - sin_a*dy,cy + sin_a*dx + cos_a*dy,radius);
+        if ( j < 0 ) continue;
+
+        // the object rotated back must be the closest to the reference one
+        dx = cat.X(j) - cx;
+        dy = cat.Y(j) - cy;
+        if ( RefTree.Nearest(cx + cos_a*dx + sin_a*dy,cy - sin_a*dx + cos_a*dy,radius) != (long)i_ref ) continue;
+
+        pairs.push_back(make_pair(i_ref,(size_t)j));
+    }
+}
+
+
+void RotatorMatcher::RefineCenter(const Catalog &cat, const vector<MatchedPair> &pairs, double angle, double &cx, double &cy) const
+{
+    // q = c + R(p - c) for matched p and q, so (I - R)c = q - Rp. The median of the right-hand
+    // sides rejects wrongly matched objects. (I - R) is the scaled rotation matrix [[a,s],[-s,a]],
+    // a = 1-cos, s = sin, which is invertible for any non-zero angle
+    double cos_a = cos(angle);
+    double a = 1.0 - cos_a;
+    double s = sin(angle);
+    double det = a*a + s*s;
+
+    if ( pairs.size() < 3 || det < 1.0E-12 ) return; // keep the estimate
+
+    vector<double> dx(pairs.size()), dy(pairs.size());
+    for ( size_t i = 0; i < pairs.size(); ++i ) {
+        double px = RefX[pairs[i].first];
+        double py = RefY[pairs[i].first];
+        dx[i] = cat.X(pairs[i].second) - (cos_a*px - s*py);
+        dy[i] = cat.Y(pairs[i].second) - (s*px + cos_a*py);
+    }
+    size_t m = pairs.size()/2;
+    nth_element(dx.begin(),dx.begin()+m,dx.end());
+    nth_element(dy.begin(),dy.begin()+m,dy.end());
+
+    cx = (a*dx[m] - s*dy[m])/det;
+    cy = (s*dx[m] + a*dy[m])/det;
+}
+
+
+int RotatorMatcher::MatchRotated(const Catalog &cat, double rotation, vector<MatchedPair> &pairs) const
+{
+    pairs.clear();
+    if ( RefX.empty() ) return ROTCEN_ERROR_BAD_MATCH;
+    if ( cat.Empty() ) return ROTCEN_ERROR_EMPTY_CAT;
+
+    KdTree cat_tree(cat.X(),cat.Y(),cat.Size());
+
+    // the initial center (and unknown direction of the rotation)
+    double angle = rotation*M_PI/180.0;
+    if ( Params.AngleSign ) {
+        angle *= Params.AngleSign;
+        PredictedPairs(cat,cat_tree,Params.CenterX,Params.CenterY,angle,Params.Window,pairs);
+    } else {
+        vector<MatchedPair> neg_pairs;
+        PredictedPairs(cat,cat_tree,Params.CenterX,Params.CenterY,angle,Params.Window,pairs);
+        PredictedPairs(cat,cat_tree,Params.CenterX,Params.CenterY,-angle,Params.Window,neg_pairs);
+        if ( neg_pairs.size() > pairs.size() ) {
+            angle = -angle;
+            pairs.swap(neg_pairs);
+        }
+    }
+
+    // the center is refined twice: by the pairs found within the window, then by the
+    // (more accurate) ones found around the positions predicted by the first estimate
+    double cx = Params.CenterX;
+    double cy = Params.CenterY;
+    for ( int iter = 0; iter < 2; ++iter ) {
+        RefineCenter(cat,pairs,angle,cx,cy);
+        PredictedPairs(cat,cat_tree,cx,cy,angle,Params.MatchRadius,pairs);
+    }
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+//
+// Batch computation
+//
+
+RotationCenter::RotationCenter(const Detector *detector, Matcher &matcher, const Solver &solver, WorkerPool *pool):
+    DetectorPtr(detector), MatcherRef(matcher), SolverRef(solver), Pool(pool)
+{
+}
+
+
+int RotationCenter::Detect(const vector<string> &frames, vector<Catalog> &cats, vector<int> &status,
+                           const FrameReport &report) const
+{
+    cats.resize(frames.size());
+    status.assign(frames.size(),ROTCEN_ERROR_OK);
+
+    if ( DetectorPtr == nullptr ) return ROTCEN_ERROR_CMD;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    pool.Run(frames.size(),[&](size_t i) {
+        ProfileScope scope("detect",i);
+        status[i] = DetectorPtr->Detect(frames[i],cats[i]);
+        scope.Items(cats[i].Size());
+        if ( status[i] == ROTCEN_ERROR_OK && cats[i].Empty() ) status[i] = ROTCEN_ERROR_EMPTY_CAT;
+        scope.Close();
+        if ( report ) report(i,status[i]);
+    });
+
+    for ( auto st: status ) if ( st != ROTCEN_ERROR_OK ) return st;
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int RotationCenter::Match(const vector<Catalog> &cats, IdTable &ids, vector<size_t> &N_matched, const vector<double> *angles)
+{
+    N_matched.clear();
+    ids.assign(cats.size(),vector<Catalog::IdType>());
+
+    if ( cats.empty() ) return ROTCEN_ERROR_NOT_ENOUGH_FILES;
+    if ( angles && angles->size() != cats.size() ) return ROTCEN_ERROR_BAD_DATA;
+
+    int ret;
+    {
+        ProfileScope scope("set-reference",0);
+        ret = MatcherRef.SetReference(cats[0]);
+        scope.Items(cats[0].Size());
+    }
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+    N_matched.push_back(cats[0].Size());
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    vector<vector<Matcher::MatchedPair> > pairs(cats.size());
+    vector<int> status(cats.size(),ROTCEN_ERROR_OK);
+
+    pool.Run(cats.size()-1,[&](size_t i) {
+        ProfileScope scope("match",i+1);
+        if ( angles ) {
+            status[i+1] = MatcherRef.MatchRotated(cats[i+1],(*angles)[i+1] - (*angles)[0],pairs[i+1]);
+        } else {
+            status[i+1] = MatcherRef.Match(cats[i+1],pairs[i+1]);
+        }
+        scope.Items(pairs[i+1].size());
+    });
+
+    // partner of each reference object in each catalog (the objects matched in all
+    // the previous catalogs only)
+    size_t N_ref = cats[0].Size();
+    vector<vector<long> > partner(cats.size(),vector<long>(N_ref,-1));
+    for ( size_t i = 0; i < N_ref; ++i ) partner[0][i] = i;
+
+    for ( size_t k = 1; k < cats.size(); ++k ) {
+        if ( status[k] != ROTCEN_ERROR_OK ) return status[k];
+
+        size_t N_common = 0;
+        for ( auto &p: pairs[k] ) {
+            if ( partner[k-1][p.first] < 0 ) continue;
+            partner[k][p.first] = p.second;
+            ++N_common;
+        }
+        if ( N_common == 0 ) return ROTCEN_ERROR_EMPTY_CAT;
+
+        N_matched.push_back(N_common);
+    }
+
+    for ( size_t i = 0; i < N_ref; ++i ) {
+        if ( partner.back()[i] < 0 ) continue;
+        for ( size_t k = 0; k < cats.size(); ++k ) ids[k].push_back(cats[k].Id(partner[k][i]));
+    }
+
+    return ROTCEN_ERROR_OK;
+}
+
+
+int RotationCenter::Solve(const vector<Catalog> &cats, const IdTable &ids, StarTracks &tracks, CenterSolution &sol) const
+{
+    if ( cats.size() != ids.size() ) return ROTCEN_ERROR_BAD_DATA;
+
+    for ( size_t k = 0; k < cats.size(); ++k ) { // the catalogs may differ from the matched ones
+        for ( auto id: ids[k] ) {
+            if ( id < 1 || (size_t)id > cats[k].Size() ) return ROTCEN_ERROR_BAD_DATA;
+        }
+    }
+
+    {
+        ProfileScope scope("tracks");
+        tracks = StarTracks(cats,ids);
+        scope.Items(tracks.Stars());
+    }
+
+    ProfileScope scope("solve");
+    scope.Items(tracks.Stars());
+
+    return SolverRef.Solve(tracks,sol);
+}
+
+
+int RotationCenter::Compute(const vector<Catalog> &cats, CenterSolution &sol)
+{
+    IdTable ids;
+    vector<size_t> N_matched;
+    StarTracks tracks;
+
+    int ret = Match(cats,ids,N_matched);
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+    return Solve(cats,ids,tracks,sol);
+}
+
+
+int RotationCenter::Compute(const vector<string> &frames, CenterSolution &sol)
+{
+    vector<Catalog> cats;
+    vector<int> status;
+
+    int ret = Detect(frames,cats,status);
+    if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+    return Compute(cats,sol);
+}
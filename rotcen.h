@@ -0,0 +1,341 @@
+#ifndef ROTCEN_H
+#define ROTCEN_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include "rotcen_errors.h"
+#include "catalog.h"
+#include "catalog_io.h"
+#include "worker_pool.h"
+#include "source_detector.h"
+#include "psf_centroider.h"
+#include "triangle_matcher.h"
+#include "spatial_index.h"
+#include "center_solver.h"
+#include "product_cache.h"
+
+using namespace std;
+
+//
+// librotcen: the rotation center of a field from a series of its frames.
+//
+// The computation consists of three steps given by the interfaces below:
+//
+//   Detector - catalog of the objects of a frame (FITS-file);
+//   Matcher  - pairs of the same objects in the reference catalog and another one;
+//   Solver   - rotation center of the tracks of the objects matched in all the frames.
+//
+// RotationCenter combines them for a batch of frames or in-memory catalogs. All the
+// functions return ROTCEN_ERROR_* codes, nothing is printed. The implementations are
+// safe to be called concurrently (e.g. for different frames).
+//
+
+class Detector
+{
+public:
+    virtual ~Detector() {}
+
+    // IDs of the objects are their row numbers starting from 1
+    virtual int Detect(const string &frame, Catalog &cat) const = 0;
+};
+
+
+class Matcher
+{
+public:
+    typedef TriangleMatcher::MatchedPair MatchedPair; // (index in reference catalog, index in catalog)
+
+    virtual ~Matcher() {}
+
+    virtual int SetReference(const Catalog &ref) = 0;
+
+    // the pairs are sorted by reference index, each reference object appears at most once
+    virtual int Match(const Catalog &cat, vector<MatchedPair> &pairs) const = 0;
+
+    // the same with the known rotation of the catalog relative to the reference one (degrees,
+    // e.g. difference of the commanded rotator angles). The matchers which cannot use it
+    // ignore the rotation.
+    virtual int MatchRotated(const Catalog &cat, double rotation, vector<MatchedPair> &pairs) const;
+};
+
+
+class Solver
+{
+public:
+    explicit Solver(WorkerPool *pool = nullptr);
+    virtual ~Solver() {}
+
+    int Solve(const StarTracks &tracks, CenterSolution &sol) const;
+
+    // the replicates are solved concurrently (on the pool of the solver)
+    int Bootstrap(const StarTracks &tracks, const BootstrapParams &params, BootstrapResult &res) const;
+
+protected:
+    // solution by the given engine (bootstrap replicates are solved by serial engines)
+    virtual int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const = 0;
+
+private:
+    CenterSolver Engine;
+};
+
+
+//
+// Detectors
+//
+
+// built-in detector (SourceDetector)
+class NativeDetector: public Detector
+{
+public:
+    NativeDetector(const SourceDetectorParams &params, WorkerPool *pool = nullptr);
+
+    int Detect(const string &frame, Catalog &cat) const override;
+
+    // the calibrator must outlive the detector (NULL disables the calibration)
+    void SetCalibrator(const FrameCalibrator *calibrator);
+
+private:
+    SourceDetector Impl;
+};
+
+
+// Bertin's SExtractor ('sex' application). The parameters file must give NUMBER, X_IMAGE,
+// Y_IMAGE and MAG_BEST columns in ASCII catalog. The catalog is written next to the frame
+// under a unique name of the call and is removed after reading; if KeepCatalogs, it is
+// renamed to CatalogName(frame), i.e. <CatalogPrefix><frame basename>.cat, instead.
+// If the product cache is set, the catalog of a frame already processed with the same
+// parameters is taken from the cache instead of running 'sex'.
+class SExtractorDetector: public Detector
+{
+public:
+    // 'args' - commandline parameters (without -CATALOG_NAME and the frame name)
+    SExtractorDetector(const vector<string> &args, const string &catalog_prefix = "obj_", bool keep_catalogs = false);
+
+    int Detect(const string &frame, Catalog &cat) const override;
+
+    string CatalogName(const string &frame) const;
+
+    // the cache must outlive the detector (NULL disables the cache)
+    void SetCache(const ProductCache *cache);
+
+    // number of the frames taken from the cache
+    size_t CachedFrames() const;
+
+    // captured standard error of the last failed run of 'sex' for the frame (empty if none)
+    string ErrorOutput(const string &frame) const;
+
+private:
+    vector<string> Args;
+    string CatalogPrefix;
+    bool KeepCatalogs;
+    const ProductCache *Cache;
+    mutable atomic<size_t> N_cached;
+    mutable map<string,string> Errors;
+    mutable mutex ErrorsMutex;
+};
+
+
+//
+// Matchers
+//
+
+// built-in triangle matcher (TriangleMatcher)
+class NativeMatcher: public Matcher
+{
+public:
+    explicit NativeMatcher(const TriangleMatcherParams &params);
+
+    int SetReference(const Catalog &ref) override;
+    int Match(const Catalog &cat, vector<MatchedPair> &pairs) const override;
+
+private:
+    TriangleMatcher Impl;
+    bool HasReference;
+};
+
+
+// 'match' application (Droege et al. 2006, PASP 118, 1666). The catalogs are written into
+// WorkDir as ASCII files (row number, X, Y and MAG columns), each call has its own files.
+class ExternalMatcher: public Matcher
+{
+public:
+    // 'args' - 'match' parameters ("key=value" items, without the catalog columns and 'outfile')
+    ExternalMatcher(const vector<string> &args, double match_radius, const string &work_dir = ".");
+    ~ExternalMatcher();
+
+    int SetReference(const Catalog &ref) override;
+    int Match(const Catalog &cat, vector<MatchedPair> &pairs) const override;
+
+private:
+    string TempName(const string &suffix) const;
+
+    vector<string> Args;
+    string WorkDir;
+    string RefFile;
+    size_t RefSize;
+};
+
+
+// celestial coordinates matcher: X and Y of the catalogs are RA and DEC (degrees). The
+// coordinates are projected onto the plane tangent to the reference field, the objects are
+// matched by the mutually closest ones within the radius (degrees) using k-d trees.
+class SkyMatcher: public Matcher
+{
+public:
+    explicit SkyMatcher(double radius);
+
+    int SetReference(const Catalog &ref) override;
+    int Match(const Catalog &cat, vector<MatchedPair> &pairs) const override;
+
+private:
+    void Project(const Catalog &cat, vector<double> &x, vector<double> &y) const;
+
+    double Radius;
+    double Ra0, Dec0, CosDec0;
+    vector<double> RefX, RefY;
+    KdTree RefTree;
+};
+
+
+// matcher of the frames of a field rotator with the known rotation angles. The positions of the
+// reference objects are predicted by the rotation around the center estimate and the closest
+// objects within the window are taken (mutually closest ones, using k-d trees). The center is
+// then refined from the matched pairs and the objects are matched again within MatchRadius
+// (twice).
+// The rotation must be given (MatchRotated), Match fails.
+struct RotatorMatcherParams
+{
+    RotatorMatcherParams();
+
+    double CenterX, CenterY; // initial estimate of the rotation center (pixels)
+    double Window;           // search radius around the positions predicted by the initial center (pixels, default 20)
+    double MatchRadius;      // search radius around the positions predicted by the refined center (pixels, default 2)
+    int AngleSign;           // +1 if the image rotates counterclockwise for increasing angle, -1 for clockwise,
+                             // 0 - the sign giving more matched objects is taken (default)
+};
+
+
+class RotatorMatcher: public Matcher
+{
+public:
+    explicit RotatorMatcher(const RotatorMatcherParams &params);
+
+    int SetReference(const Catalog &ref) override;
+    int Match(const Catalog &cat, vector<MatchedPair> &pairs) const override;
+    int MatchRotated(const Catalog &cat, double rotation, vector<MatchedPair> &pairs) const override;
+
+private:
+    // pairs of the reference objects rotated by 'angle' (radians) around (cx,cy) and the objects of the catalog
+    void PredictedPairs(const Catalog &cat, const KdTree &cat_tree, double cx, double cy, double angle,
+                        double radius, vector<MatchedPair> &pairs) const;
+
+    // the center estimate from the matched pairs (it is kept if it cannot be computed)
+    void RefineCenter(const Catalog &cat, const vector<MatchedPair> &pairs, double angle, double &cx, double &cy) const;
+
+    RotatorMatcherParams Params;
+    vector<double> RefX, RefY;
+    KdTree RefTree;
+};
+
+
+//
+// Solvers (see CenterSolver)
+//
+
+class NormalSolver: public Solver
+{
+public:
+    explicit NormalSolver(WorkerPool *pool = nullptr);
+protected:
+    int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const override;
+};
+
+
+class QRSolver: public Solver
+{
+public:
+    explicit QRSolver(WorkerPool *pool = nullptr);
+protected:
+    int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const override;
+};
+
+
+class RobustSolver: public Solver
+{
+public:
+    RobustSolver(const RobustSolverParams &params, WorkerPool *pool = nullptr);
+protected:
+    int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const override;
+private:
+    RobustSolverParams Params;
+};
+
+
+class RigidSolver: public Solver
+{
+public:
+    explicit RigidSolver(WorkerPool *pool = nullptr);
+protected:
+    int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const override;
+};
+
+
+class CircleSolver: public Solver
+{
+public:
+    CircleSolver(CenterSolver::CircleFit fit, WorkerPool *pool = nullptr);
+protected:
+    int SolveBy(const CenterSolver &engine, const StarTracks &tracks, CenterSolution &sol) const override;
+private:
+    CenterSolver::CircleFit Fit;
+};
+
+
+//
+// Batch computation. The first catalog (frame) is the reference one.
+//
+class RotationCenter
+{
+public:
+    // called for each frame as soon as it is detected (concurrently from the workers)
+    typedef function<void(size_t frame, int status)> FrameReport;
+
+    // 'detector' may be NULL if only catalogs are processed
+    RotationCenter(const Detector *detector, Matcher &matcher, const Solver &solver, WorkerPool *pool = nullptr);
+
+    // detects objects in the frames concurrently. status[k] is the result for k-th frame
+    // (ROTCEN_ERROR_EMPTY_CAT if no objects are detected), the first non-zero one is returned
+    int Detect(const vector<string> &frames, vector<Catalog> &cats, vector<int> &status,
+               const FrameReport &report = FrameReport()) const;
+
+    // matches cats[1..] against cats[0] (concurrently) and keeps the objects matched in all
+    // the catalogs: ids[k][i] is ID of i-th common object in k-th catalog. N_matched[k] is
+    // the number of the common objects after k-th catalog. On error N_matched.size() is
+    // the index of the failed catalog. ROTCEN_ERROR_EMPTY_CAT is returned if nothing is matched.
+    // If 'angles' is given, it is the rotator angle of each catalog (degrees), the matchers get
+    // the rotations relative to the reference catalog.
+    int Match(const vector<Catalog> &cats, IdTable &ids, vector<size_t> &N_matched, const vector<double> *angles = nullptr);
+
+    // tracks of the matched objects (positions are taken from 'cats') and their center
+    int Solve(const vector<Catalog> &cats, const IdTable &ids, StarTracks &tracks, CenterSolution &sol) const;
+
+    // all at once for in-memory catalogs
+    int Compute(const vector<Catalog> &cats, CenterSolution &sol);
+
+    // all at once for the frames
+    int Compute(const vector<string> &frames, CenterSolution &sol);
+
+private:
+    const Detector *DetectorPtr;
+    Matcher &MatcherRef;
+    const Solver &SolverRef;
+    WorkerPool *Pool;
+};
+
+#endif // ROTCEN_H
@@ -0,0 +1,303 @@
+#include<iostream>
+#include<cstdio>
+#include<cmath>
+#include<chrono>
+#include<limits>
+#include<algorithm>
+
+#define BOOST_NO_CXX11_SCOPED_ENUMS // special definition to fix Boost's copy_file and -std=c++11 linking error
+#include<boost/program_options.hpp>
+#include<boost/filesystem.hpp>
+
+#include"rotcen.h"
+#include"ascii_file.h"
+#include"synthetic_field.h"
+
+using namespace std;
+
+namespace po = boost::program_options;
+
+//
+// Benchmark of the processing stages on synthetic rotating star fields.
+//
+// For each number of stars the field is generated, its catalogs are written in
+// SExtractor's ASCII format and as FITS tables into the work directory, and the
+// stages are timed separately (the best of the repeated runs):
+//
+//   ascii-file     parsing of the ASCII catalogs by AsciiFile::ReadLine
+//   ascii-catalog  parsing of the ASCII catalogs by AsciiCatalogReader
+//   fits-catalog   reading of the FITS tables by read_fits_catalog
+//   match          triangle matching of all the frames (RotationCenter::Match)
+//   tracks         arrangement of the matched positions into star tracks
+//   solve-normal   the normal equations solver
+//   solve-qr       assembly of the full linear system and its QR solution (GSL)
+//   solve-rigid    the rigid rotation solver
+//
+// The results are checked against the ground truth: the parsed coordinates
+// against the generated ones, the matched objects against the true stars and
+// the center against the true one. The exit code is not zero if a check fails.
+//
+
+
+/*
+    The function returns the best (minimal) time of 'repeat' runs of 'func' in milliseconds
+*/
+template<typename Func>
+static double best_time(size_t repeat, Func func)
+{
+    double best = numeric_limits<double>::infinity();
+
+    for ( size_t r = 0; r < max(repeat,(size_t)1); ++r ) {
+        auto start = chrono::steady_clock::now();
+        func();
+        chrono::duration<double,milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best,elapsed.count());
+    }
+
+    return best;
+}
+
+
+/*
+    The function prints the line of the results table, it returns 'ok'
+*/
+static bool report(const SyntheticFieldParams &pars, const string &stage, double time_ms, const string &check, bool ok)
+{
+    printf("%8zu %6zu  %-14s %12.3f  %-4s %s\n",pars.N_stars,pars.N_frames,stage.c_str(),time_ms,ok ? "OK" : "FAIL",check.c_str());
+    fflush(stdout);
+    return ok;
+}
+
+
+/*
+    The function returns maximal difference of the coordinates of the catalogs
+    (infinity if the sizes differ)
+*/
+static double max_difference(const Catalog &cat, const Catalog &ref)
+{
+    if ( cat.Size() != ref.Size() ) return numeric_limits<double>::infinity();
+
+    double diff = 0.0;
+    for ( size_t i = 0; i < cat.Size(); ++i ) {
+        diff = max(diff,max(fabs(cat.X(i) - ref.X(i)),fabs(cat.Y(i) - ref.Y(i))));
+    }
+    return diff;
+}
+
+
+/*
+    The function formats the check message
+*/
+static string message(const char *format, double val1, double val2 = 0.0)
+{
+    char buff[256];
+    snprintf(buff,sizeof(buff),format,val1,val2);
+    return buff;
+}
+
+
+/*
+    The function runs the stages for one field, it returns false if a check fails
+*/
+static bool run_field(const SyntheticFieldParams &pars, size_t repeat, double center_tol, const string &work_dir, WorkerPool &pool)
+{
+    bool ok = true;
+    int ret = ROTCEN_ERROR_OK;
+
+    unique_ptr<SyntheticField> field_ptr;
+    double time_ms = best_time(1,[&]() { field_ptr.reset(new SyntheticField(pars)); });
+    const SyntheticField &field = *field_ptr;
+
+    size_t N_objs = 0;
+    for ( size_t k = 0; k < field.Frames(); ++k ) N_objs += field[k].Size();
+    ok &= report(pars,"generate",time_ms,message("%.0f objects, %.0f stars in all the frames",N_objs,field.CommonStars()),true);
+
+    vector<string> ascii_files, fits_files;
+    for ( size_t k = 0; k < field.Frames(); ++k ) {
+        string base = work_dir + "/field_" + to_string(pars.N_stars) + "_" + to_string(k);
+        ascii_files.push_back(base + ".cat");
+        fits_files.push_back(base + ".xyls");
+        if ( ret == ROTCEN_ERROR_OK ) ret = write_ascii_catalog(ascii_files[k],field[k]);
+        if ( ret == ROTCEN_ERROR_OK ) ret = write_fits_catalog(fits_files[k],field[k]);
+    }
+    if ( ret != ROTCEN_ERROR_OK ) {
+        cerr << "Cannot write the catalogs into " << work_dir << "!\n";
+        return false;
+    }
+
+    // catalogs parsing (the coordinates are written with 4 decimals in ASCII files)
+
+    vector<double> frame_diff(field.Frames());
+    time_ms = best_time(repeat,[&]() {
+        pool.Run(field.Frames(),[&](size_t k) {
+            AsciiFile file(ascii_files[k].c_str());
+            AsciiFile::AsciiFileFlag flag;
+            double id, x, y, mag;
+            size_t row = 0;
+
+            frame_diff[k] = 0.0;
+            while ( (flag = file.ReadLine(4,&id,&x,&y,&mag)) != AsciiFile::Eof ) {
+                if ( flag != AsciiFile::DataString ) continue;
+                if ( row < field[k].Size() ) {
+                    frame_diff[k] = max(frame_diff[k],max(fabs(x - field[k].X(row)),fabs(y - field[k].Y(row))));
+                }
+                ++row;
+            }
+            if ( row != field[k].Size() ) frame_diff[k] = numeric_limits<double>::infinity();
+        });
+    });
+    double diff = *max_element(frame_diff.begin(),frame_diff.end());
+    ok &= report(pars,"ascii-file",time_ms,message("max coordinate error %g",diff),diff <= 5.0e-5);
+
+    vector<Catalog> cats(field.Frames());
+    vector<int> status(field.Frames());
+    time_ms = best_time(repeat,[&]() {
+        pool.Run(field.Frames(),[&](size_t k) {
+            status[k] = read_ascii_catalog<NumberColumn,XImageColumn,YImageColumn,MagBestColumn>(ascii_files[k],cats[k]);
+        });
+    });
+    diff = 0.0;
+    for ( size_t k = 0; k < field.Frames(); ++k ) {
+        diff = max(diff,status[k] == ROTCEN_ERROR_OK ? max_difference(cats[k],field[k]) : numeric_limits<double>::infinity());
+    }
+    ok &= report(pars,"ascii-catalog",time_ms,message("max coordinate error %g",diff),diff <= 5.0e-5);
+
+    time_ms = best_time(repeat,[&]() {
+        pool.Run(field.Frames(),[&](size_t k) {
+            status[k] = read_fits_catalog(fits_files[k],cats[k],"X","Y");
+        });
+    });
+    diff = 0.0;
+    for ( size_t k = 0; k < field.Frames(); ++k ) {
+        diff = max(diff,status[k] == ROTCEN_ERROR_OK ? max_difference(cats[k],field[k]) : numeric_limits<double>::infinity());
+    }
+    ok &= report(pars,"fits-catalog",time_ms,message("max coordinate error %g",diff),diff == 0.0);
+
+    for ( size_t k = 0; k < field.Frames(); ++k ) cats[k] = field[k].Clone(); // with the magnitudes
+
+    // matching
+
+    TriangleMatcherParams matcher_pars;
+    matcher_pars.MatchRadius = max(1.0,5.0*pars.PosNoise);
+    NativeMatcher matcher(matcher_pars);
+    NormalSolver solver;
+    RotationCenter rotcen(nullptr,matcher,solver,&pool);
+
+    IdTable ids;
+    vector<size_t> N_matched;
+    time_ms = best_time(repeat,[&]() { ret = rotcen.Match(cats,ids,N_matched); });
+    if ( ret != ROTCEN_ERROR_OK ) return report(pars,"match",time_ms,message("failed with code %.0f",ret),false);
+
+    size_t N_correct = 0;
+    for ( size_t i = 0; i < ids[0].size(); ++i ) {
+        long star = field.Star(0,Catalog::Row(ids[0][i]));
+        bool correct = star >= 0;
+        for ( size_t k = 1; k < field.Frames() && correct; ++k ) correct = field.Star(k,Catalog::Row(ids[k][i])) == star;
+        if ( correct ) ++N_correct;
+    }
+    double correct_frac = ids[0].empty() ? 0.0 : (double)N_correct/ids[0].size();
+    ok &= report(pars,"match",time_ms,message("%.0f common objects, %.2f%% correct",ids[0].size(),100.0*correct_frac),
+                 correct_frac >= 0.99 && N_correct >= 0.9*field.CommonStars());
+
+    // solving
+
+    StarTracks tracks;
+    time_ms = best_time(repeat,[&]() { tracks = StarTracks(cats,ids); });
+    ok &= report(pars,"tracks",time_ms,message("%.0f tracks",tracks.Stars()),tracks.Stars() == ids[0].size());
+
+    CenterSolver engine(&pool);
+    typedef int (CenterSolver::*SolveMethod)(const StarTracks&, CenterSolution&) const;
+    vector<pair<string,SolveMethod> > solvers = {{"solve-normal", &CenterSolver::SolveNormal},
+                                                 {"solve-qr", &CenterSolver::SolveQR},
+                                                 {"solve-rigid", &CenterSolver::SolveRigid}};
+
+    for ( auto &s: solvers ) {
+        CenterSolution sol;
+        time_ms = best_time(repeat,[&]() { ret = (engine.*s.second)(tracks,sol); });
+        if ( ret != ROTCEN_ERROR_OK ) {
+            ok &= report(pars,s.first,time_ms,message("failed with code %.0f",ret),false);
+            continue;
+        }
+        double err = hypot(sol.X - pars.CenterX,sol.Y - pars.CenterY);
+        ok &= report(pars,s.first,time_ms,message("center error %.4f pixels",err),err <= center_tol);
+    }
+
+    for ( size_t k = 0; k < field.Frames(); ++k ) {
+        boost::filesystem::remove(ascii_files[k]);
+        boost::filesystem::remove(fits_files[k]);
+    }
+
+    return ok;
+}
+
+
+int main(int argc, char* argv[])
+{
+    SyntheticFieldParams pars;
+    vector<size_t> N_stars = {100, 1000, 10000};
+    size_t repeat = 3;
+    double center_tol = 0.05;
+    long N_jobs = 1;
+    string work_dir;
+
+    po::options_description visible_opts("Allowed options");
+    visible_opts.add_options()
+        ("help,h", "produce help message")
+        ("stars",po::value<vector<size_t> >(&N_stars)->multitoken(), "numbers of stars of the benchmarked fields (default 100 1000 10000)")
+        ("frames",po::value<size_t>(&pars.N_frames), "number of frames (default 10)")
+        ("angle-step",po::value<double>(&pars.AngleStep), "rotation between the frames (degrees, default 3)")
+        ("noise",po::value<double>(&pars.PosNoise), "RMS of the object coordinates (pixels, default 0.05)")
+        ("spurious",po::value<double>(&pars.SpuriousFraction), "fraction of spurious objects in a frame (default 0.02)")
+        ("seed",po::value<unsigned long>(&pars.Seed), "seed of the fields generator (default 1)")
+        ("repeat",po::value<size_t>(&repeat), "number of runs of each stage, the best time is reported (default 3)")
+        ("center-tol",po::value<double>(&center_tol), "maximal allowed error of the center (pixels, default 0.05)")
+        ("jobs,j",po::value<long>(&N_jobs), "number of threads (0 means number of CPU cores, default 1)")
+        ("work-dir",po::value<string>(&work_dir), "directory of the catalog files (default is a new temporary one)");
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::parse_command_line(argc,argv,visible_opts),vm);
+
+        if ( vm.count("help") ) {
+            cout << "Usage: " << boost::filesystem::basename(argv[0]) << " [options]\n\n" << visible_opts << "\n";
+            return ROTCEN_ERROR_HELP;
+        }
+
+        po::notify(vm);
+    } catch (boost::program_options::unknown_option& e) {
+        cerr << "Unknown commandline options! Try '-h' option!\n";
+        return ROTCEN_ERROR_UNKNOWN_OPT;
+    } catch (boost::program_options::error& e) {
+        cerr << "Invalid commandline option value! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    if ( N_jobs < 0 || pars.N_frames < 2 || N_stars.empty() ) {
+        cerr << "Invalid benchmark parameters! Try '-h' option!\n";
+        return ROTCEN_ERROR_INVALID_OPT_VALUE;
+    }
+
+    bool temp_dir = work_dir.empty();
+    try {
+        if ( temp_dir ) work_dir = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("rotcen_bench_%%%%%%%%")).string();
+        boost::filesystem::create_directories(work_dir);
+    } catch (boost::filesystem::filesystem_error &ex) {
+        cerr << "Cannot create the work directory!\n";
+        return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+    }
+
+    WorkerPool pool(WorkerPool::JobsNumber(N_jobs)-1);
+
+    printf("%8s %6s  %-14s %12s  %-4s %s\n","stars","frames","stage","time (ms)","","check");
+
+    bool ok = true;
+    for ( auto n: N_stars ) {
+        pars.N_stars = n;
+        ok &= run_field(pars,repeat,center_tol,work_dir,pool);
+    }
+
+    if ( temp_dir ) boost::filesystem::remove_all(work_dir);
+
+    return ok ? ROTCEN_ERROR_OK : ROTCEN_ERROR_BAD_DATA;
+}
@@ -0,0 +1,28 @@
+#ifndef ROTCEN_ERRORS_H
+#define ROTCEN_ERRORS_H
+
+//
+// Error codes of the rotation center computation
+//
+
+#define ROTCEN_ERROR_OK 0
+#define ROTCEN_ERROR_HELP 1
+#define ROTCEN_ERROR_CMD 10
+#define ROTCEN_ERROR_INPUT_LIST 20
+#define ROTCEN_ERROR_UNKNOWN_OPT 30
+#define ROTCEN_ERROR_INVALID_OPT_VALUE 40
+#define ROTCEN_ERROR_INVALID_FILENAME 50
+#define ROTCEN_ERROR_UNAVAILABLE_CMD 60
+#define ROTCEN_ERROR_NOT_ENOUGH_FILES 70
+#define ROTCEN_ERROR_APP_FAILED 80
+#define ROTCEN_ERROR_CANNOT_CREATE_FILE 90
+#define ROTCEN_ERROR_BAD_DATA 100
+#define ROTCEN_ERROR_EMPTY_CAT 110
+#define ROTCEN_ERROR_BAD_ALLOC 120
+#define ROTCEN_ERROR_BAD_MATCH 130
+#define ROTCEN_ERROR_CANNOT_SOLVE 140
+#define ROTCEN_ERROR_CANNOT_CREATE_RESULT_FILE 150
+
+#define ROTCEN_ERROR_CFITSIO 1000 // displacement for CFITSIO error code
+
+#endif // ROTCEN_ERRORS_H
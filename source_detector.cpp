@@ -0,0 +1,406 @@
+#include "source_detector.h"
+#include "rotcen_errors.h"
+#include "fits_image.h"
+#include "stage_profiler.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+
+SourceDetectorParams::SourceDetectorParams(): Thresh(5.0), MinArea(5), MeshSize(64)
+{
+}
+
+
+//
+// Accumulated isophotal moments of a component
+//
+struct SourceDetector::Moments
+{
+    Moments(): Npix(0), Flux(0.0), FluxX(0.0), FluxY(0.0)
+    {
+    }
+
+    void Add(const Moments &m)
+    {
+        Npix += m.Npix;
+        Flux += m.Flux;
+        FluxX += m.FluxX;
+        FluxY += m.FluxY;
+    }
+
+    size_t Npix;
+    double Flux;  // background-subtracted flux
+    double FluxX; // flux-weighted sum of X
+    double FluxY; // flux-weighted sum of Y
+};
+
+
+/*
+    Union-find helpers (labels are indices in 'parent' vector)
+*/
+static int uf_find(vector<int> &parent, int i)
+{
+    while ( parent[i] != i ) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+
+static void uf_union(vector<int> &parent, int i, int j)
+{
+    i = uf_find(parent,i);
+    j = uf_find(parent,j);
+    if ( i < j ) parent[j] = i; else parent[i] = j;
+}
+
+
+/*
+    Background and RMS of the mesh pixels by iterative 3-sigma clipping around median.
+    The background is SExtractor's mode estimate (2.5*median - 1.5*mean) for not crowded
+    meshes and median otherwise. The content of 'buff' is destroyed.
+*/
+static void mesh_stat(vector<float> &buff, float &bkg, float &rms)
+{
+    size_t n = buff.size();
+    double mean = 0.0, sigma = 0.0, median = 0.0;
+
+    for ( int iter = 0; iter < 10 && n > 2; ++iter ) {
+        auto mid = buff.begin() + n/2;
+        nth_element(buff.begin(),mid,buff.begin()+n);
+        median = *mid;
+
+        double sum = 0.0, sum2 = 0.0;
+        for ( size_t i = 0; i < n; ++i ) {
+            double d = buff[i] - median;
+            sum += d;
+            sum2 += d*d;
+        }
+        mean = median + sum/n;
+        sigma = sqrt(max(0.0,sum2/n - (sum/n)*(sum/n)));
+
+        if ( sigma == 0.0 ) break;
+
+        float lo = median - 3.0*sigma;
+        float hi = median + 3.0*sigma;
+        size_t n_keep = partition(buff.begin(),buff.begin()+n,[lo,hi](float v){ return v >= lo && v <= hi; }) - buff.begin();
+        if ( n_keep == n ) break;
+        n = n_keep;
+    }
+
+    if ( sigma > 0.0 && fabs(mean-median)/sigma < 0.3 ) {
+        bkg = 2.5*median - 1.5*mean;
+    } else {
+        bkg = median;
+    }
+    rms = sigma;
+}
+
+
+SourceDetector::SourceDetector(const SourceDetectorParams &params, WorkerPool *pool):
+    Params(params), Pool(pool), Calibrator(nullptr)
+{
+    if ( Params.MeshSize < 1 ) Params.MeshSize = 1;
+    if ( Params.MinArea < 1 ) Params.MinArea = 1;
+}
+
+
+void SourceDetector::EstimateBackground(const float *pix, size_t nx, size_t ny, BackgroundMap &map) const
+{
+    size_t mesh = Params.MeshSize;
+
+    size_t mesh_nx = map.Nx = (nx + mesh - 1)/mesh;
+    size_t mesh_ny = map.Ny = (ny + mesh - 1)/mesh;
+
+    vector<float> bkg(mesh_nx*mesh_ny), rms(mesh_nx*mesh_ny);
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    pool.Run(mesh_ny,[&](size_t my) {
+        vector<float> buff;
+        size_t y_end = min(ny,(my+1)*mesh);
+        for ( size_t mx = 0; mx < mesh_nx; ++mx ) {
+            size_t x_start = mx*mesh;
+            size_t x_end = min(nx,x_start+mesh);
+            buff.clear();
+            for ( size_t y = my*mesh; y < y_end; ++y ) {
+                buff.insert(buff.end(),pix+y*nx+x_start,pix+y*nx+x_end);
+            }
+            mesh_stat(buff,bkg[my*mesh_nx+mx],rms[my*mesh_nx+mx]);
+        }
+    });
+
+    // 3x3 median filtering of the mesh map (removes meshes affected by bright objects)
+
+    map.Bkg.resize(bkg.size());
+    map.Rms.resize(rms.size());
+
+    float win_bkg[9], win_rms[9];
+    for ( size_t my = 0; my < mesh_ny; ++my ) {
+        for ( size_t mx = 0; mx < mesh_nx; ++mx ) {
+            int n = 0;
+            for ( long j = (long)my-1; j <= (long)my+1; ++j ) {
+                if ( j < 0 || j >= (long)mesh_ny ) continue;
+                for ( long i = (long)mx-1; i <= (long)mx+1; ++i ) {
+                    if ( i < 0 || i >= (long)mesh_nx ) continue;
+                    win_bkg[n] = bkg[j*mesh_nx+i];
+                    win_rms[n] = rms[j*mesh_nx+i];
+                    ++n;
+                }
+            }
+            nth_element(win_bkg,win_bkg+n/2,win_bkg+n);
+            nth_element(win_rms,win_rms+n/2,win_rms+n);
+            map.Bkg[my*mesh_nx+mx] = win_bkg[n/2];
+            map.Rms[my*mesh_nx+mx] = win_rms[n/2];
+        }
+    }
+}
+
+
+/*
+    Bilinear interpolation of the mesh map for the image row 'y'.
+    Mesh values are assigned to the mesh centers.
+*/
+void SourceDetector::InterpolateBackground(const BackgroundMap &map, size_t y, size_t nx, float *bkg, float *rms) const
+{
+    float mesh = Params.MeshSize;
+    size_t mesh_nx = map.Nx;
+    size_t mesh_ny = map.Ny;
+
+    float fy = (y + 0.5f)/mesh - 0.5f;
+    fy = min(max(fy,0.0f),(float)(mesh_ny-1));
+    size_t iy = min((size_t)fy,mesh_ny > 1 ? mesh_ny-2 : 0);
+    float wy = mesh_ny > 1 ? fy - iy : 0.0f;
+    size_t iy1 = mesh_ny > 1 ? iy+1 : iy;
+
+    vector<float> col_bkg(mesh_nx), col_rms(mesh_nx);
+    for ( size_t mx = 0; mx < mesh_nx; ++mx ) {
+        col_bkg[mx] = (1.0f-wy)*map.Bkg[iy*mesh_nx+mx] + wy*map.Bkg[iy1*mesh_nx+mx];
+        col_rms[mx] = (1.0f-wy)*map.Rms[iy*mesh_nx+mx] + wy*map.Rms[iy1*mesh_nx+mx];
+    }
+
+    for ( size_t x = 0; x < nx; ++x ) {
+        float fx = (x + 0.5f)/mesh - 0.5f;
+        fx = min(max(fx,0.0f),(float)(mesh_nx-1));
+        size_t ix = min((size_t)fx,mesh_nx > 1 ? mesh_nx-2 : 0);
+        float wx = mesh_nx > 1 ? fx - ix : 0.0f;
+        size_t ix1 = mesh_nx > 1 ? ix+1 : ix;
+
+        bkg[x] = (1.0f-wx)*col_bkg[ix] + wx*col_bkg[ix1];
+        rms[x] = (1.0f-wx)*col_rms[ix] + wx*col_rms[ix1];
+    }
+}
+
+
+/*
+    Label 8-connected components of the pixels above threshold in the rows [y_start,y_end)
+    and compute their moments. On exit 'first_row' and 'last_row' contain component indices
+    (in 'objs') of the first and last rows of the band (-1 for background pixels).
+*/
+void SourceDetector::LabelBand(const float *pix, size_t nx, const BackgroundMap &map, size_t y_start, size_t y_end,
+                               vector<Moments> &objs, vector<int> &first_row, vector<int> &last_row) const
+{
+    size_t n_rows = y_end - y_start;
+
+    vector<int> labels(nx*n_rows,-1);
+    vector<int> parent;
+    vector<float> flux(nx*n_rows);
+
+    vector<float> bkg(nx), rms(nx), thresh(nx);
+
+    for ( size_t row = 0; row < n_rows; ++row ) {
+        size_t y = y_start + row;
+        const float *p = pix + y*nx;
+        float *f = flux.data() + row*nx;
+        int *lab = labels.data() + row*nx;
+        const int *prev = row ? lab - nx : nullptr;
+
+        InterpolateBackground(map,y,nx,bkg.data(),rms.data());
+
+        // background subtraction and threshold computation (vectorizable loop)
+        float k = Params.Thresh;
+        for ( size_t x = 0; x < nx; ++x ) {
+            f[x] = p[x] - bkg[x];
+            thresh[x] = k*rms[x];
+        }
+
+        for ( size_t x = 0; x < nx; ++x ) {
+            if ( !(f[x] > thresh[x]) ) continue;
+
+            int l = -1;
+            if ( x && lab[x-1] >= 0 ) l = lab[x-1];
+            if ( prev ) {
+                for ( long dx = -1; dx <= 1; ++dx ) {
+                    long xx = (long)x + dx;
+                    if ( xx < 0 || xx >= (long)nx || prev[xx] < 0 ) continue;
+                    if ( l < 0 ) l = prev[xx]; else uf_union(parent,l,prev[xx]);
+                }
+            }
+            if ( l < 0 ) {
+                l = parent.size();
+                parent.push_back(l);
+            }
+            lab[x] = l;
+        }
+    }
+
+    // resolve equivalences and accumulate moments
+
+    vector<int> comp(parent.size(),-1);
+    objs.clear();
+    for ( size_t i = 0; i < parent.size(); ++i ) {
+        int root = uf_find(parent,i);
+        if ( comp[root] < 0 ) {
+            comp[root] = objs.size();
+            objs.push_back(Moments());
+        }
+        comp[i] = comp[root];
+    }
+
+    for ( size_t row = 0; row < n_rows; ++row ) {
+        double y = y_start + row;
+        int *lab = labels.data() + row*nx;
+        const float *f = flux.data() + row*nx;
+        for ( size_t x = 0; x < nx; ++x ) {
+            if ( lab[x] < 0 ) continue;
+            lab[x] = comp[lab[x]];
+            Moments &m = objs[lab[x]];
+            ++m.Npix;
+            m.Flux += f[x];
+            m.FluxX += f[x]*x;
+            m.FluxY += f[x]*y;
+        }
+    }
+
+    first_row.assign(labels.begin(),labels.begin()+nx);
+    last_row.assign(labels.end()-nx,labels.end());
+}
+
+
+void SourceDetector::Detect(const float *pix, size_t nx, size_t ny, Catalog &cat) const
+{
+    cat = Catalog();
+
+    if ( nx == 0 || ny == 0 ) return;
+
+    WorkerPool serial;
+    WorkerPool &pool = Pool ? *Pool : serial;
+
+    BackgroundMap map;
+    EstimateBackground(pix,nx,ny,map);
+
+    // label bands of rows concurrently
+
+    size_t N_bands = min(ny,4*pool.Size());
+    size_t band_rows = (ny + N_bands - 1)/N_bands;
+    N_bands = (ny + band_rows - 1)/band_rows;
+
+    vector<vector<Moments> > band_objs(N_bands);
+    vector<vector<int> > first_rows(N_bands), last_rows(N_bands);
+
+    pool.Run(N_bands,[&](size_t i_band) {
+        size_t y_start = i_band*band_rows;
+        size_t y_end = min(ny,y_start+band_rows);
+        LabelBand(pix,nx,map,y_start,y_end,band_objs[i_band],first_rows[i_band],last_rows[i_band]);
+    });
+
+    // merge components touching across the band boundaries
+
+    vector<int> offset(N_bands+1,0);
+    for ( size_t i = 0; i < N_bands; ++i ) offset[i+1] = offset[i] + band_objs[i].size();
+
+    vector<int> parent(offset[N_bands]);
+    iota(parent.begin(),parent.end(),0);
+
+    for ( size_t i_band = 1; i_band < N_bands; ++i_band ) {
+        const vector<int> &upper = first_rows[i_band];
+        const vector<int> &lower = last_rows[i_band-1];
+        for ( size_t x = 0; x < nx; ++x ) {
+            if ( upper[x] < 0 ) continue;
+            for ( long dx = -1; dx <= 1; ++dx ) {
+                long xx = (long)x + dx;
+                if ( xx < 0 || xx >= (long)nx || lower[xx] < 0 ) continue;
+                uf_union(parent,offset[i_band]+upper[x],offset[i_band-1]+lower[xx]);
+            }
+        }
+    }
+
+    vector<Moments> objs(parent.size());
+    for ( size_t i_band = 0; i_band < N_bands; ++i_band ) {
+        for ( size_t i = 0; i < band_objs[i_band].size(); ++i ) {
+            objs[uf_find(parent,offset[i_band]+i)].Add(band_objs[i_band][i]);
+        }
+    }
+
+    // compute centroids and magnitudes. Objects are numbered in order of increasing Y
+
+    vector<size_t> idx;
+    for ( size_t i = 0; i < objs.size(); ++i ) {
+        if ( (int)i != parent[i] ) continue; // merged into other component
+        if ( objs[i].Npix < Params.MinArea || objs[i].Flux <= 0.0 ) continue;
+        idx.push_back(i);
+    }
+
+    sort(idx.begin(),idx.end(),[&objs](size_t i, size_t j) {
+        double yi = objs[i].FluxY/objs[i].Flux;
+        double yj = objs[j].FluxY/objs[j].Flux;
+        if ( yi != yj ) return yi < yj;
+        return objs[i].FluxX/objs[i].Flux < objs[j].FluxX/objs[j].Flux;
+    });
+
+    cat = Catalog(idx.size());
+
+    for ( size_t k = 0; k < idx.size(); ++k ) {
+        const Moments &m = objs[idx[k]];
+        cat.Id(k) = k+1;
+        cat.X(k) = m.FluxX/m.Flux + 1.0; // FITS pixel coordinates start from 1
+        cat.Y(k) = m.FluxY/m.Flux + 1.0;
+        cat.Mag(k) = -2.5*log10(m.Flux);
+    }
+}
+
+
+void SourceDetector::SetCalibrator(const FrameCalibrator *calibrator)
+{
+    Calibrator = calibrator;
+}
+
+
+int SourceDetector::Detect(const string &fits_filename, Catalog &cat) const
+{
+    FitsImage image;
+    vector<float> pix;
+    int ret;
+
+    {
+        ProfileScope scope("read-frame");
+
+        ret = image.Open(fits_filename);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+        ret = image.Read(pix,Pool);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+
+        scope.Items(pix.size());
+    }
+
+    size_t nx = image.Width();
+    size_t ny = image.Height();
+    image.Close();
+
+    if ( Calibrator ) {
+        ProfileScope scope("calibrate");
+        ret = Calibrator->Calibrate(fits_filename,pix.data(),nx,ny,Pool);
+        if ( ret != ROTCEN_ERROR_OK ) return ret;
+    }
+
+    ProfileScope scope("find-objects");
+    Detect(pix.data(),nx,ny,cat);
+    scope.Items(cat.Size());
+
+    return ROTCEN_ERROR_OK;
+}
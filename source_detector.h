@@ -0,0 +1,77 @@
+#ifndef SOURCE_DETECTOR_H
+#define SOURCE_DETECTOR_H
+
+#include <string>
+#include <vector>
+
+#include "catalog.h"
+#include "worker_pool.h"
+#include "frame_calibrator.h"
+
+using namespace std;
+
+//
+// Parameters of the objects detection (SExtractor-like meaning)
+//
+struct SourceDetectorParams
+{
+    SourceDetectorParams();
+
+    double Thresh;   // detection threshold in units of background RMS (DETECT_THRESH)
+    size_t MinArea;  // minimal number of pixels above threshold (DETECT_MINAREA)
+    size_t MeshSize; // size of background mesh in pixels (BACK_SIZE)
+};
+
+
+//
+// Built-in objects detector working directly on FITS-image pixels.
+//
+// The algorithm:
+//   1) background and background RMS are estimated in the meshes of
+//      MeshSize x MeshSize pixels by iterative 3-sigma clipping (SExtractor's mode
+//      estimator), the mesh map is median-filtered and bilinearly interpolated;
+//   2) pixels above Thresh*RMS are labeled into 8-connected components. The image
+//      is split into bands of rows, bands are labeled concurrently and the components
+//      are merged across band boundaries;
+//   3) isophotal flux and flux-weighted centroid are computed for each component.
+//
+// The result catalog has the columns of SExtractor's catalog:
+//   NUMBER (ID), X_IMAGE, Y_IMAGE (1-based FITS pixel coordinates) and MAG_BEST
+//   (isophotal magnitude with zero point 0).
+// No deblending of overlapped objects is performed.
+//
+class SourceDetector
+{
+public:
+    SourceDetector(const SourceDetectorParams &params, WorkerPool *pool = nullptr);
+
+    // returns ROTCEN_ERROR_* code (CFITSIO errors are displaced by ROTCEN_ERROR_CFITSIO).
+    // The detector has no state, so the frames can be processed concurrently.
+    int Detect(const string &fits_filename, Catalog &cat) const;
+
+    void Detect(const float *pix, size_t nx, size_t ny, Catalog &cat) const;
+
+    // the frames read from FITS-files are calibrated before the detection. The calibrator
+    // (with loaded master frames) must outlive the detector (NULL disables the calibration).
+    void SetCalibrator(const FrameCalibrator *calibrator);
+
+private:
+    struct Moments;
+
+    struct BackgroundMap // background and its RMS in the meshes
+    {
+        size_t Nx, Ny;
+        vector<float> Bkg, Rms;
+    };
+
+    void EstimateBackground(const float *pix, size_t nx, size_t ny, BackgroundMap &map) const;
+    void InterpolateBackground(const BackgroundMap &map, size_t y, size_t nx, float *bkg, float *rms) const;
+    void LabelBand(const float *pix, size_t nx, const BackgroundMap &map, size_t y_start, size_t y_end,
+                   vector<Moments> &objs, vector<int> &first_row, vector<int> &last_row) const;
+
+    SourceDetectorParams Params;
+    WorkerPool *Pool;
+    const FrameCalibrator *Calibrator;
+};
+
+#endif // SOURCE_DETECTOR_H
@@ -0,0 +1,106 @@
+#include "spatial_index.h"
+
+#include <numeric>
+#include <algorithm>
+
+
+KdTree::KdTree(): X(), Y(), Index()
+{
+}
+
+
+KdTree::KdTree(const double *x, const double *y, size_t N_points): X(), Y(), Index()
+{
+    Build(x,y,N_points);
+}
+
+
+/*
+    The node [lo,hi) is split by the median element (position (lo+hi)/2) along the axis
+    (0 for X, 1 for Y). Left subtree is [lo,mid), right one is [mid+1,hi).
+    The tree is built on Index vector (X and Y are still in original order),
+    the coordinates are permuted afterwards.
+*/
+void KdTree::BuildNode(size_t lo, size_t hi, int axis)
+{
+    if ( hi - lo < 2 ) return;
+
+    size_t mid = (lo + hi)/2;
+    const vector<double> &coord = axis ? Y : X;
+
+    nth_element(Index.begin()+lo,Index.begin()+mid,Index.begin()+hi,
+                [&coord](size_t i, size_t j){ return coord[i] < coord[j]; });
+
+    BuildNode(lo,mid,1-axis);
+    BuildNode(mid+1,hi,1-axis);
+}
+
+
+void KdTree::Build(const double *x, const double *y, size_t N_points)
+{
+    Index.resize(N_points);
+    iota(Index.begin(),Index.end(),0);
+
+    X.assign(x,x+N_points);
+    Y.assign(y,y+N_points);
+    BuildNode(0,Index.size(),0);
+
+    for ( size_t k = 0; k < Index.size(); ++k ) {
+        X[k] = x[Index[k]];
+        Y[k] = y[Index[k]];
+    }
+}
+
+
+void KdTree::SearchNode(size_t lo, size_t hi, int axis, double x, double y, long &best, double &best_d2) const
+{
+    while ( lo < hi ) {
+        size_t mid = (lo + hi)/2;
+
+        double dx = X[mid] - x;
+        double dy = Y[mid] - y;
+        double d2 = dx*dx + dy*dy;
+        if ( d2 <= best_d2 ) {
+            best_d2 = d2;
+            best = mid;
+        }
+
+        double diff = axis ? y - Y[mid] : x - X[mid];
+
+        // search the nearer subtree recursively, and the farther one only if the splitting
+        // line is closer than the current best distance
+        size_t near_lo = diff < 0.0 ? lo : mid+1;
+        size_t near_hi = diff < 0.0 ? mid : hi;
+        size_t far_lo = diff < 0.0 ? mid+1 : lo;
+        size_t far_hi = diff < 0.0 ? hi : mid;
+
+        SearchNode(near_lo,near_hi,1-axis,x,y,best,best_d2);
+
+        if ( diff*diff > best_d2 ) return;
+
+        lo = far_lo;
+        hi = far_hi;
+        axis = 1 - axis;
+    }
+}
+
+
+long KdTree::Nearest(double x, double y, double radius, double *dist2) const
+{
+    long best = -1;
+    double best_d2 = radius*radius;
+
+    SearchNode(0,X.size(),0,x,y,best,best_d2);
+
+    if ( best < 0 ) return -1;
+
+    if ( dist2 ) *dist2 = best_d2;
+
+    return Index[best];
+}
+
+
+size_t KdTree::Size() const
+{
+    return X.size();
+}
@@ -0,0 +1,35 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <vector>
+
+using namespace std;
+
+//
+// 2-D k-d tree for nearest-neighbour-within-radius queries.
+//
+// The tree is built once for a catalog (O(N log N)) and stored implicitly
+// in the permuted coordinate arrays, each query costs O(log N) on average.
+//
+class KdTree
+{
+public:
+    KdTree();
+    KdTree(const double *x, const double *y, size_t N_points);
+
+    void Build(const double *x, const double *y, size_t N_points);
+
+    // returns index of the closest point within 'radius' or -1 if there is no such point.
+    // Squared distance to the point is returned in 'dist2' (if it is not NULL)
+    long Nearest(double x, double y, double radius, double *dist2 = nullptr) const;
+
+    size_t Size() const;
+private:
+    void BuildNode(size_t lo, size_t hi, int axis);
+    void SearchNode(size_t lo, size_t hi, int axis, double x, double y, long &best, double &best_d2) const;
+
+    vector<double> X, Y;  // coordinates in tree order
+    vector<size_t> Index; // original indices in tree order
+};
+
+#endif // SPATIAL_INDEX_H
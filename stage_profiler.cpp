@@ -0,0 +1,369 @@
+#include "stage_profiler.h"
+#include "rotcen_errors.h"
+
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <ctime>
+#include <unistd.h>
+
+
+atomic<StageProfiler*> StageProfiler::Installed(nullptr);
+
+static thread_local ProfileScope *active_scope = nullptr;
+
+
+/*
+    The function returns microseconds of the steady clock
+*/
+static double steady_usec()
+{
+    return chrono::duration<double,micro>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static double timeval_usec(const struct timeval &tv)
+{
+    return tv.tv_sec*1.0E6 + tv.tv_usec;
+}
+
+
+/*
+    JSON string literal (quotes and control characters are escaped)
+*/
+static string json_string(const string &str)
+{
+    string res = "\"";
+    for ( unsigned char c: str ) {
+        if ( c == '"' || c == '\\' ) {
+            res += '\\';
+            res += c;
+        } else if ( c < 0x20 ) {
+            char buff[8];
+            snprintf(buff,sizeof(buff),"\\u%04x",c);
+            res += buff;
+        } else {
+            res += c;
+        }
+    }
+    return res + "\"";
+}
+
+
+static string json_usec(double usec)
+{
+    char buff[32];
+    snprintf(buff,sizeof(buff),"%.3f",usec);
+    return buff;
+}
+
+
+static string json_msec(double usec)
+{
+    return json_usec(usec/1000.0);
+}
+
+
+//
+// StageProfiler
+//
+
+StageProfiler::StageProfiler(): Origin(steady_usec()), Frames(), SpanList(), SpanMutex()
+{
+}
+
+
+StageProfiler* StageProfiler::Current()
+{
+    return Installed.load(memory_order_acquire);
+}
+
+
+void StageProfiler::Install(StageProfiler *profiler)
+{
+    Installed.store(profiler,memory_order_release);
+}
+
+
+void StageProfiler::SetFrames(const vector<string> &frames)
+{
+    lock_guard<mutex> lock(SpanMutex);
+    Frames = frames;
+}
+
+
+void StageProfiler::Add(const ProfileSpan &span)
+{
+    lock_guard<mutex> lock(SpanMutex);
+    SpanList.push_back(span);
+}
+
+
+void StageProfiler::AddProcess(const string &name, double start, const struct rusage &usage)
+{
+    ProfileSpan span;
+
+    span.Name = name;
+    span.Process = true;
+    span.Thread = ThreadNumber();
+    span.Start = start;
+    span.Wall = Now() - start;
+    span.Cpu = 0.0;
+    span.ChildCpu = timeval_usec(usage.ru_utime) + timeval_usec(usage.ru_stime);
+    span.Items = 0;
+
+    ProfileScope *scope = ProfileScope::Active();
+    span.Frame = scope ? scope->Frame() : -1;
+    if ( scope ) scope->AddChildCpu(span.ChildCpu);
+
+    Add(span);
+}
+
+
+vector<ProfileSpan> StageProfiler::Spans() const
+{
+    lock_guard<mutex> lock(SpanMutex);
+    return SpanList;
+}
+
+
+double StageProfiler::Now() const
+{
+    return steady_usec() - Origin;
+}
+
+
+size_t StageProfiler::ThreadNumber()
+{
+    static atomic<size_t> N_threads(0);
+    static thread_local size_t number = N_threads++;
+
+    return number;
+}
+
+
+double StageProfiler::ThreadCpuTime()
+{
+    timespec ts;
+    if ( clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts) ) return 0.0;
+
+    return ts.tv_sec*1.0E6 + ts.tv_nsec/1.0E3;
+}
+
+
+string StageProfiler::FrameName(long frame) const
+{
+    if ( frame >= 0 && (size_t)frame < Frames.size() ) return Frames[frame];
+
+    return "#" + to_string(frame);
+}
+
+
+/*
+    The summary has the totals of the whole process and the spans summed up by stage
+    (in order of their first appearance), by external application and by frame. The
+    times are in milliseconds.
+*/
+int StageProfiler::WriteSummary(const string &filename) const
+{
+    struct Total
+    {
+        Total(): N_spans(0), Wall(0.0), Cpu(0.0), ChildCpu(0.0), Items(0) {}
+
+        void Add(const ProfileSpan &span)
+        {
+            ++N_spans;
+            Wall += span.Wall;
+            Cpu += span.Cpu;
+            ChildCpu += span.ChildCpu;
+            Items += span.Items;
+        }
+
+        string Json(const string &key, const string &name) const
+        {
+            return "{" + json_string(key) + ": " + json_string(name) + ", \"count\": " + to_string(N_spans) +
+                   ", \"wall_ms\": " + json_msec(Wall) + ", \"cpu_ms\": " + json_msec(Cpu) +
+                   ", \"child_cpu_ms\": " + json_msec(ChildCpu) + ", \"items\": " + to_string(Items) + "}";
+        }
+
+        size_t N_spans;
+        double Wall, Cpu, ChildCpu;
+        size_t Items;
+    };
+
+    vector<ProfileSpan> spans = Spans();
+    double wall = Now();
+
+    vector<string> stage_names, process_names;
+    map<string,Total> stages, processes;
+    map<long,vector<string> > frame_stage_names;
+    map<long,map<string,Total> > frames;
+
+    for ( auto &span: spans ) {
+        vector<string> &names = span.Process ? process_names : stage_names;
+        map<string,Total> &totals = span.Process ? processes : stages;
+        if ( !totals.count(span.Name) ) names.push_back(span.Name);
+        totals[span.Name].Add(span);
+
+        if ( span.Frame < 0 ) continue;
+        map<string,Total> &frame_totals = frames[span.Frame];
+        string name = span.Process ? "process:" + span.Name : span.Name;
+        if ( !frame_totals.count(name) ) frame_stage_names[span.Frame].push_back(name);
+        frame_totals[name].Add(span);
+    }
+
+    struct rusage self_usage, child_usage;
+    getrusage(RUSAGE_SELF,&self_usage);
+    getrusage(RUSAGE_CHILDREN,&child_usage);
+
+    ofstream file(filename);
+    if ( !file.good() ) return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+
+    file << "{\n";
+    file << "  \"wall_ms\": " << json_msec(wall) << ",\n";
+    file << "  \"cpu_user_ms\": " << json_msec(timeval_usec(self_usage.ru_utime)) <<
+            ", \"cpu_system_ms\": " << json_msec(timeval_usec(self_usage.ru_stime)) << ",\n";
+    file << "  \"child_cpu_user_ms\": " << json_msec(timeval_usec(child_usage.ru_utime)) <<
+            ", \"child_cpu_system_ms\": " << json_msec(timeval_usec(child_usage.ru_stime)) << ",\n";
+    file << "  \"max_rss_kb\": " << self_usage.ru_maxrss << ", \"child_max_rss_kb\": " << child_usage.ru_maxrss << ",\n";
+
+    file << "  \"stages\": [";
+    for ( size_t i = 0; i < stage_names.size(); ++i ) {
+        file << (i ? ",\n" : "\n") << "    " << stages[stage_names[i]].Json("stage",stage_names[i]);
+    }
+    file << (stage_names.empty() ? "],\n" : "\n  ],\n");
+
+    file << "  \"processes\": [";
+    for ( size_t i = 0; i < process_names.size(); ++i ) {
+        file << (i ? ",\n" : "\n") << "    " << processes[process_names[i]].Json("application",process_names[i]);
+    }
+    file << (process_names.empty() ? "],\n" : "\n  ],\n");
+
+    file << "  \"frames\": [";
+    for ( auto it = frames.begin(); it != frames.end(); ++it ) {
+        file << (it == frames.begin() ? "\n" : ",\n");
+        file << "    {\"frame\": " << json_string(FrameName(it->first)) << ", \"stages\": [";
+        vector<string> &names = frame_stage_names[it->first];
+        for ( size_t i = 0; i < names.size(); ++i ) {
+            file << (i ? ",\n" : "\n") << "      " << it->second[names[i]].Json("stage",names[i]);
+        }
+        file << "\n    ]}";
+    }
+    file << (frames.empty() ? "]\n" : "\n  ]\n");
+    file << "}\n";
+
+    return file.good() ? ROTCEN_ERROR_OK : ROTCEN_ERROR_CANNOT_CREATE_FILE;
+}
+
+
+/*
+    Complete events ("ph": "X") of the spans, the stages and the external applications
+    are distinguished by the category. The events of a thread are nested by their times.
+*/
+int StageProfiler::WriteTrace(const string &filename) const
+{
+    vector<ProfileSpan> spans = Spans();
+
+    ofstream file(filename);
+    if ( !file.good() ) return ROTCEN_ERROR_CANNOT_CREATE_FILE;
+
+    string pid = to_string(getpid());
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": 0, \"args\": {\"name\": \"rotcen\"}}";
+
+    vector<bool> named(1,false);
+    for ( auto &span: spans ) {
+        if ( span.Thread >= named.size() ) named.resize(span.Thread+1,false);
+        if ( named[span.Thread] ) continue;
+        named[span.Thread] = true;
+        file << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << span.Thread <<
+                ", \"args\": {\"name\": \"thread " << span.Thread << "\"}}";
+    }
+
+    for ( auto &span: spans ) {
+        file << ",\n  {\"name\": " << json_string(span.Name) << ", \"cat\": \"" << (span.Process ? "process" : "stage") <<
+                "\", \"ph\": \"X\", \"ts\": " << json_usec(span.Start) << ", \"dur\": " << json_usec(span.Wall) <<
+                ", \"pid\": " << pid << ", \"tid\": " << span.Thread << ", \"args\": {";
+        if ( span.Frame >= 0 ) file << "\"frame\": " << json_string(FrameName(span.Frame)) << ", ";
+        file << "\"cpu_ms\": " << json_msec(span.Cpu) << ", \"child_cpu_ms\": " << json_msec(span.ChildCpu) <<
+                ", \"items\": " << span.Items << "}}";
+    }
+    file << "\n]}\n";
+
+    return file.good() ? ROTCEN_ERROR_OK : ROTCEN_ERROR_CANNOT_CREATE_FILE;
+}
+
+
+//
+// ProfileScope
+//
+
+ProfileScope::ProfileScope(const char *name, long frame):
+    Profiler(StageProfiler::Current()), Parent(nullptr), Name(name), FrameIndex(frame),
+    Start(0.0), StartCpu(0.0), ChildCpu(0.0), N_items(0)
+{
+    if ( Profiler == nullptr ) return;
+
+    Parent = active_scope;
+    active_scope = this;
+    if ( FrameIndex < 0 && Parent ) FrameIndex = Parent->FrameIndex; // a sub-stage of the frame
+
+    StartCpu = StageProfiler::ThreadCpuTime();
+    Start = Profiler->Now();
+}
+
+
+ProfileScope::~ProfileScope()
+{
+    Close();
+}
+
+
+void ProfileScope::Close()
+{
+    if ( Profiler == nullptr ) return;
+
+    ProfileSpan span;
+
+    span.Wall = Profiler->Now() - Start;
+    span.Cpu = StageProfiler::ThreadCpuTime() - StartCpu;
+    span.Name = Name;
+    span.Process = false;
+    span.Frame = FrameIndex;
+    span.Thread = StageProfiler::ThreadNumber();
+    span.Start = Start;
+    span.ChildCpu = ChildCpu;
+    span.Items = N_items;
+
+    active_scope = Parent;
+    if ( Parent ) Parent->AddChildCpu(ChildCpu); // the enclosing stage includes the applications too
+
+    Profiler->Add(span);
+    Profiler = nullptr;
+}
+
+
+void ProfileScope::Items(size_t n)
+{
+    N_items = n;
+}
+
+
+ProfileScope* ProfileScope::Active()
+{
+    return active_scope;
+}
+
+
+long ProfileScope::Frame() const
+{
+    return FrameIndex;
+}
+
+
+void ProfileScope::AddChildCpu(double usec)
+{
+    ChildCpu += usec;
+}
@@ -0,0 +1,125 @@
+#ifndef STAGE_PROFILER_H
+#define STAGE_PROFILER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <sys/resource.h>
+
+using namespace std;
+
+//
+// A timed span of the processing: a stage (possibly of a single frame) or a run
+// of an external application
+//
+struct ProfileSpan
+{
+    string Name;     // stage or application name
+    bool Process;    // span of an external application
+    long Frame;      // index of the frame (-1 if the span is not frame-specific)
+    size_t Thread;   // sequential number of the thread (in order of the first span)
+    double Start;    // microseconds since the profiler creation
+    double Wall;     // microseconds
+    double Cpu;      // CPU time of the thread (microseconds)
+    double ChildCpu; // user and system CPU time of the external applications (microseconds)
+    size_t Items;    // number of processed items (objects, pairs, tracks, ...)
+};
+
+
+//
+// Instrumentation of the processing stages.
+//
+// The library records the spans into the installed profiler only. The profiler
+// is installed for the whole process, an instrumented stage checks a single atomic
+// pointer, so nothing but this check is done if the profiling is off.
+//
+// The results are written as JSON summary (totals by stage, by application and by
+// frame) and as a trace in Chrome's trace event format (chrome://tracing, Perfetto).
+//
+class StageProfiler
+{
+public:
+    StageProfiler();
+
+    // the installed profiler (NULL if the profiling is off). The profiler must
+    // outlive the installation.
+    static StageProfiler* Current();
+    static void Install(StageProfiler *profiler);
+
+    // names of the frames for the spans' indices
+    void SetFrames(const vector<string> &frames);
+
+    // thread-safe
+    void Add(const ProfileSpan &span);
+
+    // a finished external application started at 'start' (see Now). The span belongs to the frame
+    // of the innermost active ProfileScope of the calling thread, which gets the CPU time of the
+    // application.
+    void AddProcess(const string &name, double start, const struct rusage &usage);
+
+    vector<ProfileSpan> Spans() const;
+
+    // microseconds since the profiler creation
+    double Now() const;
+
+    // the functions return ROTCEN_ERROR_OK or ROTCEN_ERROR_CANNOT_CREATE_FILE
+    int WriteSummary(const string &filename) const;
+    int WriteTrace(const string &filename) const;
+
+    static size_t ThreadNumber();
+    static double ThreadCpuTime(); // microseconds
+
+private:
+    string FrameName(long frame) const;
+
+    double Origin;
+    vector<string> Frames;
+    vector<ProfileSpan> SpanList;
+    mutable mutex SpanMutex;
+
+    static atomic<StageProfiler*> Installed;
+};
+
+
+//
+// The scope of a stage: the span is recorded at destruction if a profiler is installed
+//
+// {
+//     ProfileScope scope("match",k);
+//     ...
+//     scope.Items(pairs.size());
+// }
+//
+class ProfileScope
+{
+public:
+    // 'name' must be a string literal (it is copied only if a profiler is installed). The
+    // scope without the frame index inside a frame's scope belongs to the frame.
+    explicit ProfileScope(const char *name, long frame = -1);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    void Items(size_t n);
+
+    // records the span before the destruction (the scope must be the innermost one)
+    void Close();
+
+    // the innermost scope of the calling thread (NULL if there is no one or the profiling is off)
+    static ProfileScope* Active();
+
+    long Frame() const;
+    void AddChildCpu(double usec);
+
+private:
+    StageProfiler *Profiler;
+    ProfileScope *Parent;
+    const char *Name;
+    long FrameIndex;
+    double Start, StartCpu, ChildCpu;
+    size_t N_items;
+};
+
+#endif // STAGE_PROFILER_H
@@ -0,0 +1,123 @@
+#include "synthetic_field.h"
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+
+SyntheticFieldParams::SyntheticFieldParams():
+    N_stars(1000), N_frames(10), AngleStep(3.0), CenterX(1024.3), CenterY(1000.7),
+    Width(2048.0), Height(2048.0), PosNoise(0.05), SpuriousFraction(0.02), Seed(1)
+{
+}
+
+
+SyntheticField::SyntheticField(const SyntheticFieldParams &params):
+    FieldParams(params), Cats(), Stars(), N_common(0)
+{
+    mt19937_64 gen(FieldParams.Seed);
+    uniform_real_distribution<double> x_dist(0.5,FieldParams.Width+0.5);
+    uniform_real_distribution<double> y_dist(0.5,FieldParams.Height+0.5);
+    uniform_real_distribution<double> unit(0.0,1.0);
+    normal_distribution<double> pos_noise(0.0,FieldParams.PosNoise > 0.0 ? FieldParams.PosNoise : 1.0);
+    normal_distribution<double> mag_noise(0.0,0.01);
+
+    // stars of the first frame, the faint ones are more numerous
+    vector<double> star_x(FieldParams.N_stars), star_y(FieldParams.N_stars), star_mag(FieldParams.N_stars);
+    for ( size_t i = 0; i < FieldParams.N_stars; ++i ) {
+        star_x[i] = x_dist(gen);
+        star_y[i] = y_dist(gen);
+        star_mag[i] = 12.0 + 8.0*sqrt(unit(gen));
+    }
+
+    vector<size_t> N_frames_in(FieldParams.N_stars,0);
+    size_t N_spurious = lround(FieldParams.SpuriousFraction*FieldParams.N_stars);
+
+    for ( size_t k = 0; k < FieldParams.N_frames; ++k ) {
+        double angle = Angle(k)*M_PI/180.0;
+        double c = cos(angle), s = sin(angle);
+
+        vector<double> xs, ys, mags;
+        vector<long> stars;
+
+        for ( size_t i = 0; i < FieldParams.N_stars; ++i ) {
+            double dx = star_x[i] - FieldParams.CenterX;
+            double dy = star_y[i] - FieldParams.CenterY;
+            double x = FieldParams.CenterX + c*dx - s*dy;
+            double y = FieldParams.CenterY + s*dx + c*dy;
+            if ( x < 0.5 || x > FieldParams.Width+0.5 || y < 0.5 || y > FieldParams.Height+0.5 ) continue;
+
+            if ( FieldParams.PosNoise > 0.0 ) {
+                x += pos_noise(gen);
+                y += pos_noise(gen);
+            }
+            xs.push_back(x);
+            ys.push_back(y);
+            mags.push_back(star_mag[i] + mag_noise(gen));
+            stars.push_back(i);
+            ++N_frames_in[i];
+        }
+
+        for ( size_t i = 0; i < N_spurious; ++i ) {
+            xs.push_back(x_dist(gen));
+            ys.push_back(y_dist(gen));
+            mags.push_back(14.0 + 6.0*unit(gen));
+            stars.push_back(-1);
+        }
+
+        vector<size_t> order(xs.size());
+        for ( size_t i = 0; i < order.size(); ++i ) order[i] = i;
+        shuffle(order.begin(),order.end(),gen);
+
+        Catalog cat(order.size());
+        vector<long> row_stars(order.size());
+        for ( size_t row = 0; row < order.size(); ++row ) {
+            cat.Id(row) = row + 1;
+            cat.X(row) = xs[order[row]];
+            cat.Y(row) = ys[order[row]];
+            cat.Mag(row) = mags[order[row]];
+            row_stars[row] = stars[order[row]];
+        }
+
+        Cats.push_back(move(cat));
+        Stars.push_back(row_stars);
+    }
+
+    for ( auto n: N_frames_in ) if ( n == FieldParams.N_frames ) ++N_common;
+}
+
+
+const SyntheticFieldParams& SyntheticField::Params() const
+{
+    return FieldParams;
+}
+
+
+size_t SyntheticField::Frames() const
+{
+    return Cats.size();
+}
+
+
+const Catalog& SyntheticField::operator[](size_t frame) const
+{
+    return Cats[frame];
+}
+
+
+double SyntheticField::Angle(size_t frame) const
+{
+    return frame*FieldParams.AngleStep;
+}
+
+
+long SyntheticField::Star(size_t frame, size_t row) const
+{
+    return Stars[frame][row];
+}
+
+
+size_t SyntheticField::CommonStars() const
+{
+    return N_common;
+}
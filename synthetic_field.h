@@ -0,0 +1,63 @@
+#ifndef SYNTHETIC_FIELD_H
+#define SYNTHETIC_FIELD_H
+
+#include <vector>
+
+#include "catalog.h"
+
+using namespace std;
+
+//
+// Parameters of the synthetic field
+//
+struct SyntheticFieldParams
+{
+    SyntheticFieldParams();
+
+    size_t N_stars;          // stars in the field of the first frame (default 1000)
+    size_t N_frames;         // default 10
+    double AngleStep;        // rotation between the frames (degrees, counterclockwise, default 3)
+    double CenterX, CenterY; // rotation center (FITS pixel coordinates, default 1024.3, 1000.7)
+    double Width, Height;    // frame size (pixels, default 2048 x 2048)
+    double PosNoise;         // RMS of the measured coordinates (pixels, default 0.05)
+    double SpuriousFraction; // number of spurious objects in a frame relative to N_stars (default 0.02)
+    unsigned long Seed;      // seed of the generator (default 1)
+};
+
+
+//
+// Catalogs of a rotating star field with known rotation center.
+//
+// The stars are uniformly distributed over the first frame, frame k is rotated by
+// k*AngleStep around the center. A frame catalog has the stars inside the frame
+// with Gaussian noise of the coordinates and magnitudes, and the spurious objects
+// at random positions. The rows are shuffled and the IDs are the row numbers
+// 1..Size(), as in SExtractor's catalogs.
+//
+class SyntheticField
+{
+public:
+    explicit SyntheticField(const SyntheticFieldParams &params);
+
+    const SyntheticFieldParams& Params() const;
+
+    size_t Frames() const;
+    const Catalog& operator[](size_t frame) const;
+
+    // rotation of the frame relative to the first one (degrees)
+    double Angle(size_t frame) const;
+
+    // index of the star of the catalog row (-1 for a spurious object)
+    long Star(size_t frame, size_t row) const;
+
+    // number of the stars present in all the frames
+    size_t CommonStars() const;
+
+private:
+    SyntheticFieldParams FieldParams;
+    vector<Catalog> Cats;
+    vector<vector<long> > Stars;
+    size_t N_common;
+};
+
+#endif // SYNTHETIC_FIELD_H
@@ -0,0 +1,253 @@
+#include "triangle_matcher.h"
+#include "rotcen_errors.h"
+
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <algorithm>
+
+
+TriangleMatcherParams::TriangleMatcherParams():
+    MinScale(0.9), MaxScale(1.1), MatchRadius(5.0), TriangleRadius(0.002), N_objects(20)
+{
+}
+
+
+/*
+    Least-squares fit of the linear transformation from (x,y) to (ref_x,ref_y):
+        ref_x = c[0] + c[1]*x + c[2]*y
+        ref_y = c[3] + c[4]*x + c[5]*y
+    It returns false if the system is degenerated (e.g. all points are collinear).
+*/
+static bool fit_linear(const vector<TriangleMatcher::MatchedPair> &pairs,
+                       const double *ref_x, const double *ref_y,
+                       const double *x, const double *y, double c[6])
+{
+    size_t n = pairs.size();
+    if ( n < 3 ) return false;
+
+    // coordinates are centered for better conditioning
+    double xm = 0.0, ym = 0.0, rxm = 0.0, rym = 0.0;
+    for ( auto &p: pairs ) {
+        rxm += ref_x[p.first];
+        rym += ref_y[p.first];
+        xm += x[p.second];
+        ym += y[p.second];
+    }
+    xm /= n; ym /= n; rxm /= n; rym /= n;
+
+    double sxx = 0.0, sxy = 0.0, syy = 0.0;
+    double sx_rx = 0.0, sy_rx = 0.0, sx_ry = 0.0, sy_ry = 0.0;
+    for ( auto &p: pairs ) {
+        double dx = x[p.second] - xm;
+        double dy = y[p.second] - ym;
+        double drx = ref_x[p.first] - rxm;
+        double dry = ref_y[p.first] - rym;
+        sxx += dx*dx; sxy += dx*dy; syy += dy*dy;
+        sx_rx += dx*drx; sy_rx += dy*drx;
+        sx_ry += dx*dry; sy_ry += dy*dry;
+    }
+
+    double det = sxx*syy - sxy*sxy;
+    if ( !(fabs(det) > 1.0E-12*(sxx*syy + sxy*sxy)) || det == 0.0 ) return false;
+
+    c[1] = (sx_rx*syy - sy_rx*sxy)/det;
+    c[2] = (sy_rx*sxx - sx_rx*sxy)/det;
+    c[4] = (sx_ry*syy - sy_ry*sxy)/det;
+    c[5] = (sy_ry*sxx - sx_ry*sxy)/det;
+    c[0] = rxm - c[1]*xm - c[2]*ym;
+    c[3] = rym - c[4]*xm - c[5]*ym;
+
+    return true;
+}
+
+
+static void apply_linear(const double c[6], double x, double y, double &tx, double &ty)
+{
+    tx = c[0] + c[1]*x + c[2]*y;
+    ty = c[3] + c[4]*x + c[5]*y;
+}
+
+
+TriangleMatcher::TriangleMatcher(const TriangleMatcherParams &params): Params(params)
+{
+}
+
+
+/*
+    Build all the triangles from N_objects the brightest objects (the smallest magnitudes).
+    The vertices are ordered as: opposite to the longest side, opposite to the middle one,
+    opposite to the shortest one. So the similar triangles have corresponding vertices
+    at the same positions.
+*/
+void TriangleMatcher::BuildTriangles(const Catalog &cat, size_t N_objects, vector<Triangle> &triangles)
+{
+    const double *x = cat.X();
+    const double *y = cat.Y();
+    const double *mag = cat.Mag();
+
+    vector<size_t> idx(cat.Size());
+    iota(idx.begin(),idx.end(),0);
+    stable_sort(idx.begin(),idx.end(),[mag](size_t i, size_t j){ return mag[i] < mag[j]; });
+    if ( idx.size() > N_objects ) idx.resize(N_objects);
+
+    size_t n = idx.size();
+
+    triangles.clear();
+    if ( n >= 3 ) triangles.reserve(n*(n-1)*(n-2)/6);
+
+    for ( size_t i = 0; i < n; ++i ) {
+        for ( size_t j = i+1; j < n; ++j ) {
+            for ( size_t k = j+1; k < n; ++k ) {
+                size_t v[3] = {idx[i], idx[j], idx[k]};
+                double side[3]; // side[m] is opposite to vertex v[m]
+                side[0] = hypot(x[v[1]]-x[v[2]],y[v[1]]-y[v[2]]);
+                side[1] = hypot(x[v[0]]-x[v[2]],y[v[0]]-y[v[2]]);
+                side[2] = hypot(x[v[0]]-x[v[1]],y[v[0]]-y[v[1]]);
+
+                int ord[3] = {0,1,2};
+                sort(ord,ord+3,[&side](int a, int b){ return side[a] > side[b]; });
+
+                if ( side[ord[0]] <= 0.0 ) continue; // coincident points
+
+                Triangle tr;
+                tr.Size = side[ord[0]];
+                tr.U = side[ord[1]]/tr.Size;
+                tr.V = side[ord[2]]/tr.Size;
+                for ( int m = 0; m < 3; ++m ) tr.Vertex[m] = v[ord[m]];
+
+                triangles.push_back(tr);
+            }
+        }
+    }
+}
+
+
+void TriangleMatcher::SetReference(const Catalog &ref)
+{
+    RefX.assign(ref.X(),ref.X()+ref.Size());
+    RefY.assign(ref.Y(),ref.Y()+ref.Size());
+    RefTree.Build(ref.X(),ref.Y(),ref.Size());
+
+    BuildTriangles(ref,Params.N_objects,RefTriangles);
+    sort(RefTriangles.begin(),RefTriangles.end(),[](const Triangle &a, const Triangle &b){ return a.U < b.U; });
+}
+
+
+int TriangleMatcher::Match(const Catalog &cat, vector<MatchedPair> &pairs) const
+{
+    pairs.clear();
+
+    const double *x = cat.X();
+    const double *y = cat.Y();
+    const double *ref_x = RefX.data();
+    const double *ref_y = RefY.data();
+
+    vector<Triangle> triangles;
+    BuildTriangles(cat,Params.N_objects,triangles);
+
+    // vote for the vertices of the similar triangles
+
+    double eps = Params.TriangleRadius;
+    map<MatchedPair,size_t> votes;
+
+    for ( auto &tr: triangles ) {
+        Triangle key;
+        key.U = tr.U - eps;
+        auto it = lower_bound(RefTriangles.begin(),RefTriangles.end(),key,
+                              [](const Triangle &a, const Triangle &b){ return a.U < b.U; });
+        for ( ; it != RefTriangles.end() && it->U <= tr.U + eps; ++it ) {
+            if ( fabs(it->V - tr.V) > eps ) continue;
+            double scale = tr.Size/it->Size;
+            if ( scale < Params.MinScale || scale > Params.MaxScale ) continue;
+            for ( int m = 0; m < 3; ++m ) ++votes[MatchedPair(it->Vertex[m],tr.Vertex[m])];
+        }
+    }
+
+    if ( votes.empty() ) return ROTCEN_ERROR_BAD_MATCH;
+
+    // the strongest unique correspondences
+
+    vector<pair<size_t,MatchedPair> > ranked;
+    for ( auto &v: votes ) ranked.push_back(make_pair(v.second,v.first));
+    stable_sort(ranked.begin(),ranked.end(),[](const pair<size_t,MatchedPair> &a, const pair<size_t,MatchedPair> &b) {
+        return a.first > b.first;
+    });
+
+    size_t min_votes = max((size_t)2,ranked.front().first/2);
+
+    vector<char> ref_used(RefX.size(),0), used(cat.Size(),0);
+    vector<MatchedPair> cand;
+    for ( auto &r: ranked ) {
+        if ( r.first < min_votes && cand.size() >= 3 ) break;
+        if ( r.first < 2 ) break;
+        if ( ref_used[r.second.first] || used[r.second.second] ) continue;
+        ref_used[r.second.first] = 1;
+        used[r.second.second] = 1;
+        cand.push_back(r.second);
+    }
+
+    // fit transformation with iterative rejection of the worst pair
+
+    double c[6];
+    double rad2 = Params.MatchRadius*Params.MatchRadius;
+
+    for (;;) {
+        if ( !fit_linear(cand,ref_x,ref_y,x,y,c) ) return ROTCEN_ERROR_BAD_MATCH;
+
+        size_t worst = 0;
+        double worst_d2 = -1.0;
+        for ( size_t i = 0; i < cand.size(); ++i ) {
+            double tx, ty;
+            apply_linear(c,x[cand[i].second],y[cand[i].second],tx,ty);
+            double dx = tx - RefX[cand[i].first];
+            double dy = ty - RefY[cand[i].first];
+            if ( dx*dx + dy*dy > worst_d2 ) {
+                worst_d2 = dx*dx + dy*dy;
+                worst = i;
+            }
+        }
+        if ( worst_d2 <= rad2 ) break;
+        if ( cand.size() <= 3 ) return ROTCEN_ERROR_BAD_MATCH;
+
+        cand.erase(cand.begin()+worst);
+    }
+
+    // match all the objects within MatchRadius (the closest ones), refine the transformation and match again
+
+    for ( int iter = 0; iter < 2; ++iter ) {
+        vector<long> best(RefX.size(),-1);
+        vector<double> best_d2(RefX.size(),rad2);
+
+        for ( size_t j = 0; j < cat.Size(); ++j ) {
+            double tx, ty;
+            apply_linear(c,x[j],y[j],tx,ty);
+
+            double min_d2;
+            long nearest = RefTree.Nearest(tx,ty,Params.MatchRadius,&min_d2);
+            if ( nearest >= 0 && min_d2 <= best_d2[nearest] ) {
+                best[nearest] = j;
+                best_d2[nearest] = min_d2;
+            }
+        }
+
+        pairs.clear();
+        for ( size_t i = 0; i < RefX.size(); ++i ) {
+            if ( best[i] >= 0 ) pairs.push_back(MatchedPair(i,best[i]));
+        }
+
+        if ( iter == 0 && !fit_linear(pairs,ref_x,ref_y,x,y,c) ) break;
+    }
+
+    if ( pairs.empty() ) return ROTCEN_ERROR_BAD_MATCH;
+
+    // check scale of the final transformation (catalog size relative to the reference one)
+    double det = fabs(c[1]*c[5] - c[2]*c[4]);
+    double scale = det > 0.0 ? 1.0/sqrt(det) : 0.0;
+    if ( scale < Params.MinScale || scale > Params.MaxScale ) {
+        pairs.clear();
+        return ROTCEN_ERROR_BAD_MATCH;
+    }
+
+    return ROTCEN_ERROR_OK;
+}
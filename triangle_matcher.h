@@ -0,0 +1,67 @@
+#ifndef TRIANGLE_MATCHER_H
+#define TRIANGLE_MATCHER_H
+
+#include <vector>
+#include <utility>
+
+#include "catalog.h"
+#include "spatial_index.h"
+
+using namespace std;
+
+//
+// Parameters of the triangle matching (the meaning is the same as for 'match' application)
+//
+struct TriangleMatcherParams
+{
+    TriangleMatcherParams();
+
+    double MinScale;       // minimal allowed scale factor between the catalogs (min_scale)
+    double MaxScale;       // maximal allowed scale factor between the catalogs (max_scale)
+    double MatchRadius;    // maximal distance between matched objects after transformation (matchrad)
+    double TriangleRadius; // matching tolerance in the triangle space (trirad)
+    size_t N_objects;      // number of the brightest objects used to build triangles (nobj)
+};
+
+
+//
+// In-process asterism matcher (the algorithm of Valdes et al. 1995, PASP 107, 1119).
+//
+// The triangle space of the reference catalog is built once by SetReference.
+// Match finds similar triangles formed by the brightest objects of the given
+// catalog, votes for the corresponding vertices, fits the linear (6-parameters)
+// transformation from the catalog to the reference one with iterative rejection
+// and then matches all the objects within MatchRadius.
+//
+class TriangleMatcher
+{
+public:
+    typedef pair<size_t,size_t> MatchedPair; // (index in reference catalog, index in catalog)
+
+    explicit TriangleMatcher(const TriangleMatcherParams &params);
+
+    // the triangles are built from N_objects the brightest objects (smallest Mag values)
+    void SetReference(const Catalog &ref);
+
+    // returns ROTCEN_ERROR_OK or ROTCEN_ERROR_BAD_MATCH if no transformation was found.
+    // The matched pairs are sorted by reference index.
+    int Match(const Catalog &cat, vector<MatchedPair> &pairs) const;
+
+private:
+    struct Triangle
+    {
+        double U, V;      // triangle space coordinates (b/a, c/a for sides a >= b >= c)
+        double Size;      // the longest side
+        size_t Vertex[3]; // vertices in canonical order
+    };
+
+    static void BuildTriangles(const Catalog &cat, size_t N_objects, vector<Triangle> &triangles);
+
+    TriangleMatcherParams Params;
+
+    vector<double> RefX, RefY;
+    KdTree RefTree;
+    vector<Triangle> RefTriangles; // sorted by U
+};
+
+#endif // TRIANGLE_MATCHER_H
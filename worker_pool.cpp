@@ -0,0 +1,141 @@
+#include "worker_pool.h"
+
+#include <atomic>
+#include <exception>
+
+
+struct WorkerPool::Batch
+{
+    Batch(size_t n, const function<void(size_t)> &t): N_tasks(n), Task(t), Next(0), Done(0), Failed(false)
+    {
+    }
+
+    size_t N_tasks;
+    const function<void(size_t)> &Task;
+
+    atomic<size_t> Next;  // index of the next task to be started
+    size_t Done;          // number of finished tasks (guarded by DoneMutex)
+    atomic<bool> Failed;
+    exception_ptr Error;
+
+    mutex DoneMutex;
+    condition_variable DoneCond;
+};
+
+
+WorkerPool::WorkerPool(size_t N_threads): Stop(false)
+{
+    for ( size_t i = 0; i < N_threads; ++i ) {
+        Threads.push_back(thread(&WorkerPool::WorkerLoop,this));
+    }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(QueueMutex);
+        Stop = true;
+    }
+    QueueCond.notify_all();
+
+    for ( auto &th: Threads ) th.join();
+}
+
+
+size_t WorkerPool::Size() const
+{
+    return Threads.size() + 1;
+}
+
+
+size_t WorkerPool::JobsNumber(long N_jobs)
+{
+    if ( N_jobs > 0 ) return N_jobs;
+
+    size_t n = thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+
+/*
+    Execute tasks of the batch until there are no unstarted ones.
+    Any thread (worker or caller) may enter the function concurrently.
+*/
+void WorkerPool::Execute(Batch &batch)
+{
+    size_t i;
+    size_t n_done = 0;
+
+    while ( (i = batch.Next++) < batch.N_tasks ) {
+        if ( !batch.Failed ) {
+            try {
+                batch.Task(i);
+            } catch (...) {
+                lock_guard<mutex> lock(batch.DoneMutex);
+                if ( !batch.Failed ) {
+                    batch.Error = current_exception();
+                    batch.Failed = true;
+                }
+            }
+        }
+        ++n_done;
+    }
+
+    if ( n_done ) {
+        lock_guard<mutex> lock(batch.DoneMutex);
+        batch.Done += n_done;
+        if ( batch.Done == batch.N_tasks ) batch.DoneCond.notify_all();
+    }
+}
+
+
+void WorkerPool::WorkerLoop()
+{
+    for (;;) {
+        shared_ptr<Batch> batch;
+        {
+            unique_lock<mutex> lock(QueueMutex);
+            QueueCond.wait(lock, [this]{ return Stop || !Queue.empty(); });
+            if ( Queue.empty() ) return; // stopped and nothing to do
+
+            batch = Queue.front();
+            if ( batch->Next >= batch->N_tasks ) { // all tasks are already started
+                Queue.pop_front();
+                continue;
+            }
+        }
+        Execute(*batch);
+    }
+}
+
+
+void WorkerPool::Run(size_t N_tasks, const function<void(size_t)> &task)
+{
+    if ( N_tasks == 0 ) return;
+
+    if ( Threads.empty() || N_tasks == 1 ) { // serial execution in the calling thread
+        for ( size_t i = 0; i < N_tasks; ++i ) task(i);
+        return;
+    }
+
+    shared_ptr<Batch> batch = make_shared<Batch>(N_tasks,task);
+    {
+        lock_guard<mutex> lock(QueueMutex);
+        Queue.push_back(batch);
+    }
+    QueueCond.notify_all();
+
+    Execute(*batch);
+
+    {
+        unique_lock<mutex> lock(batch->DoneMutex);
+        batch->DoneCond.wait(lock, [&batch]{ return batch->Done == batch->N_tasks; });
+    }
+    {
+        lock_guard<mutex> lock(QueueMutex);
+        Queue.remove(batch);
+    }
+
+    if ( batch->Failed ) rethrow_exception(batch->Error);
+}
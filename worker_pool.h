@@ -0,0 +1,52 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+//
+// A bounded pool of worker threads.
+//
+// The method Run executes task(i) for i = 0 .. N_tasks-1 and returns
+// when all of them are finished. The calling thread participates in the
+// computation, so a pool of N_threads workers runs up to N_threads+1 tasks
+// concurrently and nested calls of Run from inside a task cannot deadlock.
+// If a task throws, the remaining unstarted tasks are skipped and the first
+// exception is rethrown in the calling thread.
+//
+class WorkerPool
+{
+public:
+    explicit WorkerPool(size_t N_threads = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t Size() const; // maximal number of concurrently executed tasks (including calling thread)
+
+    void Run(size_t N_tasks, const function<void(size_t)> &task);
+
+    // number of concurrent tasks for '--jobs N' value (0 means number of CPU cores)
+    static size_t JobsNumber(long N_jobs);
+private:
+    struct Batch;
+
+    void WorkerLoop();
+    static void Execute(Batch &batch);
+
+    vector<thread> Threads;
+    list<shared_ptr<Batch> > Queue;
+    mutex QueueMutex;
+    condition_variable QueueCond;
+    bool Stop;
+};
+
+#endif // WORKER_POOL_H